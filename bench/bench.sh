@@ -0,0 +1,155 @@
+#!/bin/sh
+#
+# run the benchmark suite and print the results as JSON
+#
+# usage: bench.sh [-a] [-r runs] [mempeek] > results.json
+#
+#     -a          benchmark the AST interpreter instead of the bytecode VM
+#     -r <runs>   run each benchmark <runs> times and keep the fastest run, default 3
+#
+# every benchmark script prints the number of operations it has executed as its last
+# line. the start time of mempeek is measured with an empty command and subtracted
+# from the run times. peek and poke are measured for each word size against
+# /dev/zero, a memfd and a file on tmpfs.
+#
+
+dir=$(dirname "$0")
+runs=3
+engine=bytecode
+flags=
+
+while [ $# -gt 0 ]; do
+    case "$1" in
+    -a)
+        engine=ast
+        flags=-a
+        ;;
+    -r)
+        case "$2" in
+        ''|0|*[!0-9]*)
+            echo "invalid number of runs" >&2
+            exit 2
+            ;;
+        esac
+        runs=$2
+        shift
+        ;;
+    -*)
+        echo "unknown option $1" >&2
+        exit 2
+        ;;
+    *)
+        break
+        ;;
+    esac
+    shift
+done
+
+mempeek=${1:-$dir/../bin/mempeek}
+
+if [ ! -x "$mempeek" ]; then
+    echo "$mempeek not found, run make first" >&2
+    exit 2
+fi
+
+# scratch files live on tmpfs when available, the file mapping has to be on tmpfs
+if [ -d /dev/shm ]; then tmpdir=/dev/shm; else tmpdir=${TMPDIR:-/tmp}; fi
+tmp=$(mktemp -d "$tmpdir/mempeek-bench.XXXXXX") || exit 2
+trap 'rm -rf "$tmp"' EXIT
+trap 'exit 2' INT TERM
+
+# runs mempeek $runs times with the given arguments and sets $best to the fastest run
+# in nanoseconds. the output of the last run is left in $tmp/out.
+measure()
+{
+    best=
+    n=0
+    while [ $n -lt $runs ]; do
+        start=$(date +%s%N)
+        if ! "$mempeek" $flags "$@" > "$tmp/out"; then
+            echo "mempeek $* failed" >&2
+            exit 1
+        fi
+        end=$(date +%s%N)
+
+        t=$((end - start))
+        if [ -z "$best" ] || [ $t -lt $best ]; then best=$t; fi
+        n=$((n + 1))
+    done
+}
+
+# prints the result of the last measurement, backend and width are JSON values
+# result <name> <backend> <width> <unit> <ops>
+result()
+{
+    ns=$((best - startup))
+    if [ $ns -lt 1 ]; then ns=1; fi
+
+    if [ -n "$separator" ]; then printf ',\n'; fi
+    separator=1
+
+    awk -v name="$1" -v backend="$2" -v width="$3" -v unit="$4" -v ops="$5" -v ns=$ns 'BEGIN {
+        printf "    { \"name\": \"%s\", \"backend\": %s, \"width\": %s, \"unit\": \"%s\", \"ops\": %d, \"seconds\": %.6f, \"rate\": %.0f }",
+               name, backend, width, unit, ops, ns / 1e9, ops * 1e9 / ns
+    }'
+}
+
+measure -c ""
+startup=$best
+
+printf '{\n'
+printf '  "mempeek": "%s",\n' "$mempeek"
+printf '  "engine": "%s",\n' $engine
+printf '  "runs": %d,\n' $runs
+awk -v ns=$startup 'BEGIN { printf "  \"startup_seconds\": %.6f,\n", ns / 1e9 }'
+printf '  "results": [\n'
+
+measure "$dir/expr.mp"
+result expr null null expressions "$(tail -n 1 "$tmp/out")"
+
+measure "$dir/loop.mp"
+result loop null null iterations "$(tail -n 1 "$tmp/out")"
+
+measure "$dir/calls.mp"
+result calls null null calls "$(tail -n 1 "$tmp/out")"
+
+# files are mapped at the offset given by the address, the mapping starts at 0
+head -c 4096 /dev/zero > "$tmp/map"
+
+for device in /dev/zero memfd:mempeek-bench "file:$tmp/map"; do
+    case "$device" in
+    /dev/zero) backend='"zero"' ;;
+    memfd:*) backend='"memfd"' ;;
+    file:*) backend='"tmpfs"' ;;
+    esac
+
+    for width in 8 16 32 64; do
+        setup="def BENCH 0; def WIDTH $width; map BENCH 0x1000 \"$device\""
+
+        measure -c "$setup" "$dir/peek.mp"
+        result peek "$backend" $width peeks "$(tail -n 1 "$tmp/out")"
+
+        measure -c "$setup" "$dir/poke.mp"
+        result poke "$backend" $width pokes "$(tail -n 1 "$tmp/out")"
+    done
+done
+
+measure "$dir/print.mp"
+result print null null lines "$(tail -n 1 "$tmp/out")"
+
+# the generated script only defines registers and subroutines, its run time is the
+# time to read and parse it
+"$dir/gen_regmap.sh" > "$tmp/regmap.mp"
+lines=$(wc -l < "$tmp/regmap.mp")
+
+measure "$tmp/regmap.mp"
+result parse null null lines $lines
+
+# the first run fills the cache
+mkdir "$tmp/cache"
+"$mempeek" $flags -C "$tmp/cache" "$tmp/regmap.mp" > /dev/null
+measure -C "$tmp/cache" "$tmp/regmap.mp"
+result parse_cached null null lines $lines
+
+printf '\n  ]\n'
+printf '}\n'
@@ -0,0 +1,36 @@
+#!/bin/sh
+#
+# generate a register description script of 20 lines per peripheral block
+# (50000 lines by default) to benchmark parsing of large imports
+#
+# usage: gen_regmap.sh [blocks] > regmap.mp
+#
+
+blocks=${1:-2500}
+
+i=0
+while [ $i -lt $blocks ]; do
+    cat <<EOT
+def BLK$i $(printf '0x%x' $((0x40000000 + i * 0x1000)))
+def BLK$i.CTRL 0x00
+def BLK$i.STATUS 0x04
+def BLK$i.DATA 0x08
+def BLK$i.IRQ 0x0c
+defproc blk${i}_init mode
+  poke BLK$i.CTRL (mode << 4) | 0x1 mask 0xff
+  cnt := 0
+  while (peek( BLK$i.STATUS ) & 0x1) == 0 do
+    cnt := cnt + 1
+    if cnt > 1000 then exit
+  endwhile
+  for n from 0 to 15 do
+    poke BLK$i.DATA n * 4 + mode
+  endfor
+  print "blk$i ready after " dec cnt
+endproc
+deffunc blk${i}_status()
+  return := peek( BLK$i.STATUS ) & 0xff
+endfunc
+EOT
+    i=$((i + 1))
+done
@@ -0,0 +1,149 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __ast_arena_h__
+#define __ast_arena_h__
+
+#include <vector>
+#include <memory>
+#include <utility>
+#include <new>
+
+#include <stdint.h>
+#include <stddef.h>
+
+class ASTNode;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTArena
+//////////////////////////////////////////////////////////////////////////////
+
+// owns all nodes of a compilation unit (a parsed file or command line, or a
+// subroutine body), nodes and child arrays are released together with the arena
+
+class ASTArena {
+public:
+    typedef std::shared_ptr<ASTArena> ptr;
+
+    ASTArena();
+    ~ASTArena();
+
+    void* allocate( size_t size, size_t align = alignof(void*) );
+
+    template< typename T, typename... ARGS > T* create( ARGS&&... args );
+
+
+    static ASTArena* get_current();
+    static ASTArena* set_current( ASTArena* arena );
+
+private:
+    // chunks grow with the arena, subroutine bodies are mostly small
+    static const size_t MIN_CHUNK_SIZE = 256;
+    static const size_t MAX_CHUNK_SIZE = 65536;
+
+    // list of constructed nodes, they are destructed in reverse order of construction
+    typedef struct node_entry {
+        ASTNode* node;
+        struct node_entry* prev;
+    } node_entry_t;
+
+    std::vector< char* > m_Chunks;
+    size_t m_ChunkSize = MIN_CHUNK_SIZE;
+    char* m_Pos = nullptr;
+    char* m_End = nullptr;
+
+    node_entry_t* m_LastNode = nullptr;
+
+    static ASTArena* s_Current;
+
+    ASTArena( const ASTArena& ) = delete;
+    ASTArena& operator=( const ASTArena& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// ASTArena helper functions
+//////////////////////////////////////////////////////////////////////////////
+
+// create a node in the arena of the compilation unit that is currently parsed
+template< typename T, typename... ARGS >
+inline T* make_node( ARGS&&... args )
+{
+    return ASTArena::get_current()->create<T>( std::forward<ARGS>( args )... );
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTArena inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline void* ASTArena::allocate( size_t size, size_t align )
+{
+    m_Pos = (char*)(((uintptr_t)m_Pos + align - 1) & ~(uintptr_t)(align - 1));
+
+    if( m_Pos + size > m_End ) {
+        size_t chunk_size = size > m_ChunkSize ? size : m_ChunkSize;
+        if( m_ChunkSize < MAX_CHUNK_SIZE ) m_ChunkSize *= 2;
+
+        m_Chunks.push_back( new char[ chunk_size ] );
+        m_Pos = m_Chunks.back();
+        m_End = m_Pos + chunk_size;
+    }
+
+    void* ret = m_Pos;
+    m_Pos += size;
+
+    return ret;
+}
+
+template< typename T, typename... ARGS >
+inline T* ASTArena::create( ARGS&&... args )
+{
+    T* node = new( allocate( sizeof(T), alignof(T) ) ) T( std::forward<ARGS>( args )... );
+
+    // register after construction, a node whose constructor throws is never destructed twice
+    node_entry_t* entry = (node_entry_t*)allocate( sizeof(node_entry_t) );
+    entry->node = node;
+    entry->prev = m_LastNode;
+    m_LastNode = entry;
+
+    return node;
+}
+
+inline ASTArena* ASTArena::get_current()
+{
+    return s_Current;
+}
+
+inline ASTArena* ASTArena::set_current( ASTArena* arena )
+{
+    ASTArena* prev = s_Current;
+    s_Current = arena;
+    return prev;
+}
+
+
+#endif // __ast_arena_h__
@@ -29,6 +29,11 @@
 #include "mempeek_exceptions.h"
 
 #include <math.h>
+#include <time.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 
@@ -39,7 +44,7 @@ using namespace std;
 
 static ASTNode::ptr int2float( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = args[0];
         return *(int64_t*)&d1;
     });
@@ -47,15 +52,15 @@ static ASTNode::ptr int2float( const yylloc_t& location )
 
 static ASTNode::ptr float2int( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         return (uint64_t)(int64_t)d1;
     });
 }
 
-static ASTNode::ptr fadd( const yylloc_t& location )
+static ASTNode::ptr fadd_( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = *(double*)(args + 1);
         double d3 = d1 + d2;
@@ -63,9 +68,9 @@ static ASTNode::ptr fadd( const yylloc_t& location )
     });
 }
 
-static ASTNode::ptr fsub( const yylloc_t& location )
+static ASTNode::ptr fsub_( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = *(double*)(args + 1);
         double d3 = d1 - d2;
@@ -73,9 +78,9 @@ static ASTNode::ptr fsub( const yylloc_t& location )
     });
 }
 
-static ASTNode::ptr fmul( const yylloc_t& location )
+static ASTNode::ptr fmul_( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = *(double*)(args + 1);
         double d3 = d1 * d2;
@@ -83,9 +88,9 @@ static ASTNode::ptr fmul( const yylloc_t& location )
     });
 }
 
-static ASTNode::ptr fdiv( const yylloc_t& location )
+static ASTNode::ptr fdiv_( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = *(double*)(args + 1);
         double d3 = d1 / d2;
@@ -93,9 +98,9 @@ static ASTNode::ptr fdiv( const yylloc_t& location )
     });
 }
 
-static ASTNode::ptr fsqrt( const yylloc_t& location )
+static ASTNode::ptr fsqrt_( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = sqrt( d1 );
         return *(uint64_t*)&d2;
@@ -104,7 +109,7 @@ static ASTNode::ptr fsqrt( const yylloc_t& location )
 
 static ASTNode::ptr fpow( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<2> >( location, [] ( const ASTNodeBuiltin<2>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = *(double*)(args + 1);
         double d3 = pow( d1, d2 );
@@ -114,7 +119,7 @@ static ASTNode::ptr fpow( const yylloc_t& location )
 
 static ASTNode::ptr fexp( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = exp( d1 );
         return *(uint64_t*)&d2;
@@ -123,7 +128,7 @@ static ASTNode::ptr fexp( const yylloc_t& location )
 
 static ASTNode::ptr flog( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = log( d1 );
         return *(uint64_t*)&d2;
@@ -132,7 +137,7 @@ static ASTNode::ptr flog( const yylloc_t& location )
 
 static ASTNode::ptr fsin( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = sin( d1 );
         return *(uint64_t*)&d2;
@@ -141,7 +146,7 @@ static ASTNode::ptr fsin( const yylloc_t& location )
 
 static ASTNode::ptr fcos( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = cos( d1 );
         return *(uint64_t*)&d2;
@@ -150,7 +155,7 @@ static ASTNode::ptr fcos( const yylloc_t& location )
 
 static ASTNode::ptr ftan( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = tan( d1 );
         return *(uint64_t*)&d2;
@@ -159,7 +164,7 @@ static ASTNode::ptr ftan( const yylloc_t& location )
 
 static ASTNode::ptr fasin( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = asin( d1 );
         return *(uint64_t*)&d2;
@@ -168,7 +173,7 @@ static ASTNode::ptr fasin( const yylloc_t& location )
 
 static ASTNode::ptr facos( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = acos( d1 );
         return *(uint64_t*)&d2;
@@ -177,7 +182,7 @@ static ASTNode::ptr facos( const yylloc_t& location )
 
 static ASTNode::ptr fatan( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = atan( d1 );
         return *(uint64_t*)&d2;
@@ -186,7 +191,7 @@ static ASTNode::ptr fatan( const yylloc_t& location )
 
 static ASTNode::ptr fabs_( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = fabs( d1 );
         return *(uint64_t*)&d2;
@@ -195,7 +200,7 @@ static ASTNode::ptr fabs_( const yylloc_t& location )
 
 static ASTNode::ptr ffloor( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = floor( d1 );
         return *(uint64_t*)&d2;
@@ -204,7 +209,7 @@ static ASTNode::ptr ffloor( const yylloc_t& location )
 
 static ASTNode::ptr fceil( const yylloc_t& location )
 {
-    return make_shared< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
         double d1 = *(double*)(args + 0);
         double d2 = ceil( d1 );
         return *(uint64_t*)&d2;
@@ -212,31 +217,115 @@ static ASTNode::ptr fceil( const yylloc_t& location )
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+// timing builtin functions
+//////////////////////////////////////////////////////////////////////////////
+
+static uint64_t read_clock( clockid_t clock )
+{
+    struct timespec ts;
+    clock_gettime( clock, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// the time stamp counter on x86 and the virtual counter on ARMv8. other architectures
+// fall back to the raw monotonic clock, one cycle is one nanosecond then.
+static inline uint64_t read_cycles()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t cycles;
+    asm volatile( "mrs %0, cntvct_el0" : "=r" (cycles) );
+    return cycles;
+#else
+    return read_clock( CLOCK_MONOTONIC_RAW );
+#endif
+}
+
+// the counter frequency of ARMv8 is known, the time stamp counter is calibrated once
+// against the raw monotonic clock for 10 milliseconds
+static double calibrate_cycles()
+{
+#if defined(__aarch64__)
+    uint64_t frequency;
+    asm volatile( "mrs %0, cntfrq_el0" : "=r" (frequency) );
+    return 1e9 / frequency;
+#elif defined(__i386__) || defined(__x86_64__)
+    uint64_t start_ns = read_clock( CLOCK_MONOTONIC_RAW );
+    uint64_t start_cycles = read_cycles();
+
+    uint64_t ns;
+    do ns = read_clock( CLOCK_MONOTONIC_RAW );
+    while( ns - start_ns < 10000000 );
+
+    uint64_t cycles = read_cycles() - start_cycles;
+    return cycles ? (double)(ns - start_ns) / cycles : 1.0;
+#else
+    return 1.0;
+#endif
+}
+
+static ASTNode::ptr clock_ns( const yylloc_t& location )
+{
+    return make_node< ASTNodeBuiltin<0> >( location, [] ( const ASTNodeBuiltin<0>::args_t& ) -> uint64_t {
+        return read_clock( CLOCK_MONOTONIC );
+    });
+}
+
+static ASTNode::ptr clock_raw_ns( const yylloc_t& location )
+{
+    return make_node< ASTNodeBuiltin<0> >( location, [] ( const ASTNodeBuiltin<0>::args_t& ) -> uint64_t {
+        return read_clock( CLOCK_MONOTONIC_RAW );
+    });
+}
+
+static ASTNode::ptr cycles( const yylloc_t& location )
+{
+    return make_node< ASTNodeBuiltin<0> >( location, [] ( const ASTNodeBuiltin<0>::args_t& ) -> uint64_t {
+        return read_cycles();
+    });
+}
+
+static ASTNode::ptr cycles2ns( const yylloc_t& location )
+{
+    return make_node< ASTNodeBuiltin<1> >( location, [] ( const ASTNodeBuiltin<1>::args_t& args ) -> uint64_t {
+        static const double ns_per_cycle = calibrate_cycles();
+        return (uint64_t)( args[0] * ns_per_cycle + 0.5 );
+    });
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class BuiltinManager implementation
 //////////////////////////////////////////////////////////////////////////////
 
 BuiltinManager::BuiltinManager()
 {
-    m_Builtins[ "int2float" ] = make_pair< size_t, nodecreator_t >( 1, int2float );
-    m_Builtins[ "float2int" ] = make_pair< size_t, nodecreator_t >( 1, float2int );
-    m_Builtins[ "fadd" ] = make_pair< size_t, nodecreator_t >( 2, fadd );
-    m_Builtins[ "fsub" ] = make_pair< size_t, nodecreator_t >( 2, fsub );
-    m_Builtins[ "fmul" ] = make_pair< size_t, nodecreator_t >( 2, fmul );
-    m_Builtins[ "fdiv" ] = make_pair< size_t, nodecreator_t >( 2, fdiv );
-    m_Builtins[ "fsqrt" ] = make_pair< size_t, nodecreator_t >( 1, fsqrt );
-    m_Builtins[ "fpow" ] = make_pair< size_t, nodecreator_t >( 2, fpow );
-    m_Builtins[ "flog" ] = make_pair< size_t, nodecreator_t >( 1, flog );
-    m_Builtins[ "fexp" ] = make_pair< size_t, nodecreator_t >( 1, fexp );
-    m_Builtins[ "fsin" ] = make_pair< size_t, nodecreator_t >( 1, fsin );
-    m_Builtins[ "fcos" ] = make_pair< size_t, nodecreator_t >( 1, fcos );
-    m_Builtins[ "ftan" ] = make_pair< size_t, nodecreator_t >( 1, ftan );
-    m_Builtins[ "fasin" ] = make_pair< size_t, nodecreator_t >( 1, fasin );
-    m_Builtins[ "facos" ] = make_pair< size_t, nodecreator_t >( 1, facos );
-    m_Builtins[ "fatan" ] = make_pair< size_t, nodecreator_t >( 1, fatan );
-    m_Builtins[ "fabs" ] = make_pair< size_t, nodecreator_t >( 1, fabs_ );
-    m_Builtins[ "ffloor" ] = make_pair< size_t, nodecreator_t >( 1, ffloor );
-    m_Builtins[ "fceil" ] = make_pair< size_t, nodecreator_t >( 1, fceil );
+    add_builtin( "int2float", 1, int2float );
+    add_builtin( "float2int", 1, float2int );
+    add_builtin( "fadd", 2, fadd_ );
+    add_builtin( "fsub", 2, fsub_ );
+    add_builtin( "fmul", 2, fmul_ );
+    add_builtin( "fdiv", 2, fdiv_ );
+    add_builtin( "fsqrt", 1, fsqrt_ );
+    add_builtin( "fpow", 2, fpow );
+    add_builtin( "flog", 1, flog );
+    add_builtin( "fexp", 1, fexp );
+    add_builtin( "fsin", 1, fsin );
+    add_builtin( "fcos", 1, fcos );
+    add_builtin( "ftan", 1, ftan );
+    add_builtin( "fasin", 1, fasin );
+    add_builtin( "facos", 1, facos );
+    add_builtin( "fatan", 1, fatan );
+    add_builtin( "fabs", 1, fabs_ );
+    add_builtin( "ffloor", 1, ffloor );
+    add_builtin( "fceil", 1, fceil );
+
+    add_builtin( "clock_ns", 0, clock_ns, false );
+    add_builtin( "clock_raw_ns", 0, clock_raw_ns, false );
+    add_builtin( "cycles", 0, cycles, false );
+    add_builtin( "cycles2ns", 1, cycles2ns );
 }
 
 void BuiltinManager::get_autocompletion( std::set< std::string >& completions, std::string prefix )
@@ -247,21 +336,30 @@ void BuiltinManager::get_autocompletion( std::set< std::string >& completions, s
     }
 }
 
-std::shared_ptr<ASTNode> BuiltinManager::get_subroutine( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params )
+ASTNode* BuiltinManager::get_subroutine( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params )
 {
     auto iter = m_Builtins.find( name );
     if( iter == m_Builtins.end() ) return nullptr;
 
-    if( iter->second.first != params.size() ) throw ASTExceptionSyntaxError( location );
+    if( iter->second.num_args != params.size() ) throw ASTExceptionSyntaxError( location );
 
-    ASTNode::ptr node = iter->second.second( location );
+    ASTNode::ptr node = iter->second.creator( location );
 
-    bool is_const = true;
+    bool is_const = iter->second.is_pure;
     for( auto param: params ) {
         node->add_child( param );
         is_const &= param->is_constant();
     }
 
-    if( is_const ) return make_shared< ASTNodeConstant >( location, node->execute() );
+    if( is_const ) return make_node< ASTNodeConstant >( location, node->execute() );
     else return node;
 }
+
+void BuiltinManager::add_builtin( std::string name, size_t num_args, nodecreator_t creator, bool is_pure )
+{
+    builtin_t& builtin = m_Builtins[ name ];
+
+    builtin.num_args = num_args;
+    builtin.creator = creator;
+    builtin.is_pure = is_pure;
+}
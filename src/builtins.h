@@ -33,8 +33,6 @@
 #include <set>
 #include <vector>
 #include <functional>
-#include <utility>
-#include <memory>
 
 class ASTNode;
 
@@ -50,11 +48,22 @@ public:
     void get_autocompletion( std::set< std::string >& completions, std::string prefix );
 
     bool has_subroutine( std::string name );
-    std::shared_ptr<ASTNode> get_subroutine( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params );
+    ASTNode* get_subroutine( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params );
 
 private:
-     typedef std::function< std::shared_ptr<ASTNode>( const yylloc_t& location ) > nodecreator_t;
-     typedef std::map< std::string, std::pair< size_t, nodecreator_t > > builtinmap_t;
+     typedef std::function< ASTNode*( const yylloc_t& location ) > nodecreator_t;
+
+     // builtins with side effects or results that change between calls, like reading a
+     // clock, are impure. only pure builtins with constant args are evaluated at parse time.
+     typedef struct {
+         size_t num_args;
+         nodecreator_t creator;
+         bool is_pure;
+     } builtin_t;
+
+     typedef std::map< std::string, builtin_t > builtinmap_t;
+
+     void add_builtin( std::string name, size_t num_args, nodecreator_t creator, bool is_pure = true );
 
      builtinmap_t m_Builtins;
 };
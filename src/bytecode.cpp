@@ -0,0 +1,233 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bytecode.h"
+
+#include "mempeek_ast.h"
+#include "profiler.h"
+
+#include <assert.h>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Bytecode implementation
+//////////////////////////////////////////////////////////////////////////////
+
+Bytecode::Bytecode()
+{}
+
+size_t Bytecode::add_builtin( builtin_t builtin )
+{
+    m_Builtins.push_back( builtin );
+    return m_Builtins.size() - 1;
+}
+
+Bytecode::opcode_t Bytecode::with_constant( opcode_t op )
+{
+    assert( op >= OP_ADD && op <= OP_LOR );
+
+    return (opcode_t)(op - OP_ADD + OP_ADDK);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class BytecodeCompiler implementation
+//////////////////////////////////////////////////////////////////////////////
+
+BytecodeCompiler::BytecodeCompiler()
+{
+    reset();
+}
+
+Bytecode::ptr BytecodeCompiler::compile( std::shared_ptr<ASTNode> root )
+{
+    reset();
+
+    m_Code = make_shared<Bytecode>();
+    m_Code->hold( root );
+
+    begin_unit();
+    statement( root.get() );
+    end_unit( get_position() );
+
+    emit( Bytecode::OP_RET, 0, 0, 0, 0, root.get() );
+
+    m_Code->set_num_registers( m_MaxReg );
+
+    return m_Code;
+}
+
+Bytecode::ptr BytecodeCompiler::compile_subroutine( ASTNode* body, const std::string& name, const std::vector< size_t >& param_slots,
+                                                    bool has_retval, size_t retval_slot )
+{
+    reset();
+
+    m_Code = make_shared<Bytecode>();
+
+    for( size_t slot: param_slots ) m_Code->add_param_slot( slot );
+    if( has_retval ) m_Code->set_retval_slot( retval_slot );
+
+    if( m_Profiler ) emit( Bytecode::OP_PROFENTER, 0, 0, 0, (uint64_t)m_Profiler->get_frame_name( name ), body );
+
+    begin_unit();
+    statement( body );
+    end_unit( get_position() );
+
+    // exit and break leave through the profiler as well
+    if( m_Profiler ) emit( Bytecode::OP_PROFLEAVE, 0, 0, 0, 0, body );
+
+    emit( Bytecode::OP_RET, 0, 0, 0, 0, body );
+
+    m_Code->set_num_registers( m_MaxReg );
+
+    return m_Code;
+}
+
+void BytecodeCompiler::statement( ASTNode* node )
+{
+    if( !node ) return;
+
+    // blocks have the location of their first statement, unless they hold a single statement
+    ASTNodeBlock* block = dynamic_cast< ASTNodeBlock* >( node );
+    if( m_Profiler && (!block || block->is_statement()) ) profile( node );
+
+    reg_t reg = alloc_reg();
+    node->compile( *this, reg );
+    free_reg( reg );
+}
+
+void BytecodeCompiler::expression( ASTNode* node, reg_t result )
+{
+    reg_t next = m_NextReg;
+    node->compile( *this, result );
+    free_reg( next );
+}
+
+size_t BytecodeCompiler::profile( ASTNode* node )
+{
+    const size_t pos = get_position();
+    if( !m_Profiler ) return pos;
+
+    // a loop head directly behind the marker of its statement shares the marker
+    const uint64_t line = (uint64_t)m_Profiler->get_line( node->get_location() );
+    if( pos > 0 && m_Code->get_code()[ pos - 1 ].op == Bytecode::OP_PROFLINE && m_Code->get_code()[ pos - 1 ].imm == line ) return pos - 1;
+
+    return emit( Bytecode::OP_PROFLINE, 0, 0, 0, line, node );
+}
+
+bool BytecodeCompiler::get_constant( ASTNode* node, uint64_t& value )
+{
+    // constant nodes are side effect free, a division by zero was already reported by the parser
+    if( !node->is_constant() ) return false;
+
+    value = node->execute();
+    return true;
+}
+
+void BytecodeCompiler::load_var( const Environment::var::slot_t& slot, reg_t reg, ASTNode* origin )
+{
+    switch( slot.type ) {
+    case Environment::var::slot_t::CONSTANT: emit( Bytecode::OP_LOADK, reg, 0, 0, slot.value, origin ); break;
+    case Environment::var::slot_t::GLOBAL: emit( Bytecode::OP_LOADG, reg, 0, 0, slot.value, origin ); break;
+    case Environment::var::slot_t::LOCAL: emit( Bytecode::OP_LOADL, reg, 0, 0, slot.value, origin ); break;
+    }
+}
+
+bool BytecodeCompiler::store_var( const Environment::var::slot_t& slot, reg_t reg, ASTNode* origin )
+{
+    switch( slot.type ) {
+    case Environment::var::slot_t::GLOBAL: emit( Bytecode::OP_STOREG, 0, reg, 0, slot.value, origin ); return true;
+    case Environment::var::slot_t::LOCAL: emit( Bytecode::OP_STOREL, 0, reg, 0, slot.value, origin ); return true;
+    default: return false;
+    }
+}
+
+void BytecodeCompiler::begin_loop()
+{
+    m_Contexts.push_back( { true, {} } );
+}
+
+void BytecodeCompiler::end_loop( size_t break_target )
+{
+    assert( !m_Contexts.empty() && m_Contexts.back().is_loop );
+
+    for( size_t pos: m_Contexts.back().jumps ) set_jump_target( pos, break_target );
+    m_Contexts.pop_back();
+}
+
+void BytecodeCompiler::begin_unit()
+{
+    m_Contexts.push_back( { false, {} } );
+}
+
+void BytecodeCompiler::end_unit( size_t exit_target )
+{
+    assert( !m_Contexts.empty() && !m_Contexts.back().is_loop );
+
+    for( size_t pos: m_Contexts.back().jumps ) set_jump_target( pos, exit_target );
+    m_Contexts.pop_back();
+}
+
+void BytecodeCompiler::emit_break( ASTNode* origin )
+{
+    assert( !m_Contexts.empty() );
+
+    // break leaves the innermost loop, outside of a loop it leaves the subroutine, import or script
+    m_Contexts.back().jumps.push_back( emit( Bytecode::OP_JMP, 0, 0, 0, 0, origin ) );
+}
+
+void BytecodeCompiler::emit_exit( ASTNode* origin )
+{
+    for( auto iter = m_Contexts.rbegin(); iter != m_Contexts.rend(); iter++ ) {
+        if( !iter->is_loop ) {
+            iter->jumps.push_back( emit( Bytecode::OP_JMP, 0, 0, 0, 0, origin ) );
+            return;
+        }
+    }
+
+    assert( false );
+}
+
+size_t BytecodeCompiler::emit_profiled( Bytecode::opcode_t op, reg_t a, reg_t b, reg_t c, uint64_t imm, ASTNode* origin )
+{
+    const bool is_poke = op >= Bytecode::OP_POKE8 && op <= Bytecode::OP_POKEM64 ||
+                         op >= Bytecode::OP_POKEC8 && op <= Bytecode::OP_POKEAC64;
+
+    m_Code->emit( Bytecode::OP_PROFMEMBEGIN, 0, 0, 0, 0, origin );
+    size_t pos = m_Code->emit( op, a, b, c, imm, origin );
+    m_Code->emit( Bytecode::OP_PROFMEM, is_poke, 0, 0, imm, origin );
+
+    return pos;
+}
+
+void BytecodeCompiler::reset()
+{
+    m_Code = nullptr;
+    m_NextReg = 0;
+    m_MaxReg = 0;
+    m_Contexts.clear();
+}
@@ -0,0 +1,355 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __bytecode_h__
+#define __bytecode_h__
+
+#include "environment.h"
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+
+#include <stdint.h>
+#include <stddef.h>
+
+class ASTNode;
+class Profiler;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Bytecode
+//////////////////////////////////////////////////////////////////////////////
+
+class Bytecode {
+public:
+    typedef std::shared_ptr<Bytecode> ptr;
+    typedef uint16_t reg_t;
+    typedef std::function< uint64_t( const uint64_t* ) > builtin_t;
+
+    enum opcode_t : uint16_t {
+        OP_NOP,
+
+        // register transfer: a = destination, b = source, imm = constant, address or frame offset
+        OP_LOADK, OP_MOV, OP_LOADG, OP_STOREG, OP_LOADL, OP_STOREL,
+
+        // binary operators a = b op c
+        OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD, OP_SHL, OP_SHR,
+        OP_LT, OP_GT, OP_LE, OP_GE, OP_EQ, OP_NE, OP_SLT, OP_SGT, OP_SLE, OP_SGE,
+        OP_AND, OP_XOR, OP_OR, OP_LAND, OP_LXOR, OP_LOR,
+
+        // binary operators with constant operand a = b op imm
+        OP_ADDK, OP_SUBK, OP_MULK, OP_DIVK, OP_MODK, OP_SHLK, OP_SHRK,
+        OP_LTK, OP_GTK, OP_LEK, OP_GEK, OP_EQK, OP_NEK, OP_SLTK, OP_SGTK, OP_SLEK, OP_SGEK,
+        OP_ANDK, OP_XORK, OP_ORK, OP_LANDK, OP_LXORK, OP_LORK,
+
+        // unary operators a = op b
+        OP_NEG, OP_NOT, OP_LNOT,
+
+        // control flow: imm = jump target, b = condition
+        // OP_FORTEST leaves the loop when counter a has passed limit b in direction of step c
+        OP_JMP, OP_JZ, OP_JNZ, OP_FORTEST,
+
+        // memory access: a = destination or address, b = address or value, c = mask, imm = mapping cache
+        OP_PEEK8, OP_PEEK16, OP_PEEK32, OP_PEEK64,
+        OP_POKE8, OP_POKE16, OP_POKE32, OP_POKE64,
+        OP_POKEM8, OP_POKEM16, OP_POKEM32, OP_POKEM64,
+
+        // memory access to an address that is bound in the mapping cache imm
+        OP_PEEKC8, OP_PEEKC16, OP_PEEKC32, OP_PEEKC64,
+        OP_POKEC8, OP_POKEC16, OP_POKEC32, OP_POKEC64,
+        OP_POKEMC8, OP_POKEMC16, OP_POKEMC32, OP_POKEMC64,
+
+        // atomic masked memory access, unbound and bound to the mapping cache imm
+        OP_POKEA8, OP_POKEA16, OP_POKEA32, OP_POKEA64,
+        OP_POKEAC8, OP_POKEAC16, OP_POKEAC32, OP_POKEAC64,
+
+        // output: b = value and imm = print modifier, or imm = pointer to string
+        OP_PRINT, OP_PRINTS,
+
+        // periodic execution: a = deadline, b = period, imm = ASTNodeEvery
+        OP_EVERYINIT, OP_EVERYWAIT,
+
+        // calls: a = result, b = first argument, c = number of arguments, imm = callee
+        OP_CALL, OP_BUILTIN, OP_EXEC,
+
+        OP_QUIT, OP_RET,
+
+        // profiling, emitted only when a profiler is set: imm = line record or frame name,
+        // OP_PROFMEM follows a memory access with a = is poke and imm = its mapping cache
+        OP_PROFLINE, OP_PROFENTER, OP_PROFLEAVE, OP_PROFMEMBEGIN, OP_PROFMEM
+    };
+
+    typedef struct {
+        opcode_t op;
+        reg_t a;
+        reg_t b;
+        reg_t c;
+        uint64_t imm;
+    } instruction_t;
+
+    Bytecode();
+
+    size_t emit( opcode_t op, reg_t a, reg_t b, reg_t c, uint64_t imm, ASTNode* origin );
+
+    size_t get_size();
+    void set_jump_target( size_t pos, size_t target );
+
+    size_t add_builtin( builtin_t builtin );
+
+    const instruction_t* get_code();
+    ASTNode* get_origin( size_t pos );
+    const builtin_t& get_builtin( size_t index );
+
+    size_t get_num_registers();
+    void set_num_registers( size_t num );
+
+    const std::vector< size_t >& get_param_slots();
+    void add_param_slot( size_t offset );
+
+    bool has_retval();
+    size_t get_retval_slot();
+    void set_retval_slot( size_t offset );
+
+    void hold( std::shared_ptr<ASTNode> root );
+
+    static opcode_t with_constant( opcode_t op );
+    static bool is_memory_access( opcode_t op );
+
+private:
+    std::vector< instruction_t > m_Code;
+
+    // source node of each instruction to report runtime errors
+    std::vector< ASTNode* > m_Origin;
+
+    std::vector< builtin_t > m_Builtins;
+
+    size_t m_NumRegisters = 0;
+
+    std::vector< size_t > m_ParamSlots;
+    bool m_HasRetval = false;
+    size_t m_RetvalSlot = 0;
+
+    std::shared_ptr<ASTNode> m_Root;
+
+    Bytecode( const Bytecode& ) = delete;
+    Bytecode& operator=( const Bytecode& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class BytecodeCompiler
+//////////////////////////////////////////////////////////////////////////////
+
+class BytecodeCompiler {
+public:
+    typedef Bytecode::reg_t reg_t;
+
+    BytecodeCompiler();
+
+    Bytecode::ptr compile( std::shared_ptr<ASTNode> root );
+    Bytecode::ptr compile_subroutine( ASTNode* body, const std::string& name, const std::vector< size_t >& param_slots,
+                                      bool has_retval, size_t retval_slot );
+
+    // code that is compiled with a profiler reports to it while it is executed
+    void set_profiler( Profiler* profiler );
+
+    // interface for ASTNode::compile()
+    void statement( ASTNode* node );
+    void expression( ASTNode* node, reg_t result );
+
+    // marks the line of node when profiling, returns the position of the marker
+    size_t profile( ASTNode* node );
+    bool get_constant( ASTNode* node, uint64_t& value );
+
+    reg_t alloc_reg();
+    void free_reg( reg_t reg );
+
+    size_t emit( Bytecode::opcode_t op, reg_t a, reg_t b, reg_t c, uint64_t imm, ASTNode* origin );
+    size_t get_position();
+    void set_jump_target( size_t pos, size_t target );
+
+    size_t add_builtin( Bytecode::builtin_t builtin );
+
+    void load_var( const Environment::var::slot_t& slot, reg_t reg, ASTNode* origin );
+    bool store_var( const Environment::var::slot_t& slot, reg_t reg, ASTNode* origin );
+
+    void begin_loop();
+    void end_loop( size_t break_target );
+
+    void begin_unit();
+    void end_unit( size_t exit_target );
+
+    void emit_break( ASTNode* origin );
+    void emit_exit( ASTNode* origin );
+
+private:
+    typedef struct {
+        bool is_loop;
+        std::vector< size_t > jumps;
+    } context_t;
+
+    void reset();
+
+    size_t emit_profiled( Bytecode::opcode_t op, reg_t a, reg_t b, reg_t c, uint64_t imm, ASTNode* origin );
+
+    Bytecode::ptr m_Code;
+    Profiler* m_Profiler = nullptr;
+
+    reg_t m_NextReg;
+    reg_t m_MaxReg;
+
+    std::vector< context_t > m_Contexts;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Bytecode inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline size_t Bytecode::emit( opcode_t op, reg_t a, reg_t b, reg_t c, uint64_t imm, ASTNode* origin )
+{
+    m_Code.push_back( { op, a, b, c, imm } );
+    m_Origin.push_back( origin );
+    return m_Code.size() - 1;
+}
+
+inline bool Bytecode::is_memory_access( opcode_t op )
+{
+    return op >= OP_PEEK8 && op <= OP_POKEAC64;
+}
+
+inline size_t Bytecode::get_size()
+{
+    return m_Code.size();
+}
+
+inline void Bytecode::set_jump_target( size_t pos, size_t target )
+{
+    m_Code[ pos ].imm = target;
+}
+
+inline const Bytecode::instruction_t* Bytecode::get_code()
+{
+    return m_Code.data();
+}
+
+inline ASTNode* Bytecode::get_origin( size_t pos )
+{
+    return m_Origin[ pos ];
+}
+
+inline const Bytecode::builtin_t& Bytecode::get_builtin( size_t index )
+{
+    return m_Builtins[ index ];
+}
+
+inline size_t Bytecode::get_num_registers()
+{
+    return m_NumRegisters;
+}
+
+inline void Bytecode::set_num_registers( size_t num )
+{
+    m_NumRegisters = num;
+}
+
+inline const std::vector< size_t >& Bytecode::get_param_slots()
+{
+    return m_ParamSlots;
+}
+
+inline void Bytecode::add_param_slot( size_t offset )
+{
+    m_ParamSlots.push_back( offset );
+}
+
+inline bool Bytecode::has_retval()
+{
+    return m_HasRetval;
+}
+
+inline size_t Bytecode::get_retval_slot()
+{
+    return m_RetvalSlot;
+}
+
+inline void Bytecode::set_retval_slot( size_t offset )
+{
+    m_HasRetval = true;
+    m_RetvalSlot = offset;
+}
+
+inline void Bytecode::hold( std::shared_ptr<ASTNode> root )
+{
+    m_Root = root;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class BytecodeCompiler inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline BytecodeCompiler::reg_t BytecodeCompiler::alloc_reg()
+{
+    if( m_NextReg >= m_MaxReg ) m_MaxReg = m_NextReg + 1;
+    return m_NextReg++;
+}
+
+inline void BytecodeCompiler::free_reg( reg_t reg )
+{
+    // registers are allocated like a stack, freeing a register frees all registers above
+    m_NextReg = reg;
+}
+
+inline size_t BytecodeCompiler::emit( Bytecode::opcode_t op, reg_t a, reg_t b, reg_t c, uint64_t imm, ASTNode* origin )
+{
+    if( m_Profiler && Bytecode::is_memory_access( op ) ) return emit_profiled( op, a, b, c, imm, origin );
+    return m_Code->emit( op, a, b, c, imm, origin );
+}
+
+inline void BytecodeCompiler::set_profiler( Profiler* profiler )
+{
+    m_Profiler = profiler;
+}
+
+inline size_t BytecodeCompiler::get_position()
+{
+    return m_Code->get_size();
+}
+
+inline void BytecodeCompiler::set_jump_target( size_t pos, size_t target )
+{
+    m_Code->set_jump_target( pos, target );
+}
+
+inline size_t BytecodeCompiler::add_builtin( Bytecode::builtin_t builtin )
+{
+    return m_Code->add_builtin( builtin );
+}
+
+
+#endif // __bytecode_h__
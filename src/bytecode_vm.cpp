@@ -0,0 +1,467 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "bytecode_vm.h"
+
+#include "environment.h"
+#include "mempeek_ast.h"
+#include "mempeek_exceptions.h"
+#include "output.h"
+#include "profiler.h"
+#include "trace.h"
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class BytecodeVM implementation
+//////////////////////////////////////////////////////////////////////////////
+
+BytecodeVM::BytecodeVM( Environment* env )
+ : m_Env( env )
+{}
+
+uint64_t BytecodeVM::execute( std::shared_ptr<ASTNode> root )
+{
+    Bytecode::ptr code = m_Compiler.compile( root );
+    if( !m_Profiler ) return run( code.get() );
+
+    m_Profiler->begin_run( root->get_location().file );
+
+    uint64_t status;
+    try {
+        status = run( code.get() );
+    }
+    catch( ... ) {
+        m_Profiler->end_run();
+        throw;
+    }
+
+    m_Profiler->end_run();
+    return status;
+}
+
+void BytecodeVM::set_profiler( Profiler* profiler )
+{
+    m_Profiler = profiler;
+    m_Compiler.set_profiler( profiler );
+
+    // subroutines are compiled again with or without profiling
+    m_Subroutines.clear();
+}
+
+Bytecode* BytecodeVM::get_subroutine_code( ASTNodeSubroutine* node )
+{
+    ASTNode* body = node->get_body();
+
+    // the body of node is alive, so a cached body at the same address that is alive as well is the same one
+    auto iter = m_Subroutines.find( body );
+    if( iter != m_Subroutines.end() && !iter->second.first.expired() ) return iter->second.second.get();
+
+    vector< size_t > param_slots;
+    for( const Environment::var::slot_t& param: node->get_params() ) param_slots.push_back( param.value );
+
+    Bytecode::ptr code = m_Compiler.compile_subroutine( body, node->get_name(), param_slots, node->is_function(),
+                                                        node->get_retval().value );
+    m_Subroutines[ body ] = make_pair( node->get_body_handle(), code );
+
+    return code.get();
+}
+
+uint64_t BytecodeVM::run( Bytecode* code )
+{
+    const size_t depth = m_Frames.size();
+
+    size_t base = 0;
+    if( depth > 0 ) base = m_Frames.back().base + m_Frames.back().code->get_num_registers();
+
+    const Bytecode::instruction_t* instructions = code->get_code();
+    uint64_t* r = reserve_registers( base, code->get_num_registers() );
+    size_t pc = 0;
+
+    VarStorage* vars = nullptr;
+    uint64_t* locals = nullptr;
+
+    try {
+        for(;;) {
+            const Bytecode::instruction_t& in = instructions[ pc++ ];
+
+            switch( in.op ) {
+            case Bytecode::OP_NOP: break;
+
+            case Bytecode::OP_LOADK: r[ in.a ] = in.imm; break;
+            case Bytecode::OP_MOV: r[ in.a ] = r[ in.b ]; break;
+            case Bytecode::OP_LOADG: r[ in.a ] = *(uint64_t*)in.imm; break;
+            case Bytecode::OP_STOREG: *(uint64_t*)in.imm = r[ in.b ]; break;
+            case Bytecode::OP_LOADL: r[ in.a ] = locals[ in.imm ]; break;
+            case Bytecode::OP_STOREL: locals[ in.imm ] = r[ in.b ]; break;
+
+#define BINARY_OPERATOR( OP, EXPR ) \
+            case Bytecode::OP: { const uint64_t r0 = r[ in.b ], r1 = r[ in.c ]; r[ in.a ] = (EXPR); break; } \
+            case Bytecode::OP##K: { const uint64_t r0 = r[ in.b ], r1 = in.imm; r[ in.a ] = (EXPR); break; }
+
+            BINARY_OPERATOR( OP_ADD, r0 + r1 )
+            BINARY_OPERATOR( OP_SUB, r0 - r1 )
+            BINARY_OPERATOR( OP_MUL, r0 * r1 )
+            BINARY_OPERATOR( OP_SHL, r0 << r1 )
+            BINARY_OPERATOR( OP_SHR, r0 >> r1 )
+            BINARY_OPERATOR( OP_LT, (r0 < r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_GT, (r0 > r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_LE, (r0 <= r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_GE, (r0 >= r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_EQ, (r0 == r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_NE, (r0 != r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_SLT, ((int64_t)r0 < (int64_t)r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_SGT, ((int64_t)r0 > (int64_t)r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_SLE, ((int64_t)r0 <= (int64_t)r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_SGE, ((int64_t)r0 >= (int64_t)r1) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_AND, r0 & r1 )
+            BINARY_OPERATOR( OP_XOR, r0 ^ r1 )
+            BINARY_OPERATOR( OP_OR, r0 | r1 )
+            BINARY_OPERATOR( OP_LAND, ((r0 != 0) && (r1 != 0)) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_LXOR, ((r0 != 0) != (r1 != 0)) ? 0xffffffffffffffff : 0 )
+            BINARY_OPERATOR( OP_LOR, ((r0 != 0) || (r1 != 0)) ? 0xffffffffffffffff : 0 )
+
+#undef BINARY_OPERATOR
+
+            // the compiler never emits the constant forms with a divisor of zero
+            case Bytecode::OP_DIV:
+                if( r[ in.c ] == 0 ) throw ASTExceptionDivisionByZero( code->get_origin( pc - 1 )->get_location() );
+                r[ in.a ] = r[ in.b ] / r[ in.c ];
+                break;
+
+            case Bytecode::OP_DIVK: r[ in.a ] = r[ in.b ] / in.imm; break;
+
+            case Bytecode::OP_MOD:
+                if( r[ in.c ] == 0 ) throw ASTExceptionDivisionByZero( code->get_origin( pc - 1 )->get_location() );
+                r[ in.a ] = r[ in.b ] % r[ in.c ];
+                break;
+
+            case Bytecode::OP_MODK: r[ in.a ] = r[ in.b ] % in.imm; break;
+
+            case Bytecode::OP_NEG: r[ in.a ] = -r[ in.b ]; break;
+            case Bytecode::OP_NOT: r[ in.a ] = ~r[ in.b ]; break;
+            case Bytecode::OP_LNOT: r[ in.a ] = r[ in.b ] ? 0 : 0xffffffffffffffff; break;
+
+            case Bytecode::OP_JMP:
+                // check for termination on backward jumps to be able to leave endless loops
+                if( in.imm < pc && Environment::is_terminated() ) {
+                    unwind( depth, vars );
+                    return ASTNode::STATUS_TERMINATE;
+                }
+                pc = in.imm;
+                break;
+
+            case Bytecode::OP_JZ: if( !r[ in.b ] ) pc = in.imm; break;
+            case Bytecode::OP_JNZ: if( r[ in.b ] ) pc = in.imm; break;
+
+            case Bytecode::OP_FORTEST: {
+                const int64_t i = r[ in.a ], to = r[ in.b ], step = r[ in.c ];
+                if( !(step > 0 && i <= to || step < 0 && i >= to) ) pc = in.imm;
+                break;
+            }
+
+            case Bytecode::OP_PEEK8: r[ in.a ] = peek<uint8_t>( code, pc - 1, r[ in.b ] ); break;
+            case Bytecode::OP_PEEK16: r[ in.a ] = peek<uint16_t>( code, pc - 1, r[ in.b ] ); break;
+            case Bytecode::OP_PEEK32: r[ in.a ] = peek<uint32_t>( code, pc - 1, r[ in.b ] ); break;
+            case Bytecode::OP_PEEK64: r[ in.a ] = peek<uint64_t>( code, pc - 1, r[ in.b ] ); break;
+
+            case Bytecode::OP_POKE8: poke<uint8_t>( code, pc - 1, r[ in.a ], r[ in.b ] ); break;
+            case Bytecode::OP_POKE16: poke<uint16_t>( code, pc - 1, r[ in.a ], r[ in.b ] ); break;
+            case Bytecode::OP_POKE32: poke<uint32_t>( code, pc - 1, r[ in.a ], r[ in.b ] ); break;
+            case Bytecode::OP_POKE64: poke<uint64_t>( code, pc - 1, r[ in.a ], r[ in.b ] ); break;
+
+            case Bytecode::OP_POKEM8: poke<uint8_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEM16: poke<uint16_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEM32: poke<uint32_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEM64: poke<uint64_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+
+            case Bytecode::OP_PEEKC8: r[ in.a ] = peek_bound<uint8_t>( code, pc - 1 ); break;
+            case Bytecode::OP_PEEKC16: r[ in.a ] = peek_bound<uint16_t>( code, pc - 1 ); break;
+            case Bytecode::OP_PEEKC32: r[ in.a ] = peek_bound<uint32_t>( code, pc - 1 ); break;
+            case Bytecode::OP_PEEKC64: r[ in.a ] = peek_bound<uint64_t>( code, pc - 1 ); break;
+
+            case Bytecode::OP_POKEC8: poke_bound<uint8_t>( code, pc - 1, r[ in.b ] ); break;
+            case Bytecode::OP_POKEC16: poke_bound<uint16_t>( code, pc - 1, r[ in.b ] ); break;
+            case Bytecode::OP_POKEC32: poke_bound<uint32_t>( code, pc - 1, r[ in.b ] ); break;
+            case Bytecode::OP_POKEC64: poke_bound<uint64_t>( code, pc - 1, r[ in.b ] ); break;
+
+            case Bytecode::OP_POKEMC8: poke_bound<uint8_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEMC16: poke_bound<uint16_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEMC32: poke_bound<uint32_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEMC64: poke_bound<uint64_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+
+            case Bytecode::OP_POKEA8: poke_atomic<uint8_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEA16: poke_atomic<uint16_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEA32: poke_atomic<uint32_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEA64: poke_atomic<uint64_t>( code, pc - 1, r[ in.a ], r[ in.b ], r[ in.c ] ); break;
+
+            case Bytecode::OP_POKEAC8: poke_atomic_bound<uint8_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEAC16: poke_atomic_bound<uint16_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEAC32: poke_atomic_bound<uint32_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+            case Bytecode::OP_POKEAC64: poke_atomic_bound<uint64_t>( code, pc - 1, r[ in.b ], r[ in.c ] ); break;
+
+            case Bytecode::OP_PRINT:
+                ASTNodePrint::print_value( r[ in.b ], (int)in.imm );
+                Output::end_statement();
+                break;
+
+            case Bytecode::OP_PRINTS:
+                Output::write( *(const std::string*)in.imm );
+                Output::end_statement();
+                break;
+
+            case Bytecode::OP_EVERYINIT: r[ in.a ] = ((ASTNodeEvery*)in.imm)->start_schedule(); break;
+            case Bytecode::OP_EVERYWAIT: ((ASTNodeEvery*)in.imm)->wait_deadline( r[ in.a ], r[ in.b ] ); break;
+
+            case Bytecode::OP_CALL: {
+                ASTNodeSubroutine* node = (ASTNodeSubroutine*)in.imm;
+
+                if( node->is_dropped() ) throw ASTExceptionDroppedSubroutine( node->get_location() );
+
+                Bytecode* callee = get_subroutine_code( node );
+
+                VarStorage* callee_vars = node->get_local_vars();
+                uint64_t* callee_locals = callee_vars->alloc_frame();
+
+                const vector< size_t >& param_slots = callee->get_param_slots();
+                for( size_t i = 0; i < in.c; i++ ) callee_locals[ param_slots[i] ] = r[ in.b + i ];
+
+                callee_vars->enter_frame( callee_locals );
+
+                m_Frames.push_back( { code, pc, base, in.a, vars } );
+
+                base += code->get_num_registers();
+                code = callee;
+                instructions = code->get_code();
+                r = reserve_registers( base, code->get_num_registers() );
+                pc = 0;
+
+                vars = callee_vars;
+                locals = callee_locals;
+
+                if( Environment::is_terminated() ) {
+                    unwind( depth, vars );
+                    return ASTNode::STATUS_TERMINATE;
+                }
+                break;
+            }
+
+            case Bytecode::OP_RET: {
+                if( m_Frames.size() == depth ) return ASTNode::STATUS_NORMAL;
+
+                const uint64_t retval = code->has_retval() ? locals[ code->get_retval_slot() ] : 0;
+                vars->leave_frame();
+
+                frame_t& frame = m_Frames.back();
+                code = frame.code;
+                instructions = code->get_code();
+                pc = frame.pc;
+                base = frame.base;
+                r = m_Registers.data() + base;
+                r[ frame.result ] = retval;
+
+                vars = frame.vars;
+                locals = vars ? vars->get_storage() : nullptr;
+
+                m_Frames.pop_back();
+                break;
+            }
+
+            case Bytecode::OP_BUILTIN: r[ in.a ] = code->get_builtin( in.imm )( r + in.b ); break;
+
+            case Bytecode::OP_EXEC:
+                r[ in.a ] = ((ASTNode*)in.imm)->execute();
+                if( Environment::is_terminated() ) {
+                    unwind( depth, vars );
+                    return ASTNode::STATUS_TERMINATE;
+                }
+                break;
+
+            case Bytecode::OP_QUIT:
+                unwind( depth, vars );
+                return ASTNode::STATUS_QUIT;
+
+            case Bytecode::OP_PROFLINE:
+            case Bytecode::OP_PROFENTER:
+            case Bytecode::OP_PROFLEAVE:
+            case Bytecode::OP_PROFMEMBEGIN:
+            case Bytecode::OP_PROFMEM:
+                profile( in );
+                break;
+            }
+        }
+    }
+    catch( ... ) {
+        unwind( depth, vars );
+        throw;
+    }
+}
+
+void BytecodeVM::profile( const Bytecode::instruction_t& in )
+{
+    switch( in.op ) {
+    case Bytecode::OP_PROFLINE: m_Profiler->enter_line( (Profiler::line_t*)in.imm ); break;
+    case Bytecode::OP_PROFENTER: m_Profiler->enter_subroutine( (const std::string*)in.imm ); break;
+    case Bytecode::OP_PROFLEAVE: m_Profiler->leave_subroutine(); break;
+    case Bytecode::OP_PROFMEMBEGIN: m_Profiler->begin_memory_access(); break;
+    case Bytecode::OP_PROFMEM: m_Profiler->end_memory_access( ((Environment::mapping_cache_t*)in.imm)->mmap, in.a ); break;
+    default: break;
+    }
+}
+
+void BytecodeVM::unwind( size_t depth, VarStorage* vars )
+{
+    // release the local variables of all subroutines that are still running
+    if( vars ) vars->leave_frame();
+
+    while( m_Frames.size() > depth ) {
+        if( m_Frames.back().vars ) m_Frames.back().vars->leave_frame();
+        m_Frames.pop_back();
+    }
+}
+
+template< typename T >
+inline uint64_t BytecodeVM::peek( Bytecode* code, size_t pc, uint64_t address )
+{
+    void* addr = (void*)address;
+    MMap* mmap = m_Env->get_mapping( addr, sizeof(T), *(Environment::mapping_cache_t*)code->get_code()[ pc ].imm );
+
+    if( !mmap ) throw ASTExceptionNoMapping( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    const uint64_t start = TraceRecorder::start();
+
+    uint64_t ret = mmap->peek<T>( addr );
+    if( mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), address, sizeof(T), ret, (T)~(T)0, Trace::READ );
+
+    return ret;
+}
+
+template< typename T >
+inline void BytecodeVM::poke( Bytecode* code, size_t pc, uint64_t address, uint64_t value )
+{
+    void* addr = (void*)address;
+    MMap* mmap = m_Env->get_mapping( addr, sizeof(T), *(Environment::mapping_cache_t*)code->get_code()[ pc ].imm );
+
+    if( !mmap ) throw ASTExceptionNoMapping( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    const uint64_t start = TraceRecorder::start();
+
+    mmap->poke<T>( addr, value );
+    if( mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), address, sizeof(T), (T)value, (T)~(T)0, Trace::WRITE );
+}
+
+template< typename T >
+inline void BytecodeVM::poke( Bytecode* code, size_t pc, uint64_t address, uint64_t value, uint64_t mask )
+{
+    void* addr = (void*)address;
+    MMap* mmap = m_Env->get_mapping( addr, sizeof(T), *(Environment::mapping_cache_t*)code->get_code()[ pc ].imm );
+
+    if( !mmap ) throw ASTExceptionNoMapping( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    const uint64_t start = TraceRecorder::start();
+
+    mmap->modify<T>( addr, value, mask );
+    if( mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), address, sizeof(T), (T)value, (T)mask, Trace::MODIFY );
+}
+
+template< typename T >
+inline uint64_t BytecodeVM::peek_bound( Bytecode* code, size_t pc )
+{
+    Environment::mapping_cache_t* cache = (Environment::mapping_cache_t*)code->get_code()[ pc ].imm;
+
+    const uint64_t start = TraceRecorder::start();
+
+    uint64_t ret = cache->mmap->peek<T>( cache->virt_addr );
+    if( cache->mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), cache->phys_addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), (uintptr_t)cache->phys_addr, sizeof(T), ret, (T)~(T)0, Trace::READ );
+
+    return ret;
+}
+
+template< typename T >
+inline void BytecodeVM::poke_bound( Bytecode* code, size_t pc, uint64_t value )
+{
+    Environment::mapping_cache_t* cache = (Environment::mapping_cache_t*)code->get_code()[ pc ].imm;
+
+    const uint64_t start = TraceRecorder::start();
+
+    cache->mmap->poke<T>( cache->virt_addr, value );
+    if( cache->mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), cache->phys_addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), (uintptr_t)cache->phys_addr, sizeof(T), (T)value, (T)~(T)0, Trace::WRITE );
+}
+
+template< typename T >
+inline void BytecodeVM::poke_bound( Bytecode* code, size_t pc, uint64_t value, uint64_t mask )
+{
+    Environment::mapping_cache_t* cache = (Environment::mapping_cache_t*)code->get_code()[ pc ].imm;
+
+    const uint64_t start = TraceRecorder::start();
+
+    cache->mmap->modify<T>( cache->virt_addr, value, mask );
+    if( cache->mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), cache->phys_addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), (uintptr_t)cache->phys_addr, sizeof(T), (T)value, (T)mask, Trace::MODIFY );
+}
+
+template< typename T >
+inline void BytecodeVM::poke_atomic( Bytecode* code, size_t pc, uint64_t address, uint64_t value, uint64_t mask )
+{
+    void* addr = (void*)address;
+    MMap* mmap = m_Env->get_mapping( addr, sizeof(T), *(Environment::mapping_cache_t*)code->get_code()[ pc ].imm );
+
+    if( !mmap ) throw ASTExceptionNoMapping( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    const uint64_t start = TraceRecorder::start();
+
+    mmap->modify_atomic<T>( addr, value, mask );
+    if( mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), address, sizeof(T), (T)value, (T)mask, Trace::MODIFY_ATOMIC );
+}
+
+template< typename T >
+inline void BytecodeVM::poke_atomic_bound( Bytecode* code, size_t pc, uint64_t value, uint64_t mask )
+{
+    Environment::mapping_cache_t* cache = (Environment::mapping_cache_t*)code->get_code()[ pc ].imm;
+
+    const uint64_t start = TraceRecorder::start();
+
+    cache->mmap->modify_atomic<T>( cache->virt_addr, value, mask );
+    if( cache->mmap->has_failed() ) throw ASTExceptionBusError( code->get_origin( pc )->get_location(), cache->phys_addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, code->get_origin( pc )->get_location(), (uintptr_t)cache->phys_addr, sizeof(T), (T)value, (T)mask, Trace::MODIFY_ATOMIC );
+}
@@ -0,0 +1,117 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __bytecode_vm_h__
+#define __bytecode_vm_h__
+
+#include "bytecode.h"
+
+#include <vector>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include <stdint.h>
+
+class Environment;
+class VarStorage;
+class ASTNodeSubroutine;
+class Profiler;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class BytecodeVM
+//////////////////////////////////////////////////////////////////////////////
+
+class BytecodeVM {
+public:
+    BytecodeVM( Environment* env );
+
+    // returns the completion status of the script, see ASTNode::status_t
+    uint64_t execute( std::shared_ptr<ASTNode> root );
+
+    // code that is compiled afterwards is profiled, nullptr ends profiling
+    void set_profiler( Profiler* profiler );
+
+private:
+    // saved state of a caller while a subroutine is running
+    typedef struct {
+        Bytecode* code;
+        size_t pc;
+        size_t base;
+        Bytecode::reg_t result;
+        VarStorage* vars;
+    } frame_t;
+
+    uint64_t run( Bytecode* code );
+    void unwind( size_t depth, VarStorage* vars );
+
+    // kept out of run(), the profiling instructions must not slow down code that is not profiled
+    void profile( const Bytecode::instruction_t& in );
+
+    Bytecode* get_subroutine_code( ASTNodeSubroutine* node );
+
+    uint64_t* reserve_registers( size_t base, size_t num );
+
+    template< typename T > uint64_t peek( Bytecode* code, size_t pc, uint64_t address );
+    template< typename T > void poke( Bytecode* code, size_t pc, uint64_t address, uint64_t value );
+    template< typename T > void poke( Bytecode* code, size_t pc, uint64_t address, uint64_t value, uint64_t mask );
+
+    template< typename T > uint64_t peek_bound( Bytecode* code, size_t pc );
+    template< typename T > void poke_bound( Bytecode* code, size_t pc, uint64_t value );
+    template< typename T > void poke_bound( Bytecode* code, size_t pc, uint64_t value, uint64_t mask );
+
+    template< typename T > void poke_atomic( Bytecode* code, size_t pc, uint64_t address, uint64_t value, uint64_t mask );
+    template< typename T > void poke_atomic_bound( Bytecode* code, size_t pc, uint64_t value, uint64_t mask );
+
+    Environment* m_Env;
+
+    BytecodeCompiler m_Compiler;
+    Profiler* m_Profiler = nullptr;
+
+    std::vector< uint64_t > m_Registers;
+    std::vector< frame_t > m_Frames;
+
+    // compiled subroutine bodies, the weak_ptr detects bodies that were dropped and reallocated
+    // at the same address
+    std::map< ASTNode*, std::pair< std::weak_ptr<ASTNode>, Bytecode::ptr > > m_Subroutines;
+
+    BytecodeVM( const BytecodeVM& ) = delete;
+    BytecodeVM& operator=( const BytecodeVM& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class BytecodeVM inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t* BytecodeVM::reserve_registers( size_t base, size_t num )
+{
+    if( m_Registers.size() < base + num ) m_Registers.resize( base + num );
+    return m_Registers.data() + base;
+}
+
+
+#endif // __bytecode_vm_h__
@@ -0,0 +1,185 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// thin client of the mempeek server. it does not link the interpreter, all requests
+// are executed by the server that was started with "mempeek -s <socket>".
+
+#include "server.h"
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+#include <unistd.h>
+#include <sys/un.h>
+
+using namespace std;
+
+
+static void print_usage( const char* name )
+{
+    printf( "Usage: %s [options] [script] ...\n"
+            "\n"
+            "Options:\n"
+            "    -s <socket> Connect to the server on <socket>, default is $MEMPEEK_SOCKET\n"
+            "    -c <stmt>   Execute the mempeek command <stmt>\n"
+            "    -h          Print usage\n"
+            "\n"
+            "Without scripts and commands the request is read from stdin.\n", name );
+}
+
+static bool write_all( int fd, const string& data )
+{
+    const char* p = data.c_str();
+    size_t len = data.length();
+
+    while( len > 0 ) {
+        ssize_t ret = write( fd, p, len );
+        if( ret < 0 ) {
+            if( errno == EINTR ) continue;
+            return false;
+        }
+        p += ret;
+        len -= ret;
+    }
+
+    return true;
+}
+
+static int connect_server( const char* path )
+{
+    sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+
+    if( strlen( path ) >= sizeof(addr.sun_path) ) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy( addr.sun_path, path );
+
+    int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( fd < 0 ) return -1;
+
+    if( connect( fd, (sockaddr*)&addr, sizeof(addr) ) != 0 ) {
+        int err = errno;
+        close( fd );
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+// sends one request and forwards the output, returns the status or -1 when the
+// connection was lost
+static int execute( int fd, ServerProtocol::frame_t type, const string& request )
+{
+    if( !ServerProtocol::send_frame( fd, type, request.c_str(), request.length() ) ) return -1;
+
+    for(;;) {
+        ServerProtocol::frame_t response;
+        string data;
+
+        if( !ServerProtocol::recv_frame( fd, response, data ) ) return -1;
+
+        switch( response ) {
+        case ServerProtocol::RESPONSE_STDOUT: write_all( STDOUT_FILENO, data ); break;
+        case ServerProtocol::RESPONSE_STDERR: write_all( STDERR_FILENO, data ); break;
+        case ServerProtocol::RESPONSE_EXIT: return data.length() == 1 ? (uint8_t)data[0] : -1;
+        default: return -1;
+        }
+    }
+}
+
+int main( int argc, char** argv )
+{
+    const char* path = getenv( "MEMPEEK_SOCKET" );
+    vector< pair< ServerProtocol::frame_t, string > > requests;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp( argv[i], "-h" ) == 0 ) {
+            print_usage( argv[0] );
+            return 0;
+        }
+        else if( strcmp( argv[i], "-s" ) == 0 || strcmp( argv[i], "-c" ) == 0 ) {
+            if( i + 1 >= argc ) {
+                fprintf( stderr, argv[i][1] == 's' ? "missing socket path\n" : "missing command\n" );
+                return 2;
+            }
+
+            if( argv[i][1] == 's' ) path = argv[++i];
+            else requests.push_back( make_pair( ServerProtocol::REQUEST_COMMAND, string( argv[++i] ) ) );
+        }
+        else {
+            // the server has another working directory, scripts that are not in the
+            // include path of the server are passed with their absolute path
+            char absname[ PATH_MAX ];
+            if( realpath( argv[i], absname ) ) requests.push_back( make_pair( ServerProtocol::REQUEST_FILE, string( absname ) ) );
+            else requests.push_back( make_pair( ServerProtocol::REQUEST_FILE, string( argv[i] ) ) );
+        }
+    }
+
+    if( !path ) {
+        fprintf( stderr, "no socket given, use -s or set MEMPEEK_SOCKET\n" );
+        return 2;
+    }
+
+    if( requests.size() == 0 ) {
+        string script;
+        char buf[ 4096 ];
+        size_t len;
+        while( (len = fread( buf, 1, sizeof(buf), stdin )) > 0 ) script.append( buf, len );
+        requests.push_back( make_pair( ServerProtocol::REQUEST_COMMAND, script ) );
+    }
+
+    int fd = connect_server( path );
+    if( fd < 0 ) {
+        fprintf( stderr, "cannot connect to %s: %s\n", path, strerror( errno ) );
+        return 2;
+    }
+
+    // like mempeek, errors are reported and the remaining requests are executed
+    int ret = 0;
+    for( auto request: requests ) {
+        int status = execute( fd, request.first, request.second );
+        if( status < 0 ) {
+            fprintf( stderr, "connection to %s lost\n", path );
+            ret = 2;
+            break;
+        }
+        if( status == ServerProtocol::STATUS_ERROR ) ret = 1;
+        if( status == ServerProtocol::STATUS_QUIT ) break;
+    }
+
+    close( fd );
+    return ret;
+}
@@ -26,18 +26,28 @@
 #include "environment.h"
 
 #include "md5.h"
+#include "xxhash64.h"
+#include "script_file.h"
+#include "script_cache.h"
 #include "mempeek_ast.h"
+#include "bytecode_vm.h"
+#include "ast_arena.h"
 #include "mempeek_exceptions.h"
 #include "parser.h"
 #include "lexer.h"
 
+#include <algorithm>
+#include <sstream>
+
 #include <assert.h>
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 using namespace std;
 
@@ -54,27 +64,42 @@ std::stack<int> Environment::s_DefaultModifierStack;
 
 volatile sig_atomic_t Environment::s_IsTerminated = 0;
 
+bool Environment::s_IsBytecodeEnabled = true;
+
+std::set< std::string > Environment::s_Filenames;
+
 
 Environment::Environment()
 {
     m_GlobalVars = new VarStorage;
 
+    m_FrameStack = new FrameStack;
+
     m_BuiltinManager = new BuiltinManager;
 
     m_ProcedureManager = new SubroutineManager( this );
     m_FunctionManager = new SubroutineManager( this );
+
+    m_BytecodeVM = new BytecodeVM( this );
 }
 
 Environment::~Environment()
 {
-	for( auto value: m_Mappings ) delete value.second;
+	for( MMap* mmap: m_Mappings ) delete mmap;
+	for( auto& device: m_IrqDevices ) close( device.second );
+
+	delete m_BytecodeVM;
 
 	delete m_ProcedureManager;
 	delete m_FunctionManager;
 
 	delete m_BuiltinManager;
 
+	delete m_FrameStack;
+
 	delete m_GlobalVars;
+
+	delete m_ScriptCache;
 }
 
 std::shared_ptr<ASTNode> Environment::parse( const char* str, bool is_file, bool run_once )
@@ -86,28 +111,29 @@ std::shared_ptr<ASTNode> Environment::parse( const char* str, bool is_file, bool
 std::shared_ptr<ASTNode> Environment::parse( const yylloc_t& location, const char* str, bool is_file, bool run_once )
 {
     ASTNode::ptr yyroot = nullptr;
-    FILE* file = nullptr;
+    ASTArena::ptr arena = make_shared<ASTArena>();
+    ScriptFile file;
     char* curdir = nullptr;
     string filename = str;
-    MD5 md5;
+    string key;
 
     if( is_file ) {
-        file = fopen( filename.c_str(), "r" );
-        if( !file ) {
+        bool is_open = file.open( filename );
+        if( !is_open ) {
             for( string path: m_IncludePaths ) {
                 if( path.length() > 0 && path.back() != '/' ) path += '/';
                 filename = path + str;
-                file = fopen( filename.c_str(), "r" );
-                if( file ) break;
+                is_open = file.open( filename );
+                if( is_open ) break;
             }
         }
 
-        if( !file ) throw ASTExceptionFileNotFound( location, str );
+        if( !is_open ) throw ASTExceptionFileNotFound( location, str );
 
-        if( run_once ) {
-            md5.load( filename.c_str() );
+        if( run_once || m_ScriptCache ) key = get_content_key( file.get_buffer(), file.get_size() );
 
-            if( m_ImportedFiles.find( md5 ) == m_ImportedFiles.end() ) m_ImportedFiles.insert( md5 );
+        if( run_once ) {
+            if( m_ImportedFiles.find( key ) == m_ImportedFiles.end() ) m_ImportedFiles.insert( key );
             else return nullptr;
         }
 
@@ -124,30 +150,49 @@ std::shared_ptr<ASTNode> Environment::parse( const yylloc_t& location, const cha
         }
     }
 
-    yyscan_t scanner;
-    yylex_init( &scanner );
-    yyset_extra( is_file ? filename.c_str() : "", scanner );
+    // scripts found in the cache are parsed from their tokens without the scanner
+    yytokens_t cached_tokens;
+    yytokens_t recorded_tokens;
 
-    YY_BUFFER_STATE lex_buffer;
-    if( file ) lex_buffer = yy_create_buffer( file, YY_BUF_SIZE, scanner );
-    else lex_buffer = yy_scan_string( str, scanner );
+    yylexer_t lexer = { nullptr, intern_filename( is_file ? filename : "" ), nullptr, nullptr, 0, false, false };
+    if( is_file && m_ScriptCache ) {
+        if( m_ScriptCache->load( key, cached_tokens ) ) lexer.replayed = &cached_tokens;
+        else lexer.recorded = &recorded_tokens;
+    }
 
-    yy_switch_to_buffer( lex_buffer, scanner );
+    yyscan_t scanner = nullptr;
+    YY_BUFFER_STATE lex_buffer = nullptr;
+
+    if( !lexer.replayed ) {
+        yylex_init( &scanner );
+        yyset_extra( &lexer, scanner );
+
+        // files are scanned in place, the buffer is terminated by two NUL bytes
+        if( is_file ) lex_buffer = yy_scan_buffer( file.get_buffer(), file.get_size() + 2, scanner );
+        else lex_buffer = yy_scan_string( str, scanner );
+
+        yy_switch_to_buffer( lex_buffer, scanner );
+        lexer.scanner = scanner;
+    }
 
     if( is_file ) {
         push_default_size();
         push_default_modifier();
     }
 
-    auto cleanup = [ lex_buffer, scanner, is_file, file, curdir ] () {
-        yy_delete_buffer( lex_buffer, scanner );
-        yylex_destroy( scanner );
+    ASTArena* enclosing_arena = ASTArena::set_current( arena.get() );
+
+    auto cleanup = [ lex_buffer, scanner, is_file, curdir, enclosing_arena ] () {
+        ASTArena::set_current( enclosing_arena );
+
+        if( scanner ) {
+            yy_delete_buffer( lex_buffer, scanner );
+            yylex_destroy( scanner );
+        }
 
         if( is_file ) {
             pop_default_size();
             pop_default_modifier();
-
-            fclose( file );
         }
 
         if( curdir ) {
@@ -157,17 +202,18 @@ std::shared_ptr<ASTNode> Environment::parse( const yylloc_t& location, const cha
     };
 
     try {
-        yyparse( scanner, this, yyroot );
+        yyparse( &lexer, this, yyroot );
     }
     catch( ... ) {
         cleanup();
 
-        if( is_file && run_once ) m_ImportedFiles.erase( md5 );
+        if( is_file && run_once ) m_ImportedFiles.erase( key );
 
         if( m_SubroutineContext ) {
             m_SubroutineContext->abort_subroutine();
             m_SubroutineContext = nullptr;
             m_LocalVars = nullptr;
+            m_SubroutineArena = nullptr;
         }
 
         throw;
@@ -175,7 +221,63 @@ std::shared_ptr<ASTNode> Environment::parse( const yylloc_t& location, const cha
 
     cleanup();
 
-    return yyroot;
+    // a script cut short by an unknown token must be scanned again to report it
+    if( lexer.recorded && !lexer.terminated ) m_ScriptCache->store( key, recorded_tokens );
+
+    if( !yyroot ) return nullptr;
+
+    // the returned handle keeps the whole arena alive
+    return std::shared_ptr<ASTNode>( arena, yyroot );
+}
+
+uint64_t Environment::execute( std::shared_ptr<ASTNode> root )
+{
+    if( !root ) return ASTNode::STATUS_NORMAL;
+
+    if( s_IsBytecodeEnabled ) return m_BytecodeVM->execute( root );
+    else return root->execute();
+}
+
+bool Environment::set_cache_path( std::string path )
+{
+    struct stat buf;
+    if( stat( path.c_str(), &buf ) != 0 || !S_ISDIR( buf.st_mode ) ) return false;
+
+    delete m_ScriptCache;
+    m_ScriptCache = new ScriptCache( path );
+
+    return true;
+}
+
+bool Environment::set_content_hash( std::string name )
+{
+    if( name == "md5" ) m_ContentHash = HASH_MD5;
+    else if( name == "xxh64" ) m_ContentHash = HASH_XXH64;
+    else return false;
+
+    return true;
+}
+
+void Environment::set_profiler( Profiler* profiler )
+{
+    m_BytecodeVM->set_profiler( profiler );
+}
+
+std::string Environment::get_content_key( const char* data, size_t size )
+{
+    if( m_ContentHash == HASH_XXH64 ) {
+        char key[24];
+        snprintf( key, sizeof(key), "xxh64-%016llx", (unsigned long long)XXHash64::hash( data, size ) );
+        return key;
+    }
+    else {
+        MD5 md5;
+        md5.check( (const uint8_t*)data, size );
+
+        ostringstream key;
+        key << md5;
+        return key.str();
+    }
 }
 
 bool Environment::add_include_path( std::string path )
@@ -229,25 +331,65 @@ bool Environment::map_memory( void* phys_addr, size_t size, std::string device )
 	MMap* mmap = MMap::create( phys_addr, size, device.c_str() );
 	if( !mmap ) return false;
 
-	m_Mappings[ phys_addr ] = mmap;
+	// a mapping with the same base as an older one is placed behind it and hides it from lookups
+	auto iter = upper_bound( m_Mappings.begin(), m_Mappings.end(), phys_addr,
+	                         [] ( void* addr, MMap* mmap ) { return addr < mmap->get_base_address(); } );
+	m_Mappings.insert( iter, mmap );
+
 	return true;
 }
 
 MMap* Environment::get_mapping( void* phys_addr, size_t size )
 {
-	if( m_Mappings.empty() ) return nullptr;
-
-	auto iter = m_Mappings.upper_bound( phys_addr );
+	auto iter = upper_bound( m_Mappings.begin(), m_Mappings.end(), phys_addr,
+	                         [] ( void* addr, MMap* mmap ) { return addr < mmap->get_base_address(); } );
 
-	MMap* mmap;
 	if( iter == m_Mappings.begin() ) return nullptr;
-	else if( iter == m_Mappings.end() ) mmap = m_Mappings.rbegin()->second;
-	else mmap = (--iter)->second;
 
+	MMap* mmap = *(--iter);
 	if( (uint8_t*)mmap->get_base_address() + mmap->get_size() < (uint8_t*)phys_addr + size ) return nullptr;
 	else return mmap;
 }
 
+bool Environment::bind_mapping( void* phys_addr, size_t size, mapping_cache_t& cache )
+{
+    MMap* mmap = get_mapping( phys_addr, size, cache );
+    if( !mmap ) return false;
+
+    cache.phys_addr = phys_addr;
+    cache.virt_addr = mmap->get_virtual_address( phys_addr );
+
+    return true;
+}
+
+int Environment::open_irq_device( std::string device )
+{
+    auto iter = m_IrqDevices.find( device );
+    if( iter != m_IrqDevices.end() ) return iter->second;
+
+    // "fd:<n>" uses a file descriptor inherited from the parent process, like an eventfd
+    if( device.compare( 0, 3, "fd:" ) == 0 ) {
+        const char* number = device.c_str() + 3;
+        char* end;
+        errno = 0;
+        long inherited = strtol( number, &end, 10 );
+        if( end == number || *end || errno || inherited < 0 || inherited > INT_MAX ) return -1;
+
+        int fd = fcntl( inherited, F_DUPFD_CLOEXEC, 0 );
+        if( fd >= 0 ) m_IrqDevices[ device ] = fd;
+        return fd;
+    }
+
+    std::string file = MMap::get_device_file( device.c_str() );
+    if( file.empty() ) return -1;
+
+    int fd = open( file.c_str(), O_RDWR | O_CLOEXEC );
+    if( fd < 0 ) return -1;
+
+    m_IrqDevices[ device ] = fd;
+    return fd;
+}
+
 void Environment::enter_subroutine_context( const yylloc_t& location, std::string name, bool is_function )
 {
     assert( m_SubroutineContext == nullptr && m_LocalVars == nullptr );
@@ -261,6 +403,9 @@ void Environment::enter_subroutine_context( const yylloc_t& location, std::strin
     m_SubroutineContext = is_function ? m_FunctionManager : m_ProcedureManager;
 
     m_LocalVars = m_SubroutineContext->begin_subroutine( location, name, is_function );
+
+    m_SubroutineArena = make_shared<ASTArena>();
+    m_EnclosingArena = ASTArena::set_current( m_SubroutineArena.get() );
 }
 
 void Environment::set_subroutine_param( std::string name )
@@ -270,11 +415,11 @@ void Environment::set_subroutine_param( std::string name )
     m_SubroutineContext->set_param( name );
 }
 
-void Environment::set_subroutine_body( std::shared_ptr<ASTNode> body  )
+void Environment::set_subroutine_body( ASTNode* body  )
 {
     assert( m_SubroutineContext );
 
-    m_SubroutineContext->set_body( body );
+    m_SubroutineContext->set_body( std::shared_ptr<ASTNode>( m_SubroutineArena, body ) );
 }
 
 void Environment::commit_subroutine_context( )
@@ -285,18 +430,21 @@ void Environment::commit_subroutine_context( )
 
     m_SubroutineContext = nullptr;
     m_LocalVars = nullptr;
+
+    ASTArena::set_current( m_EnclosingArena );
+    m_SubroutineArena = nullptr;
 }
 
-std::shared_ptr<ASTNode> Environment::get_procedure( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params )
+ASTNode* Environment::get_procedure( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params )
 {
-    std::shared_ptr<ASTNode> node = m_ProcedureManager->get_subroutine( location, name, params );
+    ASTNode* node = m_ProcedureManager->get_subroutine( location, name, params );
     if( !node ) throw ASTExceptionNamingConflict( location, name );
     return node;
 }
 
-std::shared_ptr<ASTNode> Environment::get_function( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params )
+ASTNode* Environment::get_function( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params )
 {
-    std::shared_ptr<ASTNode> node = m_BuiltinManager->get_subroutine( location, name, params );
+    ASTNode* node = m_BuiltinManager->get_subroutine( location, name, params );
     if( node ) return node;
 
     node = m_FunctionManager->get_subroutine( location, name, params );
@@ -304,6 +452,12 @@ std::shared_ptr<ASTNode> Environment::get_function( const yylloc_t& location, st
     return node;
 }
 
+const char* Environment::intern_filename( std::string name )
+{
+    // locations of all nodes share the file names, the table is never shrunk
+    return s_Filenames.insert( name ).first->c_str();
+}
+
 uint64_t Environment::parse_int( string str )
 {
     uint64_t value = 0;
@@ -425,7 +579,7 @@ VarStorage* SubroutineManager::begin_subroutine( const yylloc_t& location, std::
 
     m_PendingName = name;
     m_PendingSubroutine = new subroutine_t;
-    m_PendingSubroutine->vars = new VarStorage;
+    m_PendingSubroutine->vars = new VarStorage( m_Environment->get_frame_stack() );
     m_PendingSubroutine->location = location;
 
     if( is_function ) {
@@ -493,7 +647,7 @@ void SubroutineManager::get_autocompletion( std::set< std::string >& completions
     }
 }
 
-std::shared_ptr<ASTNode> SubroutineManager::get_subroutine( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params )
+ASTNode* SubroutineManager::get_subroutine( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params )
 {
     subroutine_t* subroutine;
 
@@ -506,7 +660,7 @@ std::shared_ptr<ASTNode> SubroutineManager::get_subroutine( const yylloc_t& loca
 
     if( subroutine->params.size() != params.size() ) throw ASTExceptionSyntaxError( location );
 
-    ASTNode::ptr node = make_shared<ASTNodeSubroutine>( location, subroutine->body, subroutine->vars, subroutine->params, subroutine->retval );
+    ASTNode::ptr node = make_node<ASTNodeSubroutine>( location, name, subroutine->body, subroutine->vars, subroutine->params, subroutine->retval );
 
     for( auto param: params ) node->add_child( param );
 
@@ -518,21 +672,16 @@ std::shared_ptr<ASTNode> SubroutineManager::get_subroutine( const yylloc_t& loca
 // class VarStorage implementation
 //////////////////////////////////////////////////////////////////////////////
 
-VarStorage::VarStorage()
+VarStorage::VarStorage( FrameStack* frames )
+ : m_Frames( frames )
 {}
 
 VarStorage::~VarStorage()
 {
     for( auto value: m_Vars ) delete value.second;
-
-    if( m_Storage ) delete[] m_Storage;
-    while( !m_Stack.empty() ) {
-        delete[] m_Stack.top();
-        m_Stack.pop();
-    }
 }
 
-Environment::var* VarStorage::alloc_def( std::string name )
+Environment::var* VarStorage::alloc_def( std::string name, uint64_t value )
 {
     auto iter = m_Vars.find( name );
 
@@ -540,18 +689,19 @@ Environment::var* VarStorage::alloc_def( std::string name )
         size_t dot = name.find( '.' );
 
         if( dot == string::npos ) {
-            Environment::var* var = new VarStorage::defvar();
+            Environment::var* var = new VarStorage::defvar( value );
             iter = m_Vars.insert( make_pair( name, var ) ).first;
         }
         else {
             auto base = m_Vars.find( name.substr( 0, dot ) );
             if( base == m_Vars.end() ) return nullptr;
 
-            Environment::var* var = new VarStorage::structvar( base->second );
+            Environment::var* var = new VarStorage::structvar( base->second, value );
             iter = m_Vars.insert( make_pair( name, var ) ).first;
         }
     }
     else if( !iter->second->is_def() ) return nullptr;
+    else ((VarStorage::defvar*)iter->second)->set( value );
 
     return iter->second;
 }
@@ -612,6 +762,45 @@ std::set< std::string > VarStorage::get_struct_members( std::string name )
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class FrameStack implementation
+//////////////////////////////////////////////////////////////////////////////
+
+FrameStack::FrameStack()
+{
+    uint64_t* base = new uint64_t[ SEGMENT_SIZE ];
+    m_Segments.push_back( { base, base + SEGMENT_SIZE } );
+
+    m_Top = base;
+    m_End = base + SEGMENT_SIZE;
+}
+
+FrameStack::~FrameStack()
+{
+    for( segment_t& segment: m_Segments ) delete[] segment.base;
+}
+
+uint64_t* FrameStack::alloc_segment( size_t size )
+{
+    // the current segment is full, continue with the next one and replace it if it is too small
+    if( ++m_Segment == m_Segments.size() ) m_Segments.push_back( { nullptr, nullptr } );
+
+    segment_t& segment = m_Segments[ m_Segment ];
+    if( (size_t)(segment.end - segment.base) < size ) {
+        delete[] segment.base;
+
+        const size_t segment_size = size > SEGMENT_SIZE ? size : SEGMENT_SIZE;
+        segment.base = new uint64_t[ segment_size ];
+        segment.end = segment.base + segment_size;
+    }
+
+    m_Top = segment.base + size;
+    m_End = segment.end;
+
+    return segment.base;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class Environment::var implementation
 //////////////////////////////////////////////////////////////////////////////
@@ -634,14 +823,18 @@ bool Environment::var::is_local() const
 // class VarStorage::defvar implementation
 //////////////////////////////////////////////////////////////////////////////
 
+VarStorage::defvar::defvar( uint64_t value )
+ : m_Value( value )
+{}
+
 bool VarStorage::defvar::is_def() const
 {
     return true;
 }
 
-uint64_t VarStorage::defvar::get() const
+Environment::var::slot_t VarStorage::defvar::get_slot() const
 {
-    return m_Value;
+    return { slot_t::CONSTANT, m_Value, nullptr };
 }
 
 void VarStorage::defvar::set( uint64_t value )
@@ -654,23 +847,14 @@ void VarStorage::defvar::set( uint64_t value )
 // class VarStorage::structvar implementation
 //////////////////////////////////////////////////////////////////////////////
 
-VarStorage::structvar::structvar( const Environment::var* base )
- : m_Base( base )
+VarStorage::structvar::structvar( const Environment::var* base, uint64_t offset )
+ : defvar( offset ),
+   m_Base( base )
 {}
 
-bool VarStorage::structvar::is_def() const
+Environment::var::slot_t VarStorage::structvar::get_slot() const
 {
-    return true;
-}
-
-uint64_t VarStorage::structvar::get() const
-{
-    return m_Base->get() + m_Offset;
-}
-
-void VarStorage::structvar::set( uint64_t offset )
-{
-    m_Offset = offset;
+    return { slot_t::CONSTANT, m_Base->get_slot().value + m_Value, nullptr };
 }
 
 
@@ -678,14 +862,9 @@ void VarStorage::structvar::set( uint64_t offset )
 // class VarStorage::globalvar implementation
 //////////////////////////////////////////////////////////////////////////////
 
-uint64_t VarStorage::globalvar::get() const
+Environment::var::slot_t VarStorage::globalvar::get_slot() const
 {
-    return m_Value;
-}
-
-void VarStorage::globalvar::set( uint64_t value )
-{
-    m_Value = value;
+    return { slot_t::GLOBAL, (uint64_t)&m_Value, nullptr };
 }
 
 
@@ -703,14 +882,9 @@ bool VarStorage::localvar::is_local() const
     return true;
 }
 
-uint64_t VarStorage::localvar::get() const
+Environment::var::slot_t VarStorage::localvar::get_slot() const
 {
-    return m_Storage[ m_Offset ];
-}
-
-void VarStorage::localvar::set( uint64_t value )
-{
-    m_Storage[ m_Offset ] = value;
+    return { slot_t::LOCAL, m_Offset, &m_Storage };
 }
 
 
@@ -722,12 +896,7 @@ VarStorage::refvar::refvar( Environment::var* var)
  : m_Var( var )
 {}
 
-uint64_t VarStorage::refvar::get() const
-{
-    return m_Var->get();
-}
-
-void VarStorage::refvar::set( uint64_t value )
+Environment::var::slot_t VarStorage::refvar::get_slot() const
 {
-    m_Var->set( value );
+    return m_Var->get_slot();
 }
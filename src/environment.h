@@ -29,7 +29,6 @@
 #include "mempeek_parser.h"
 #include "builtins.h"
 #include "mmap.h"
-#include "md5.h"
 
 #include <string>
 #include <utility>
@@ -48,21 +47,45 @@
 
 class SubroutineManager;
 class VarStorage;
+class FrameStack;
 class ASTNode;
+class BytecodeVM;
+class Profiler;
+class ASTArena;
+class ScriptCache;
 
 class Environment {
 public:
 	class var;
 
+    // cache of a peek or poke site, the mapping that was hit last is checked
+    // first. Sites with a constant address bind the virtual address once.
+    typedef struct {
+        MMap* mmap;
+        void* phys_addr;
+        volatile void* virt_addr;
+    } mapping_cache_t;
+
 	Environment();
 	~Environment();
 
 	std::shared_ptr<ASTNode> parse( const char* str, bool is_file, bool run_once );
     std::shared_ptr<ASTNode> parse( const yylloc_t& location, const char* str, bool is_file, bool run_once );
 
+    uint64_t execute( std::shared_ptr<ASTNode> root );
+
     bool add_include_path( std::string path );
 
-	var* alloc_def( std::string name );
+    // scripts are cached in the directory as token streams
+    bool set_cache_path( std::string path );
+
+    // hash that identifies the content of imported and cached files, "md5" or "xxh64"
+    bool set_content_hash( std::string name );
+
+    // scripts executed by the bytecode VM afterwards are profiled, nullptr ends profiling
+    void set_profiler( Profiler* profiler );
+
+	var* alloc_def( std::string name, uint64_t value );
 	var* alloc_var( std::string name );
     var* alloc_global( std::string name );
     var* alloc_static( std::string name );
@@ -75,14 +98,19 @@ public:
     bool map_memory( void* phys_addr, size_t size, std::string device );
 
 	MMap* get_mapping( void* phys_addr, size_t size );
+    MMap* get_mapping( void* phys_addr, size_t size, mapping_cache_t& cache );
+    bool bind_mapping( void* phys_addr, size_t size, mapping_cache_t& cache );
+
+    // file descriptor of a device for interrupt handling, opened once and kept open
+    int open_irq_device( std::string device );
 
 	void enter_subroutine_context( const yylloc_t& location, std::string name, bool is_function );
     void set_subroutine_param( std::string name );
-    void set_subroutine_body( std::shared_ptr<ASTNode> body );
+    void set_subroutine_body( ASTNode* body );
 	void commit_subroutine_context();
 
-	std::shared_ptr<ASTNode> get_procedure( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params );
-    std::shared_ptr<ASTNode> get_function( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params );
+	ASTNode* get_procedure( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params );
+    ASTNode* get_function( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params );
 
     bool drop_procedure( std::string name );
     bool drop_function( std::string name );
@@ -101,13 +129,25 @@ public:
     static void clear_terminate();
     static bool is_terminated();
 
+    static void set_bytecode_enabled( bool enabled );
+    static bool is_bytecode_enabled();
+
+    FrameStack* get_frame_stack();
+
+    static const char* intern_filename( std::string name );
+
     static uint64_t parse_int( std::string str );
     static uint64_t parse_float( std::string str );
 
 private:
+    std::string get_content_key( const char* data, size_t size );
+
     VarStorage* m_GlobalVars;
 
-	std::map< void*, MMap* > m_Mappings;
+    // sorted by base address, mappings are never released as sites may cache them
+	std::vector< MMap* > m_Mappings;
+
+	std::map< std::string, int > m_IrqDevices;
 
 	BuiltinManager* m_BuiltinManager;
 
@@ -117,8 +157,20 @@ private:
 	SubroutineManager* m_SubroutineContext = nullptr;
     VarStorage* m_LocalVars = nullptr;
 
+    // nodes of a subroutine body are allocated in an arena of their own
+    std::shared_ptr<ASTArena> m_SubroutineArena;
+    ASTArena* m_EnclosingArena = nullptr;
+
+    BytecodeVM* m_BytecodeVM;
+
+    FrameStack* m_FrameStack;
+
 	std::vector< std::string > m_IncludePaths;
-	std::set< MD5 > m_ImportedFiles;
+	std::set< std::string > m_ImportedFiles;
+
+	enum { HASH_MD5, HASH_XXH64 } m_ContentHash = HASH_MD5;
+
+	ScriptCache* m_ScriptCache = nullptr;
 
 	static int s_DefaultSize;
 	static std::stack<int> s_DefaultSizeStack;
@@ -127,6 +179,10 @@ private:
     static std::stack<int> s_DefaultModifierStack;
 
     static volatile sig_atomic_t s_IsTerminated;
+
+    static std::set< std::string > s_Filenames;
+
+    static bool s_IsBytecodeEnabled;
 };
 
 
@@ -150,7 +206,7 @@ public:
     void get_autocompletion( std::set< std::string >& completions, std::string prefix );
 
     bool has_subroutine( std::string name );
-    std::shared_ptr<ASTNode> get_subroutine( const yylloc_t& location, std::string name, std::vector< std::shared_ptr<ASTNode> >& params );
+    ASTNode* get_subroutine( const yylloc_t& location, std::string name, std::vector< ASTNode* >& params );
 
 private:
     typedef struct {
@@ -176,10 +232,10 @@ private:
 
 class VarStorage {
 public:
-    VarStorage();
+    VarStorage( FrameStack* frames = nullptr );
     ~VarStorage();
 
-    Environment::var* alloc_def( std::string name );
+    Environment::var* alloc_def( std::string name, uint64_t value );
     Environment::var* alloc_global( std::string name );
     Environment::var* alloc_ref( std::string name, Environment::var* var );
     Environment::var* alloc_local( std::string name );
@@ -190,8 +246,14 @@ public:
 
     const Environment::var* get( std::string name );
 
-    void push();
-    void pop();
+    // a call reserves the frame of the callee, the arguments are stored into it
+    // and then the frame is entered, a frame that is never entered is discarded
+    uint64_t* alloc_frame();
+    void enter_frame( uint64_t* frame );
+    void leave_frame();
+    void discard_frame( uint64_t* frame );
+
+    uint64_t* get_storage();
 
 private:
     class defvar;
@@ -202,9 +264,46 @@ private:
 
     std::map< std::string, Environment::var* > m_Vars;
 
+    FrameStack* m_Frames;
+
     uint64_t* m_Storage = nullptr;
     size_t m_StorageSize = 0;
-    std::stack< uint64_t* > m_Stack;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class FrameStack
+//////////////////////////////////////////////////////////////////////////////
+
+// storage of the local variables of all running subroutines. The stack grows
+// by segments that are kept for reuse, frames never move once they are allocated.
+
+class FrameStack {
+public:
+    FrameStack();
+    ~FrameStack();
+
+    uint64_t* alloc( size_t size );
+    void release( uint64_t* frame );
+
+private:
+    static const size_t SEGMENT_SIZE = 16384;
+
+    typedef struct {
+        uint64_t* base;
+        uint64_t* end;
+    } segment_t;
+
+    uint64_t* alloc_segment( size_t size );
+
+    std::vector< segment_t > m_Segments;
+    size_t m_Segment = 0;
+
+    uint64_t* m_Top;
+    uint64_t* m_End;
+
+    FrameStack( const FrameStack& ) = delete;
+    FrameStack& operator=( const FrameStack& ) = delete;
 };
 
 
@@ -212,15 +311,26 @@ private:
 // class Environment::var
 //////////////////////////////////////////////////////////////////////////////
 
+// vars are symbol table entries only, the parser resolves every reference to a
+// slot and the interpreters access the value through the slot
+
 class  Environment::var {
 public:
+    typedef struct {
+        enum { CONSTANT, GLOBAL, LOCAL } type;
+        uint64_t value;             // constant value, address of a global or offset of a local
+        uint64_t* const* frame;     // storage of the subroutine a local belongs to
+    } slot_t;
+
 	virtual ~var();
 
 	virtual bool is_def() const;
     virtual bool is_local() const;
 
-	virtual uint64_t get() const = 0;
-	virtual void set( uint64_t value ) = 0;
+    virtual slot_t get_slot() const = 0;
+
+    static uint64_t load( const slot_t& slot );
+    static void store( const slot_t& slot, uint64_t value );
 };
 
 
@@ -230,13 +340,16 @@ public:
 
 class VarStorage::defvar : public Environment::var {
 public:
+    defvar( uint64_t value );
+
     bool is_def() const override;
 
-    uint64_t get() const override;
-    void set( uint64_t value ) override;
+    slot_t get_slot() const override;
 
-private:
-    uint64_t m_Value = 0;
+    void set( uint64_t value );
+
+protected:
+    uint64_t m_Value;
 };
 
 
@@ -244,17 +357,15 @@ private:
 // class VarStorage::structvar
 //////////////////////////////////////////////////////////////////////////////
 
-class VarStorage::structvar : public Environment::var {
-public:
-    structvar( const Environment::var* base );
+// the value of a struct member is the offset to the base of the struct
 
-    bool is_def() const override;
+class VarStorage::structvar : public VarStorage::defvar {
+public:
+    structvar( const Environment::var* base, uint64_t offset );
 
-    uint64_t get() const override;
-    void set( uint64_t offset ) override;
+    slot_t get_slot() const override;
 
 private:
-    uint64_t m_Offset = 0;
     const Environment::var* m_Base;
 };
 
@@ -265,8 +376,7 @@ private:
 
 class VarStorage::globalvar : public Environment::var {
 public:
-    uint64_t get() const override;
-    void set( uint64_t value ) override;
+    slot_t get_slot() const override;
 
 private:
     uint64_t m_Value = 0;
@@ -283,8 +393,7 @@ public:
 
     bool is_local() const override;
 
-    uint64_t get() const override;
-    void set( uint64_t value ) override;
+    slot_t get_slot() const override;
 
 private:
     uint64_t*& m_Storage;
@@ -300,8 +409,7 @@ class VarStorage::refvar : public Environment::var {
 public:
     refvar( Environment::var* var );
 
-    uint64_t get() const override;
-    void set( uint64_t value ) override;
+    slot_t get_slot() const override;
 
 private:
     Environment::var* m_Var;
@@ -312,9 +420,9 @@ private:
 // class Environment inline functions
 //////////////////////////////////////////////////////////////////////////////
 
-inline Environment::var* Environment::alloc_def( std::string name )
+inline Environment::var* Environment::alloc_def( std::string name, uint64_t value )
 {
-    return m_GlobalVars->alloc_def( name );
+    return m_GlobalVars->alloc_def( name, value );
 }
 
 inline Environment::var* Environment::alloc_var( std::string name )
@@ -341,6 +449,12 @@ inline Environment::var* Environment::alloc_static( std::string name )
     else return m_GlobalVars->alloc_global( name );
 }
 
+inline MMap* Environment::get_mapping( void* phys_addr, size_t size, mapping_cache_t& cache )
+{
+    if( cache.mmap && cache.mmap->contains( phys_addr, size ) ) return cache.mmap;
+    else return cache.mmap = get_mapping( phys_addr, size );
+}
+
 inline std::set< std::string > Environment::get_struct_members( std::string name )
 {
     return m_GlobalVars->get_struct_members( name );
@@ -356,6 +470,11 @@ inline bool Environment::drop_function( std::string name )
     return m_FunctionManager->drop_subroutine( name );
 }
 
+inline FrameStack* Environment::get_frame_stack()
+{
+    return m_FrameStack;
+}
+
 inline void Environment::set_terminate()
 {
     s_IsTerminated = 1;
@@ -371,6 +490,16 @@ inline bool Environment::is_terminated()
     return s_IsTerminated == 1;
 }
 
+inline void Environment::set_bytecode_enabled( bool enabled )
+{
+    s_IsBytecodeEnabled = enabled;
+}
+
+inline bool Environment::is_bytecode_enabled()
+{
+    return s_IsBytecodeEnabled;
+}
+
 inline int Environment::get_default_size()
 {
     return s_DefaultSize;
@@ -425,19 +554,80 @@ inline const Environment::var* VarStorage::get( std::string name )
     else return iter->second;
 }
 
-inline void VarStorage::push()
+inline uint64_t* VarStorage::alloc_frame()
+{
+    // the first word links to the frame of the enclosing activation
+    uint64_t* frame = m_Frames->alloc( m_StorageSize + 1 );
+    frame[0] = (uint64_t)m_Storage;
+    return frame + 1;
+}
+
+inline void VarStorage::enter_frame( uint64_t* frame )
+{
+    m_Storage = frame;
+}
+
+inline void VarStorage::leave_frame()
+{
+    uint64_t* frame = m_Storage - 1;
+    m_Storage = (uint64_t*)frame[0];
+    m_Frames->release( frame );
+}
+
+inline void VarStorage::discard_frame( uint64_t* frame )
 {
-    if( m_StorageSize > 0 )
-        m_Stack.push( m_Storage );
-        m_Storage = new uint64_t[ m_StorageSize ];
+    m_Frames->release( frame - 1 );
+}
+
+inline uint64_t* VarStorage::get_storage()
+{
+    return m_Storage;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class FrameStack inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t* FrameStack::alloc( size_t size )
+{
+    if( m_Top + size > m_End ) return alloc_segment( size );
+
+    uint64_t* frame = m_Top;
+    m_Top += size;
+    return frame;
+}
+
+inline void FrameStack::release( uint64_t* frame )
+{
+    // frames are released in reverse order, a frame outside of the current
+    // segment is the last one of a previous segment
+    while( frame < m_Segments[ m_Segment ].base || frame >= m_Segments[ m_Segment ].end ) m_Segment--;
+
+    m_Top = frame;
+    m_End = m_Segments[ m_Segment ].end;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Environment::var inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t Environment::var::load( const slot_t& slot )
+{
+    switch( slot.type ) {
+    case slot_t::CONSTANT: return slot.value;
+    case slot_t::GLOBAL: return *(uint64_t*)slot.value;
+    default: return (*slot.frame)[ slot.value ];
+    }
 }
 
-inline void VarStorage::pop()
+inline void Environment::var::store( const slot_t& slot, uint64_t value )
 {
-    if( !m_Stack.empty() ) {
-        delete[] m_Storage;
-        m_Storage = m_Stack.top();
-        m_Stack.pop();
+    switch( slot.type ) {
+    case slot_t::CONSTANT: break;
+    case slot_t::GLOBAL: *(uint64_t*)slot.value = value; break;
+    default: (*slot.frame)[ slot.value ] = value; break;
     }
 }
 
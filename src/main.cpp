@@ -25,7 +25,11 @@
 
 #include "mempeek_ast.h"
 #include "mempeek_exceptions.h"
+#include "output.h"
 #include "console.h"
+#include "server.h"
+#include "profiler.h"
+#include "trace.h"
 #include "teestream.h"
 #include "version.h"
 
@@ -37,7 +41,9 @@
 #include <iostream>
 #include <fstream>
 
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <signal.h>
 
 #include <sys/ioctl.h>
@@ -54,37 +60,44 @@ static void signal_handler( int )
     Environment::set_terminate();
 }
 
-static void parse( Environment* env, const char* str, bool is_file )
+static bool parse( Environment* env, const char* str, bool is_file )
 {
+    bool ret = true;
+
     Environment::clear_terminate();
     signal( SIGABRT, signal_handler );
     signal( SIGINT, signal_handler );
     signal( SIGTERM, signal_handler );
 
     try {
-        ASTNode::ptr yyroot = env->parse( str, is_file, false );
+        std::shared_ptr<ASTNode> yyroot = env->parse( str, is_file, false );
 
 #ifdef ASTDEBUG
 		cerr << "executing ASTNode[" << yyroot << "]" << endl;
 #endif
-		yyroot->execute();
-    }
-    catch( ASTExceptionExit& ) {
-        // nothing to do
-    }
-    catch( ASTExceptionBreak& ) {
-        // nothing to do
+		uint64_t status = env->execute( yyroot );
+		Output::flush();
+
+		if( status == ASTNode::STATUS_TERMINATE ) cout << endl << "terminated execution" << endl;
+		else if( status == ASTNode::STATUS_QUIT ) throw ASTExceptionQuit();
     }
     catch( ASTExceptionTerminate& ) {
+        // terminated inside of a function call
+        Output::flush();
         cout << endl << "terminated execution" << endl;
     }
     catch( const ASTCompileException& ex ) {
+        Output::flush();
         cerr << ex.get_location() << "compile error: " << ex.what() << endl;
+        ret = false;
     }
     catch( const ASTRuntimeException& ex ) {
+        Output::flush();
         cerr << ex.get_location() << "runtime error: " << ex.what() << endl;
+        ret = false;
     }
     catch( ... ) {
+        Output::flush();
         signal( SIGABRT, SIG_DFL );
         signal( SIGINT, SIG_DFL );
         signal( SIGTERM, SIG_DFL );
@@ -95,6 +108,16 @@ static void parse( Environment* env, const char* str, bool is_file )
     signal( SIGABRT, SIG_DFL );
     signal( SIGINT, SIG_DFL );
     signal( SIGTERM, SIG_DFL );
+
+    return ret;
+}
+
+// the grammar ends each statement with a newline or semicolon, commands from the command
+// line and from clients get a newline appended to end the last statement
+static bool parse_command( Environment* env, const string& command )
+{
+    string cmd = command + '\n';
+    return parse( env, cmd.c_str(), false );
 }
 
 static void print_usage( const char* name )
@@ -104,9 +127,19 @@ static void print_usage( const char* name )
             "Options:\n"
             "    -i          Enter interactive mode when all scripts and commands are completed\n"
             "    -I <path>   Add <path> to the search path of the \"import\" command\n"
+            "    -C <path>   Cache the token streams of scripts and imports in directory <path>\n"
+            "    -H <hash>   Identify imported and cached files by \"md5\" (default) or \"xxh64\"\n"
             "    -c <stmt>   Execute the mempeek command <stmt>\n"
             "    -l <file>   Write output and interactive input to <file>\n"
             "    -ll <file>  Append output and interactive input to <file>\n"
+            "    -a          Execute with the AST interpreter instead of the bytecode VM\n"
+            "    -u          Flush output after each print, also when it is no terminal\n"
+            "    -t <file>   Record the peeks and pokes that follow in the trace <file>\n"
+            "    -T <num>    Preallocate <num> records for the following -t, default is 1048576\n"
+            "    -p <file>   Profile the scripts and commands that follow, write the report to <file>\n"
+            "                and the folded stacks for flame graphs to <file>.folded\n"
+            "    -s <socket> Serve the requests of mempeek-client on the Unix domain socket <socket>\n"
+            "                when all scripts and commands are completed\n"
             "    -v          Print version\n"
             "    -h          Print usage\n"
          << flush;
@@ -220,16 +253,24 @@ int main( int argc, char** argv )
 #endif
 
     MMap::enable_signal_handler();
+    Output::set_line_buffered( isatty( STDOUT_FILENO ) );
 
     ofstream* logfile = nullptr;
     basic_teebuf< char >* cout_buf = nullptr;
     basic_teebuf< char >* cerr_buf = nullptr;
 
+    Profiler* profiler = nullptr;
+    string profile_file;
+
+    TraceRecorder* trace = nullptr;
+    size_t trace_capacity = 1024 * 1024;
+
     Environment env;
 
     try {
         bool is_interactive = false;
         bool has_commands = false;
+        const char* socket_path = nullptr;
 
         passwd* pwd = getpwuid( getuid() );
         if( pwd ) {
@@ -253,6 +294,74 @@ int main( int argc, char** argv )
                 throw ASTExceptionQuit();
             }
             else if( strcmp( argv[i], "-i" ) == 0 ) is_interactive = true;
+            else if( strcmp( argv[i], "-a" ) == 0 ) {
+                // scripts run while the options are parsed, so -a after -p is rejected here
+                // and no report is written
+                if( profiler ) {
+                    cerr << "profiling requires the bytecode VM" << endl;
+                    env.set_profiler( nullptr );
+                    delete profiler;
+                    profiler = nullptr;
+                    throw ASTExceptionQuit();
+                }
+                Environment::set_bytecode_enabled( false );
+            }
+            else if( strcmp( argv[i], "-u" ) == 0 ) Output::set_line_buffered( true );
+            else if( strcmp( argv[i], "-s" ) == 0 ) {
+                if( ++i >= argc ) {
+                    cerr << "missing socket path" << endl;
+                    throw ASTExceptionQuit();
+                }
+                socket_path = argv[i];
+            }
+            else if( strcmp( argv[i], "-p" ) == 0 ) {
+                if( profiler ) {
+                    cerr << "duplicate profile option" << endl;
+                    throw ASTExceptionQuit();
+                }
+                if( ++i >= argc ) {
+                    cerr << "missing file name" << endl;
+                    throw ASTExceptionQuit();
+                }
+                if( !Environment::is_bytecode_enabled() ) {
+                    cerr << "profiling requires the bytecode VM" << endl;
+                    throw ASTExceptionQuit();
+                }
+
+                profile_file = argv[i];
+                profiler = new Profiler;
+                env.set_profiler( profiler );
+            }
+            else if( strcmp( argv[i], "-T" ) == 0 ) {
+                if( ++i >= argc ) {
+                    cerr << "missing number of records" << endl;
+                    throw ASTExceptionQuit();
+                }
+
+                char* end;
+                trace_capacity = strtoull( argv[i], &end, 0 );
+                if( *end || trace_capacity == 0 ) {
+                    cerr << "invalid number of records" << endl;
+                    throw ASTExceptionQuit();
+                }
+            }
+            else if( strcmp( argv[i], "-t" ) == 0 ) {
+                if( trace ) {
+                    cerr << "duplicate trace option" << endl;
+                    throw ASTExceptionQuit();
+                }
+                if( ++i >= argc ) {
+                    cerr << "missing file name" << endl;
+                    throw ASTExceptionQuit();
+                }
+
+                trace = new TraceRecorder;
+                if( !trace->create( argv[i], trace_capacity ) ) {
+                    cerr << "cannot create trace " << argv[i] << ": " << strerror( errno ) << endl;
+                    throw ASTExceptionQuit();
+                }
+                TraceRecorder::set_active( trace );
+            }
             else if( strcmp( argv[i], "-I" ) == 0 ) {
                 if( ++i >= argc ) {
                     cerr << "missing include path" << endl;
@@ -264,15 +373,35 @@ int main( int argc, char** argv )
                     throw ASTExceptionQuit();
                 }
             }
+            else if( strcmp( argv[i], "-C" ) == 0 ) {
+                if( ++i >= argc ) {
+                    cerr << "missing cache path" << endl;
+                    throw ASTExceptionQuit();
+                }
+
+                if( !env.set_cache_path( argv[i] ) ) {
+                    cerr << "cache path not found" << endl;
+                    throw ASTExceptionQuit();
+                }
+            }
+            else if( strcmp( argv[i], "-H" ) == 0 ) {
+                if( ++i >= argc ) {
+                    cerr << "missing hash name" << endl;
+                    throw ASTExceptionQuit();
+                }
+
+                if( !env.set_content_hash( argv[i] ) ) {
+                    cerr << "unknown hash" << endl;
+                    throw ASTExceptionQuit();
+                }
+            }
             else if( strcmp( argv[i], "-c" ) == 0 ) {
                 if( ++i >= argc ) {
                     cerr << "missing command" << endl;
                     throw ASTExceptionQuit();
                 }
-                // TODO: parser should treat EOF as end of statement
-                string cmd = string( argv[i] ) + '\n';
 
-                parse( &env, cmd.c_str(), false );
+                parse_command( &env, argv[i] );
                 has_commands = true;
             }
             else if( strcmp( argv[i], "-l" ) == 0 || strcmp( argv[i], "-ll" ) == 0 ) {
@@ -304,7 +433,25 @@ int main( int argc, char** argv )
             }
         }
 
-        if( is_interactive || !has_commands ) {
+        if( socket_path ) {
+            Server server( socket_path );
+            if( !server.listen() ) {
+                cerr << "cannot create socket " << socket_path << ": " << strerror( errno ) << endl;
+                throw ASTExceptionQuit();
+            }
+
+            server.run( [&env] ( const string& request, bool is_file ) -> ServerProtocol::status_t {
+                try {
+                    bool ok = is_file ? parse( &env, request.c_str(), true ) : parse_command( &env, request );
+                    return ok ? ServerProtocol::STATUS_OK : ServerProtocol::STATUS_ERROR;
+                }
+                catch( ASTExceptionQuit& ) {
+                    // ends the connection, not the server
+                    return ServerProtocol::STATUS_QUIT;
+                }
+            } );
+        }
+        else if( is_interactive || !has_commands ) {
             Console console( "mempeek", "~/.mempeek_history" );
 #ifdef USE_EDITLINE
             console.set_clientdata( &env );
@@ -322,6 +469,20 @@ int main( int argc, char** argv )
         // nothing to do
     }
 
+    Output::flush();
+
+    if( trace ) {
+        if( trace->get_num_dropped() ) cerr << "trace full, " << trace->get_num_dropped() << " accesses were not recorded" << endl;
+        if( !trace->close() ) cerr << "cannot write trace" << endl;
+        delete trace;
+    }
+
+    if( profiler ) {
+        env.set_profiler( nullptr );
+        if( !profiler->write( profile_file ) ) cerr << "cannot write profile " << profile_file << endl;
+        delete profiler;
+    }
+
     if( logfile ) {
         cout_buf->detach( logfile->rdbuf() );
         cerr_buf->detach( logfile->rdbuf() );
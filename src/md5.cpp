@@ -48,15 +48,18 @@ bool MD5::load( const char* file )
     reset();
 
     ifstream in( file, ios::binary );
+    if( !in ) return false;
 
+    uint8_t buffer[ 4096 ];
     for(;;) {
-        uint8_t c = (uint8_t)in.get();
+        in.read( (char*)buffer, sizeof(buffer) );
+        check( buffer, in.gcount() );
+
         if( in.eof() ) return true;
         if( in.fail() ) {
             reset();
             return false;
         }
-        check( c );
     }
 }
 
@@ -137,13 +137,20 @@ inline void MD5::check( uint8_t value )
 inline void MD5::check( const uint8_t* buffer, size_t size )
 {
     m_HasChecksum = false;
+    m_MessageSize += size;
+
+    // copied in chunks that complete the current block
+    while( size > 0 ) {
+        size_t len = 64 - m_BufferSize;
+        if( len > size ) len = size;
+
+        memcpy( m_Buffer + m_BufferSize, buffer, len );
+        m_BufferSize += len;
+        buffer += len;
+        size -= len;
 
-    for( size_t i = 0; i < size; i++ ) {
-        m_Buffer[ m_BufferSize++ ] = buffer[i];
         if( m_BufferSize >= 64 ) calc_hash();
     }
-
-    m_MessageSize += size;
 }
 
 
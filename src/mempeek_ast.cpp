@@ -27,16 +27,24 @@
 
 #include "mempeek_exceptions.h"
 #include "mempeek_parser.h"
+#include "output.h"
+#include "sampler.h"
+#include "trace.h"
 #include "parser.h"
 #include "lexer.h"
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
+#include <algorithm>
 
 #include <stdio.h>
 #include <ctype.h>
 #include <time.h>
 #include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/epoll.h>
 
 using namespace std;
 
@@ -61,6 +69,11 @@ ASTNode::ptr ASTNode::clone_to_const()
     return nullptr;
 }
 
+void ASTNode::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    compiler.emit( Bytecode::OP_EXEC, result, 0, 0, (uint64_t)this, this );
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeBreak
@@ -82,12 +95,21 @@ uint64_t ASTNodeBreak::execute()
 #endif
 
     switch( m_Token ) {
-    case T_EXIT: throw ASTExceptionExit();
-    case T_BREAK: throw ASTExceptionBreak();
-    case T_QUIT: throw ASTExceptionQuit();
+    case T_EXIT: return STATUS_EXIT;
+    case T_BREAK: return STATUS_BREAK;
+    case T_QUIT: return STATUS_QUIT;
     }
 
-    return 0;
+    return STATUS_NORMAL;
+}
+
+void ASTNodeBreak::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    switch( m_Token ) {
+    case T_EXIT: compiler.emit_exit( this ); break;
+    case T_BREAK: compiler.emit_break( this ); break;
+    case T_QUIT: compiler.emit( Bytecode::OP_QUIT, 0, 0, 0, 0, this ); break;
+    }
 }
 
 
@@ -95,8 +117,9 @@ uint64_t ASTNodeBreak::execute()
 // class ASTNodeBlock implementation
 //////////////////////////////////////////////////////////////////////////////
 
-ASTNodeBlock::ASTNodeBlock( const yylloc_t& yylloc )
- : ASTNode( yylloc )
+ASTNodeBlock::ASTNodeBlock( const yylloc_t& yylloc, bool is_statement )
+ : ASTNode( yylloc ),
+   m_IsStatement( is_statement )
 {
 #ifdef ASTDEBUG
 	cerr << "AST[" << this << "]: creating ASTNodeBlock" << endl;
@@ -109,12 +132,23 @@ uint64_t ASTNodeBlock::execute()
 	cerr << "AST[" << this << "]: executing ASTNodeBlock" << endl;
 #endif
 
-	for( ASTNode::ptr node: get_children() ) {
-	    node->execute();
-        if( Environment::is_terminated() ) throw ASTExceptionTerminate();
+	for( const ASTNode::ptr& node: get_children() ) {
+	    uint64_t status = node->execute();
+	    if( status != STATUS_NORMAL ) return status;
+        if( Environment::is_terminated() ) return STATUS_TERMINATE;
 	}
 
-	return 0;
+	return STATUS_NORMAL;
+}
+
+void ASTNodeBlock::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    if( m_IsStatement ) {
+        for( ASTNode::ptr node: get_children() ) compiler.expression( node, result );
+    }
+    else {
+        for( ASTNode::ptr node: get_children() ) compiler.statement( node );
+    }
 }
 
 
@@ -122,17 +156,22 @@ uint64_t ASTNodeBlock::execute()
 // class ASTNodeSubroutine implementation
 //////////////////////////////////////////////////////////////////////////////
 
-ASTNodeSubroutine::ASTNodeSubroutine( const yylloc_t& yylloc, std::weak_ptr<ASTNode> body, VarStorage* vars,
+ASTNodeSubroutine::ASTNodeSubroutine( const yylloc_t& yylloc, std::string name, std::shared_ptr<ASTNode> body, VarStorage* vars,
                                       std::vector< Environment::var* >& params, Environment::var* retval )
  : ASTNode( yylloc ),
+   m_Name( name ),
    m_LocalVars( vars ),
-   m_Params( params ),
-   m_Retval( retval ),
-   m_Body( body )
+   m_IsFunction( retval != nullptr ),
+   m_Body( body ),
+   m_BodyNode( body.get() )
 {
 #ifdef ASTDEBUG
-    cerr << "AST[" << this << "]: creating ASTNodeSubroutine" << endl;
+    cerr << "AST[" << this << "]: creating ASTNodeSubroutine name=" << name << endl;
 #endif
+
+    for( Environment::var* param: params ) m_Params.push_back( param->get_slot() );
+    if( retval ) m_Retval = retval->get_slot();
+    else m_Retval = { Environment::var::slot_t::CONSTANT, 0, nullptr };
 }
 
 uint64_t ASTNodeSubroutine::execute()
@@ -141,41 +180,51 @@ uint64_t ASTNodeSubroutine::execute()
     cerr << "AST[" << this << "]: executing ASTNodeSubroutine" << endl;
 #endif
 
-    bool is_pushed = false;
-    uint64_t ret = 0;
+    if( m_Body.expired() ) throw ASTExceptionDroppedSubroutine( get_location() );
 
+    // the arguments are evaluated in the context of the caller directly into the frame of the callee
+    uint64_t* frame = m_LocalVars->alloc_frame();
     try {
-        ASTNode::ptr body = m_Body.lock();
-        if( !body ) throw ASTExceptionDroppedSubroutine( get_location() );
-
-        vector<uint64_t> values( m_Params.size() );
-
-        for( size_t i = 0; i < m_Params.size(); i++ ) values[i] = get_children()[i]->execute();
-
-        m_LocalVars->push();
-        is_pushed = true;
-
-        for( size_t i = 0; i < m_Params.size(); i++ ) m_Params[i]->set( values[i] );
-
-        body->execute();
+        for( size_t i = 0; i < m_Params.size(); i++ ) frame[ m_Params[i].value ] = get_children()[i]->execute();
     }
-    catch( ASTExceptionExit& ) {
-        // nothing to do
+    catch( ... ) {
+        m_LocalVars->discard_frame( frame );
+        throw;
     }
-    catch( ASTExceptionBreak& ) {
-        // nothing to do
+
+    m_LocalVars->enter_frame( frame );
+
+    uint64_t status;
+    try {
+        status = m_BodyNode->execute();
     }
     catch( ... ) {
-        if( is_pushed ) m_LocalVars->pop();
+        m_LocalVars->leave_frame();
         throw;
     }
 
-    if( is_pushed ) {
-        if( m_Retval ) ret = m_Retval->get();
-        m_LocalVars->pop();
-    }
+    uint64_t ret = m_IsFunction ? frame[ m_Retval.value ] : 0;
+    m_LocalVars->leave_frame();
 
-    return ret;
+    // exit and break end the subroutine only
+    if( status != STATUS_QUIT && status != STATUS_TERMINATE ) return ret;
+
+    // procedures are statements and pass the status on, functions are evaluated inside of expressions
+    if( !m_IsFunction ) return status;
+    else if( status == STATUS_QUIT ) throw ASTExceptionQuit();
+    else throw ASTExceptionTerminate();
+}
+
+void ASTNodeSubroutine::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    const size_t num_params = m_Params.size();
+
+    Bytecode::reg_t args = compiler.alloc_reg();
+    for( size_t i = 1; i < num_params; i++ ) compiler.alloc_reg();
+    for( size_t i = 0; i < num_params; i++ ) compiler.expression( get_children()[i], args + i );
+
+    compiler.emit( Bytecode::OP_CALL, result, args, num_params, (uint64_t)this, this );
+    compiler.free_reg( args );
 }
 
 
@@ -215,13 +264,31 @@ uint64_t ASTNodeIf::execute()
 #endif
 
 	if( get_children()[0]->execute() ) {
-		get_children()[1]->execute();
+		return get_children()[1]->execute();
 	}
 	else {
-		if( get_children().size() > 2 ) get_children()[2]->execute();
+		if( get_children().size() > 2 ) return get_children()[2]->execute();
 	}
 
-	return 0;
+	return STATUS_NORMAL;
+}
+
+void ASTNodeIf::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    Bytecode::reg_t condition = compiler.alloc_reg();
+    compiler.expression( get_children()[0], condition );
+    size_t jump_else = compiler.emit( Bytecode::OP_JZ, 0, condition, 0, 0, this );
+    compiler.free_reg( condition );
+
+    compiler.statement( get_children()[1] );
+
+    if( get_children().size() > 2 ) {
+        size_t jump_end = compiler.emit( Bytecode::OP_JMP, 0, 0, 0, 0, this );
+        compiler.set_jump_target( jump_else, compiler.get_position() );
+        compiler.statement( get_children()[2] );
+        compiler.set_jump_target( jump_end, compiler.get_position() );
+    }
+    else compiler.set_jump_target( jump_else, compiler.get_position() );
 }
 
 
@@ -246,19 +313,33 @@ uint64_t ASTNodeWhile::execute()
 	cerr << "AST[" << this << "]: executing ASTNodeWhile" << endl;
 #endif
 
-	ASTNode::ptr condition = get_children()[0];
-	ASTNode::ptr block = get_children()[1];
+	ASTNode* condition = get_children()[0];
+	ASTNode* block = get_children()[1];
 
 	while( condition->execute() ) {
-	    try {
-	        block->execute();
-	    }
-	    catch( ASTExceptionBreak& ) {
-	        break;
-	    }
+	    uint64_t status = block->execute();
+	    if( status == STATUS_BREAK ) break;
+	    if( status != STATUS_NORMAL ) return status;
 	}
 
-	return 0;
+	return STATUS_NORMAL;
+}
+
+void ASTNodeWhile::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    size_t loop = compiler.profile( this );
+
+    Bytecode::reg_t condition = compiler.alloc_reg();
+    compiler.expression( get_children()[0], condition );
+    size_t jump_end = compiler.emit( Bytecode::OP_JZ, 0, condition, 0, 0, this );
+    compiler.free_reg( condition );
+
+    compiler.begin_loop();
+    compiler.statement( get_children()[1] );
+    compiler.emit( Bytecode::OP_JMP, 0, 0, 0, loop, this );
+
+    compiler.set_jump_target( jump_end, compiler.get_position() );
+    compiler.end_loop( compiler.get_position() );
 }
 
 
@@ -273,7 +354,7 @@ ASTNodeFor::ASTNodeFor( const yylloc_t& yylloc, ASTNodeAssign::ptr var, ASTNode:
     cerr << "AST[" << this << "]: creating ASTNodeFor var=[" << var << "] to=[" << to << "]" << endl;
 #endif
 
-    m_Var = var->get_var();
+    m_Slot = var->get_slot();
 
     add_child( var );
     add_child( to );
@@ -286,7 +367,7 @@ ASTNodeFor::ASTNodeFor( const yylloc_t& yylloc, ASTNodeAssign::ptr var, ASTNode:
     cerr << "AST[" << this << "]: creating ASTNodeFor var=[" << var << "] to=[" << to << "] step=[" << step << "]" << endl;
 #endif
 
-    m_Var = var->get_var();
+    m_Slot = var->get_slot();
 
     add_child( var );
     add_child( to );
@@ -302,15 +383,46 @@ uint64_t ASTNodeFor::execute()
     const int64_t to = get_children()[child++]->execute();
     const int64_t step = (get_children().size() > 3) ? get_children()[child++]->execute() : 1;
 
-    ASTNode::ptr block = get_children()[child];
-    for( int64_t i = m_Var->get(); step > 0 && i <= to || step < 0 && i >= to; m_Var->set( i += step ) ) {
-        try {
-            block->execute();
-        }
-        catch( ASTExceptionBreak& ) {
-            break;
-        }
+    ASTNode* block = get_children()[child];
+    for( int64_t i = Environment::var::load( m_Slot ); step > 0 && i <= to || step < 0 && i >= to; Environment::var::store( m_Slot, i += step ) ) {
+        uint64_t status = block->execute();
+        if( status == STATUS_BREAK ) break;
+        if( status != STATUS_NORMAL ) return status;
     }
+
+    return STATUS_NORMAL;
+}
+
+void ASTNodeFor::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    int child = 0;
+
+    compiler.statement( get_children()[child++] );
+
+    Bytecode::reg_t to = compiler.alloc_reg();
+    compiler.expression( get_children()[child++], to );
+
+    Bytecode::reg_t step = compiler.alloc_reg();
+    if( get_children().size() > 3 ) compiler.expression( get_children()[child++], step );
+    else compiler.emit( Bytecode::OP_LOADK, step, 0, 0, 1, this );
+
+    // like execute(), the counter lives outside of the loop variable
+    Bytecode::reg_t counter = compiler.alloc_reg();
+    compiler.load_var( m_Slot, counter, this );
+
+    size_t loop = compiler.profile( this );
+    size_t test = compiler.emit( Bytecode::OP_FORTEST, counter, to, step, 0, this );
+
+    compiler.begin_loop();
+    compiler.statement( get_children()[child] );
+    compiler.emit( Bytecode::OP_ADD, counter, counter, step, 0, this );
+    compiler.store_var( m_Slot, counter, this );
+    compiler.emit( Bytecode::OP_JMP, 0, 0, 0, loop, this );
+
+    compiler.set_jump_target( test, compiler.get_position() );
+    compiler.end_loop( compiler.get_position() );
+
+    compiler.free_reg( to );
 }
 
 
@@ -318,9 +430,33 @@ uint64_t ASTNodeFor::execute()
 // class ASTNodePeek implementation
 //////////////////////////////////////////////////////////////////////////////
 
-ASTNodePeek::ASTNodePeek( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction )
+// number of bytes accessed by a peek or poke
+static size_t get_access_size( int size_restriction )
+{
+    switch( size_restriction ) {
+    case T_8BIT: return 1;
+    case T_16BIT: return 2;
+    case T_32BIT: return 4;
+    default: return 8;
+    }
+}
+
+// accesses to a constant address are bound to the mapping when it already exists
+static void bind_address( Environment* env, ASTNode::ptr& address, int size_restriction, Environment::mapping_cache_t& cache )
+{
+    if( !address->is_constant() ) return;
+
+    // fold the address like add_child() does, so that errors in it are compile errors
+    ASTNode::ptr constnode = address->clone_to_const();
+    if( constnode ) address = constnode;
+
+    env->bind_mapping( (void*)address->execute(), get_access_size( size_restriction ), cache );
+}
+
+ASTNodePeek::ASTNodePeek( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction, const Environment::mapping_cache_t& cache )
  : ASTNode( yylloc ),
    m_Env( env ),
+   m_Cache( cache ),
    m_SizeRestriction( size_restriction )
 {
 #ifdef ASTDEBUG
@@ -337,69 +473,101 @@ ASTNodePeek::ASTNodePeek( const yylloc_t& yylloc, Environment* env, ASTNode::ptr
 	add_child( address );
 }
 
-uint64_t ASTNodePeek::execute()
+ASTNode::ptr ASTNodePeek::create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction )
 {
-#ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: executing ASTNodePeek" << endl;
-#endif
+	Environment::mapping_cache_t cache = { nullptr, nullptr, nullptr };
+	bind_address( env, address, size_restriction, cache );
 
-	switch( m_SizeRestriction ) {
-	case T_8BIT: return peek<uint8_t>();
-	case T_16BIT: return peek<uint16_t>();
-	case T_32BIT: return peek<uint32_t>();
-	case T_64BIT: return peek<uint64_t>();
-	};
+	switch( size_restriction ) {
+	case T_8BIT: return create< uint8_t >( yylloc, env, address, size_restriction, cache );
+	case T_16BIT: return create< uint16_t >( yylloc, env, address, size_restriction, cache );
+	case T_32BIT: return create< uint32_t >( yylloc, env, address, size_restriction, cache );
+	case T_64BIT: return create< uint64_t >( yylloc, env, address, size_restriction, cache );
 
-	return 0;
+	default: throw ASTExceptionSyntaxError( yylloc );
+	}
 }
 
 template< typename T >
-uint64_t ASTNodePeek::peek()
+ASTNode::ptr ASTNodePeek::create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction, const Environment::mapping_cache_t& cache )
 {
-	void* address = (void*)get_children()[0]->execute();
-	MMap* mmap = m_Env->get_mapping( address, sizeof(T) );
+    if( cache.virt_addr ) return make_node< ASTNodePeekT< T, true > >( yylloc, env, address, size_restriction, cache );
+    else return make_node< ASTNodePeekT< T, false > >( yylloc, env, address, size_restriction, cache );
+}
 
-    if( !mmap ) throw ASTExceptionNoMapping( get_location(), address, sizeof(T) );
+void ASTNodePeek::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    const bool is_bound = m_Cache.virt_addr != nullptr;
+    Bytecode::opcode_t op;
+
+    switch( m_SizeRestriction ) {
+    case T_8BIT: op = is_bound ? Bytecode::OP_PEEKC8 : Bytecode::OP_PEEK8; break;
+    case T_16BIT: op = is_bound ? Bytecode::OP_PEEKC16 : Bytecode::OP_PEEK16; break;
+    case T_32BIT: op = is_bound ? Bytecode::OP_PEEKC32 : Bytecode::OP_PEEK32; break;
+    case T_64BIT: op = is_bound ? Bytecode::OP_PEEKC64 : Bytecode::OP_PEEK64; break;
+    default: ASTNode::compile( compiler, result ); return;
+    }
+
+    if( !is_bound ) compiler.expression( get_children()[0], result );
+    compiler.emit( op, result, result, 0, (uint64_t)&m_Cache, this );
+}
+
+template< typename T, typename A >
+inline uint64_t ASTNodePeek::peek( MMap* mmap, A addr, void* phys_addr )
+{
+    const uint64_t start = TraceRecorder::start();
 
-    uint64_t ret = mmap->peek<T>( address );
-    if( mmap->has_failed() ) throw ASTExceptionBusError( get_location(), address, sizeof(T) );
+    uint64_t ret = mmap->peek<T>( addr );
+    if( mmap->has_failed() ) throw ASTExceptionBusError( get_location(), phys_addr, sizeof(T) );
+
+    if( start ) TraceRecorder::record( start, get_location(), (uintptr_t)phys_addr, sizeof(T), ret, (T)~(T)0, Trace::READ );
 
     return ret;
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
-// class ASTNodePoke implementation
+// class ASTNodePeekT implementation
 //////////////////////////////////////////////////////////////////////////////
 
-ASTNodePoke::ASTNodePoke( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, int size_restriction )
- : ASTNode( yylloc ),
-   m_Env( env ),
-   m_SizeRestriction( size_restriction )
+template< typename T, bool IS_BOUND >
+ASTNodePeekT< T, IS_BOUND >::ASTNodePeekT( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction, const Environment::mapping_cache_t& cache )
+ : ASTNodePeek( yylloc, env, address, size_restriction, cache )
+{}
+
+template< typename T, bool IS_BOUND >
+uint64_t ASTNodePeekT< T, IS_BOUND >::execute()
 {
 #ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: creating ASTNodePoke address=[" << address << "] value=[" << value << "] restriction=";
-	switch( m_SizeRestriction ) {
-	case T_8BIT: cerr << "8" << endl; break;
-	case T_16BIT: cerr << "16" << endl; break;
-	case T_32BIT: cerr << "32" << endl; break;
-	case T_64BIT: cerr << "64" << endl; break;
-	default: cerr << "ERR" << endl; break;
-	}
+	cerr << "AST[" << this << "]: executing ASTNodePeekT<" << sizeof(T) * 8 << ", " << IS_BOUND << ">" << endl;
 #endif
 
-	add_child( address );
-	add_child( value );
+    if( IS_BOUND ) return peek< T >( m_Cache.mmap, m_Cache.virt_addr, m_Cache.phys_addr );
+
+	void* address = (void*)get_children()[0]->execute();
+	MMap* mmap = m_Env->get_mapping( address, sizeof(T), m_Cache );
+
+    if( !mmap ) throw ASTExceptionNoMapping( get_location(), address, sizeof(T) );
+
+    return peek< T >( mmap, address, address );
 }
 
-ASTNodePoke::ASTNodePoke( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask, int size_restriction )
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodePoke implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodePoke::ASTNodePoke( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask,
+                          int size_restriction, bool is_atomic, const Environment::mapping_cache_t& cache )
  : ASTNode( yylloc ),
    m_Env( env ),
-   m_SizeRestriction( size_restriction )
+   m_Cache( cache ),
+   m_SizeRestriction( size_restriction ),
+   m_IsAtomic( is_atomic )
 {
 #ifdef ASTDEBUG
 	cerr << "AST[" << this << "]: creating ASTNodePoke address=[" << address << "] value=[" << value
-		 << "] mask=[" << mask << "] restriction=";
+		 << "] mask=[" << mask << "] atomic=" << is_atomic << " restriction=";
 	switch( m_SizeRestriction ) {
 	case T_8BIT: cerr << "8" << endl; break;
 	case T_16BIT: cerr << "16" << endl; break;
@@ -414,211 +582,1074 @@ ASTNodePoke::ASTNodePoke( const yylloc_t& yylloc, Environment* env, ASTNode::ptr
 	add_child( mask );
 }
 
-uint64_t ASTNodePoke::execute()
+ASTNode::ptr ASTNodePoke::create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, int size_restriction, bool is_atomic )
 {
-#ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: executing ASTNodePoke" << endl;
-#endif
+    // an atomic poke without mask replaces all bits
+    ASTNode::ptr mask = is_atomic ? make_node< ASTNodeConstant >( yylloc, ~(uint64_t)0 ) : nullptr;
 
-	switch( m_SizeRestriction ) {
-	case T_8BIT: poke<uint8_t>(); break;
-	case T_16BIT: poke<uint16_t>(); break;
-	case T_32BIT: poke<uint32_t>(); break;
-	case T_64BIT: poke<uint64_t>(); break;
-	};
+    return create( yylloc, env, address, value, mask, size_restriction, is_atomic );
+}
 
-	return 0;
+ASTNode::ptr ASTNodePoke::create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask, int size_restriction, bool is_atomic )
+{
+	Environment::mapping_cache_t cache = { nullptr, nullptr, nullptr };
+	bind_address( env, address, size_restriction, cache );
+
+	switch( size_restriction ) {
+	case T_8BIT: return create< uint8_t >( yylloc, env, address, value, mask, size_restriction, is_atomic, cache );
+	case T_16BIT: return create< uint16_t >( yylloc, env, address, value, mask, size_restriction, is_atomic, cache );
+	case T_32BIT: return create< uint32_t >( yylloc, env, address, value, mask, size_restriction, is_atomic, cache );
+	case T_64BIT: return create< uint64_t >( yylloc, env, address, value, mask, size_restriction, is_atomic, cache );
+
+	default: throw ASTExceptionSyntaxError( yylloc );
+	}
 }
 
 template< typename T >
-void ASTNodePoke::poke()
+ASTNode::ptr ASTNodePoke::create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask,
+                                  int size_restriction, bool is_atomic, const Environment::mapping_cache_t& cache )
+{
+    if( cache.virt_addr ) {
+        if( is_atomic ) return make_node< ASTNodePokeT< T, true, MODIFY_ATOMIC > >( yylloc, env, address, value, mask, size_restriction, cache );
+        else if( mask ) return make_node< ASTNodePokeT< T, true, MODIFY > >( yylloc, env, address, value, mask, size_restriction, cache );
+        else return make_node< ASTNodePokeT< T, true, WRITE > >( yylloc, env, address, value, mask, size_restriction, cache );
+    }
+    else {
+        if( is_atomic ) return make_node< ASTNodePokeT< T, false, MODIFY_ATOMIC > >( yylloc, env, address, value, mask, size_restriction, cache );
+        else if( mask ) return make_node< ASTNodePokeT< T, false, MODIFY > >( yylloc, env, address, value, mask, size_restriction, cache );
+        else return make_node< ASTNodePokeT< T, false, WRITE > >( yylloc, env, address, value, mask, size_restriction, cache );
+    }
+}
+
+void ASTNodePoke::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    const bool has_mask = get_children().size() > 2;
+    const bool is_bound = m_Cache.virt_addr != nullptr;
+    Bytecode::opcode_t op;
+
+    switch( m_SizeRestriction ) {
+    case T_8BIT: op = Bytecode::OP_POKE8; break;
+    case T_16BIT: op = Bytecode::OP_POKE16; break;
+    case T_32BIT: op = Bytecode::OP_POKE32; break;
+    case T_64BIT: op = Bytecode::OP_POKE64; break;
+    default: return;
+    }
+
+    // the opcode groups are laid out with the same order of access sizes
+    if( m_IsAtomic ) op = (Bytecode::opcode_t)(op + (is_bound ? Bytecode::OP_POKEAC8 : Bytecode::OP_POKEA8) - Bytecode::OP_POKE8);
+    else if( has_mask ) op = (Bytecode::opcode_t)(op + (is_bound ? Bytecode::OP_POKEMC8 : Bytecode::OP_POKEM8) - Bytecode::OP_POKE8);
+    else if( is_bound ) op = (Bytecode::opcode_t)(op + Bytecode::OP_POKEC8 - Bytecode::OP_POKE8);
+
+    Bytecode::reg_t address = compiler.alloc_reg();
+    Bytecode::reg_t value = compiler.alloc_reg();
+    Bytecode::reg_t mask = has_mask ? compiler.alloc_reg() : 0;
+
+    if( !is_bound ) compiler.expression( get_children()[0], address );
+
+    compiler.expression( get_children()[1], value );
+    if( has_mask ) compiler.expression( get_children()[2], mask );
+
+    compiler.emit( op, address, value, mask, (uint64_t)&m_Cache, this );
+    compiler.free_reg( address );
+}
+
+template< ASTNodePoke::access_t ACCESS, typename T, typename A >
+inline void ASTNodePoke::poke( MMap* mmap, A addr, void* phys_addr, T value )
+{
+    const T mask = ACCESS == WRITE ? (T)~(T)0 : (T)get_children()[2]->execute();
+
+    const uint64_t start = TraceRecorder::start();
+
+    if( ACCESS == MODIFY_ATOMIC ) mmap->modify_atomic<T>( addr, value, mask );
+    else if( ACCESS == MODIFY ) mmap->modify<T>( addr, value, mask );
+    else mmap->poke<T>( addr, value );
+
+    if( mmap->has_failed() ) throw ASTExceptionBusError( get_location(), phys_addr, sizeof(T) );
+
+    if( start ) {
+        const Trace::type_t type = ACCESS == MODIFY_ATOMIC ? Trace::MODIFY_ATOMIC : ACCESS == MODIFY ? Trace::MODIFY : Trace::WRITE;
+        TraceRecorder::record( start, get_location(), (uintptr_t)phys_addr, sizeof(T), value, mask, type );
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodePokeT implementation
+//////////////////////////////////////////////////////////////////////////////
+
+template< typename T, bool IS_BOUND, ASTNodePoke::access_t ACCESS >
+ASTNodePokeT< T, IS_BOUND, ACCESS >::ASTNodePokeT( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask,
+                                                   int size_restriction, const Environment::mapping_cache_t& cache )
+ : ASTNodePoke( yylloc, env, address, value, mask, size_restriction, ACCESS == MODIFY_ATOMIC, cache )
+{}
+
+template< typename T, bool IS_BOUND, ASTNodePoke::access_t ACCESS >
+uint64_t ASTNodePokeT< T, IS_BOUND, ACCESS >::execute()
 {
+#ifdef ASTDEBUG
+	cerr << "AST[" << this << "]: executing ASTNodePokeT<" << sizeof(T) * 8 << ", " << IS_BOUND << ", " << ACCESS << ">" << endl;
+#endif
+
+    if( IS_BOUND ) {
+        poke< ACCESS, T >( m_Cache.mmap, m_Cache.virt_addr, m_Cache.phys_addr, get_children()[1]->execute() );
+        return 0;
+    }
+
 	void* address = (void*)get_children()[0]->execute();
 	T value = get_children()[1]->execute();
 
-	MMap* mmap = m_Env->get_mapping( address, sizeof(T) );
+	MMap* mmap = m_Env->get_mapping( address, sizeof(T), m_Cache );
 
 	if( !mmap ) throw ASTExceptionNoMapping( get_location(), address, sizeof(T) );
 
-	if( get_children().size() == 2 ) mmap->poke<T>( address, value );
-	else {
-		T mask = get_children()[2]->execute();
-		mmap->clear<T>( address, mask );
-		mmap->set<T>( address, value & mask);
-	}
+	poke< ACCESS, T >( mmap, address, address, value );
+
+	return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeMemBlock implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodeMemBlock::ASTNodeMemBlock( const yylloc_t& yylloc, Environment* env, int operation, int size_restriction,
+                                  ASTNode::ptr address, ASTNode::ptr size )
+ : ASTNode( yylloc ),
+   m_Env( env ),
+   m_Operation( operation ),
+   m_Width( size_restriction ? get_access_size( size_restriction ) : 0 )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeMemBlock operation=" << operation << " width=" << m_Width
+         << " address=[" << address << "] size=[" << size << "]" << endl;
+#endif
+
+    add_child( address );
+    add_child( size );
+}
+
+ASTNodeMemBlock::ASTNodeMemBlock( const yylloc_t& yylloc, Environment* env, int operation, int size_restriction,
+                                  ASTNode::ptr address, ASTNode::ptr arg, ASTNode::ptr size )
+ : ASTNode( yylloc ),
+   m_Env( env ),
+   m_Operation( operation ),
+   m_Width( size_restriction ? get_access_size( size_restriction ) : 0 )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeMemBlock operation=" << operation << " width=" << m_Width
+         << " address=[" << address << "] arg=[" << arg << "] size=[" << size << "]" << endl;
+#endif
+
+    add_child( address );
+    add_child( size );
+    add_child( arg );
+}
+
+ASTNodeMemBlock::ASTNodeMemBlock( const yylloc_t& yylloc, Environment* env, int operation, int size_restriction,
+                                  ASTNode::ptr address, ASTNode::ptr size, std::string file )
+ : ASTNode( yylloc ),
+   m_Env( env ),
+   m_Operation( operation ),
+   m_Width( size_restriction ? get_access_size( size_restriction ) : 0 ),
+   m_File( file )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeMemBlock operation=" << operation << " width=" << m_Width
+         << " address=[" << address << "] size=[" << size << "] file=" << file << endl;
+#endif
+
+    add_child( address );
+    add_child( size );
+}
+
+uint64_t ASTNodeMemBlock::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeMemBlock" << endl;
+#endif
+
+    void* address = (void*)get_children()[0]->execute();
+    size_t size = get_children()[1]->execute();
+
+    if( m_Width && size % m_Width ) throw ASTExceptionBlockAlignment( get_location(), size, m_Width );
+    if( m_Width && (uintptr_t)address % m_Width ) throw ASTExceptionBlockAddressAlignment( get_location(), address, m_Width );
+
+    switch( m_Operation ) {
+    case T_MEMDUMP: dump( address, size ); break;
+    case T_MEMLOAD: load( address, size ); break;
+    case T_MEMSAVE: save( address, size ); break;
+
+    case T_MEMFILL: {
+        uint64_t value = get_children()[2]->execute();
+        MMap* mmap = get_mapping( address, size );
+
+        mmap->fill( address, value, size, m_Width );
+        if( mmap->has_failed() ) throw ASTExceptionBlockBusError( get_location(), address, size );
+        break;
+    }
+
+    case T_MEMCOPY: {
+        void* source = (void*)get_children()[2]->execute();
+        if( m_Width && (uintptr_t)source % m_Width ) throw ASTExceptionBlockAddressAlignment( get_location(), source, m_Width );
+
+        MMap* src_mmap = get_mapping( source, size );
+        MMap* dst_mmap = get_mapping( address, size );
+
+        if( src_mmap->is_memory_mapped() ) {
+            dst_mmap->write( address, src_mmap->get_virtual_address( source ), size, m_Width );
+            if( dst_mmap->has_failed() ) throw ASTExceptionBlockBusError( get_location(), address, size );
+        }
+        else copy( dst_mmap, address, src_mmap, source, size );
+        break;
+    }
+    }
+
+    return 0;
+}
+
+MMap* ASTNodeMemBlock::get_mapping( void* address, size_t size )
+{
+    MMap* mmap = m_Env->get_mapping( address, size );
+    if( !mmap ) throw ASTExceptionNoBlockMapping( get_location(), address, size );
+    return mmap;
+}
+
+void ASTNodeMemBlock::dump( void* address, size_t size )
+{
+    // lines of 16 bytes, grouped by the access width. byte dumps get an additional ascii column.
+    const size_t width = m_Width ? m_Width : 1;
+    uint8_t buffer[ 4096 ];
+
+    MMap* mmap = get_mapping( address, size );
+
+    for( size_t offset = 0; offset < size && !Environment::is_terminated(); offset += sizeof(buffer) ) {
+        const size_t chunk = std::min( size - offset, sizeof(buffer) );
+        uint8_t* chunk_addr = (uint8_t*)address + offset;
+
+        mmap->read( chunk_addr, buffer, chunk, m_Width );
+        if( mmap->has_failed() ) throw ASTExceptionBlockBusError( get_location(), chunk_addr, chunk );
+
+        for( size_t line = 0; line < chunk; line += 16 ) {
+            const size_t len = std::min( chunk - line, (size_t)16 );
+
+            Output::hex( (uintptr_t)(chunk_addr + line), sizeof(void*) * 2 );
+            Output::put( ':' );
+
+            for( size_t i = 0; i < len; i += width ) {
+                const uint8_t* p = buffer + line + i;
+                uint64_t value;
+
+                switch( width ) {
+                case 2: { uint16_t v; memcpy( &v, p, 2 ); value = v; break; }
+                case 4: { uint32_t v; memcpy( &v, p, 4 ); value = v; break; }
+                case 8: { uint64_t v; memcpy( &v, p, 8 ); value = v; break; }
+                default: value = *p; break;
+                }
+
+                Output::put( ' ' );
+                Output::hex_digits( value, width * 2 );
+            }
+
+            if( width == 1 ) {
+                for( size_t i = len; i < 16; i++ ) Output::write( "   ", 3 );
+                Output::write( "  ", 2 );
+                for( size_t i = 0; i < len; i++ ) Output::put( isprint( buffer[ line + i ] ) ? buffer[ line + i ] : '.' );
+            }
+
+            Output::put( '\n' );
+        }
+    }
+
+    Output::end_statement();
+}
+
+void ASTNodeMemBlock::copy( MMap* dst_mmap, void* address, MMap* src_mmap, void* source, size_t size )
+{
+    // the source has no virtual address, copy through a buffer in the direction that
+    // handles overlapping blocks like memmove()
+    uint8_t buffer[ 4096 ];
+    const bool backwards = address > source && address < (uint8_t*)source + size;
+
+    for( size_t done = 0; done < size; done += sizeof(buffer) ) {
+        const size_t chunk = std::min( size - done, sizeof(buffer) );
+        const size_t offset = backwards ? size - done - chunk : done;
+        uint8_t* chunk_addr = (uint8_t*)address + offset;
+
+        src_mmap->read( (uint8_t*)source + offset, buffer, chunk, m_Width );
+        dst_mmap->write( chunk_addr, buffer, chunk, m_Width );
+        if( dst_mmap->has_failed() ) throw ASTExceptionBlockBusError( get_location(), chunk_addr, chunk );
+    }
+}
+
+void ASTNodeMemBlock::load( void* address, size_t size )
+{
+    uint8_t buffer[ 4096 ];
+
+    MMap* mmap = get_mapping( address, size );
+
+    ifstream file( m_File.c_str(), ios::in | ios::binary );
+    if( !file ) throw ASTExceptionFileAccess( get_location(), m_File );
+
+    for( size_t offset = 0; offset < size; offset += sizeof(buffer) ) {
+        const size_t chunk = std::min( size - offset, sizeof(buffer) );
+        uint8_t* chunk_addr = (uint8_t*)address + offset;
+
+        file.read( (char*)buffer, chunk );
+        if( (size_t)file.gcount() != chunk ) throw ASTExceptionFileAccess( get_location(), m_File );
+
+        mmap->write( chunk_addr, buffer, chunk, m_Width );
+        if( mmap->has_failed() ) throw ASTExceptionBlockBusError( get_location(), chunk_addr, chunk );
+    }
+}
+
+void ASTNodeMemBlock::save( void* address, size_t size )
+{
+    uint8_t buffer[ 4096 ];
+
+    MMap* mmap = get_mapping( address, size );
+
+    ofstream file( m_File.c_str(), ios::out | ios::binary | ios::trunc );
+    if( !file ) throw ASTExceptionFileAccess( get_location(), m_File );
+
+    for( size_t offset = 0; offset < size; offset += sizeof(buffer) ) {
+        const size_t chunk = std::min( size - offset, sizeof(buffer) );
+        uint8_t* chunk_addr = (uint8_t*)address + offset;
+
+        mmap->read( chunk_addr, buffer, chunk, m_Width );
+        if( mmap->has_failed() ) throw ASTExceptionBlockBusError( get_location(), chunk_addr, chunk );
+
+        if( !file.write( (const char*)buffer, chunk ) ) throw ASTExceptionFileAccess( get_location(), m_File );
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodePrint implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodePrint::ASTNodePrint( const yylloc_t& yylloc )
+ : ASTNode( yylloc ),
+   m_Text( "\n" )
+{
+#ifdef ASTDEBUG
+	cerr << "AST[" << this << "]: creating ASTNodePrint newline" << endl;
+#endif
+}
+
+ASTNodePrint::ASTNodePrint( const yylloc_t& yylloc, std::string text )
+ : ASTNode( yylloc ),
+   m_Text( text )
+{
+#ifdef ASTDEBUG
+	cerr << "AST[" << this << "]: creating ASTNodePrint text=\"" << text << "\"" << endl;
+#endif
+}
+
+ASTNodePrint::ASTNodePrint( const yylloc_t& yylloc, ASTNode::ptr expression, int modifier )
+ : ASTNode( yylloc )
+{
+#ifdef ASTDEBUG
+	cerr << "AST[" << this << "]: creating ASTNodePrint expression=[" << expression << "] modifier=0x"
+		 << hex << setw(2) << setfill('0') << modifier << dec << endl;
+#endif
+
+	if( (modifier & MOD_SIZEMASK) == MOD_WORDSIZE ) {
+	    modifier &= ~MOD_SIZEMASK;
+	    modifier |= size_to_mod( Environment::get_default_size() );
+	}
+
+	add_child( expression );
+	m_Modifier = modifier;
+}
+
+uint64_t ASTNodePrint::execute()
+{
+#ifdef ASTDEBUG
+	cerr << "AST[" << this << "]: executing ASTNodePrint" << endl;
+#endif
+
+	for( ASTNode::ptr node: get_children() ) print_value( node->execute(), m_Modifier );
+	Output::write( m_Text );
+	Output::end_statement();
+
+	return 0;
+}
+
+void ASTNodePrint::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    for( ASTNode::ptr node: get_children() ) {
+        compiler.expression( node, result );
+        compiler.emit( Bytecode::OP_PRINT, 0, result, 0, m_Modifier, this );
+    }
+
+    if( !m_Text.empty() ) compiler.emit( Bytecode::OP_PRINTS, 0, 0, 0, (uint64_t)&m_Text, this );
+}
+
+int ASTNodePrint::size_to_mod( int size )
+{
+	switch( size ) {
+    case T_8BIT: return MOD_8BIT;
+	case T_16BIT: return MOD_16BIT;
+	case T_32BIT: return MOD_32BIT;
+	case T_64BIT: return MOD_64BIT;
+	default: return 0;
+	}
+}
+
+void ASTNodePrint::print_value( uint64_t value, int modifier )
+{
+	int size = 0;
+	int64_t nvalue;
+
+	switch( modifier & MOD_SIZEMASK ) {
+	case MOD_8BIT:
+		value &= 0xff;
+		nvalue = (int8_t)value;
+		size = 1;
+		break;
+
+	case MOD_16BIT:
+		value &= 0xffff;
+		nvalue = (int16_t)value;
+		size = 2;
+		break;
+
+	case MOD_32BIT:
+		value &= 0xffffffff;
+		nvalue = (int32_t)value;
+		size = 4;
+		break;
+
+	case MOD_64BIT:
+		nvalue = (int64_t)value;
+		size = 8;
+		break;
+	}
+
+	switch( modifier & MOD_TYPEMASK ) {
+	case MOD_HEX: Output::hex( value, 2 * size ); break;
+	case MOD_DEC: Output::dec( value ); break;
+	case MOD_NEG: Output::dec_signed( nvalue ); break;
+	case MOD_BIN: Output::bin( value, size * 8 ); break;
+
+	case MOD_FLOAT: {
+	    assert( (modifier & MOD_SIZEMASK) == MOD_64BIT );
+	    double d = *(double*)&value;
+	    Output::flt( d );
+	    break;
+	}
+
+	}
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeSleep implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodeSleep::ASTNodeSleep( const yylloc_t& yylloc, ASTNode::ptr expression )
+ : ASTNode( yylloc )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeSleep expression=[" << expression << "]" << endl;
+#endif
+
+    add_child( expression );
+}
+
+uint64_t ASTNodeSleep::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeSleep" << endl;
+#endif
+
+    uint64_t time = get_children()[0]->execute() * 1000;
+
+    // don't hold back buffered output while waiting
+    Output::flush();
+
+    struct timespec ts;
+    ts.tv_sec = time / 1000000000;
+    ts.tv_nsec = time % 1000000000;
+
+    for(;;) {
+        struct timespec remaining;
+        int ret = nanosleep( &ts, &remaining );
+        if( ret == 0 ) break;
+        if( errno == EINTR ) {
+            if( Environment::is_terminated() ) break;
+            ts = remaining;
+            continue;
+        }
+        else {
+            cerr << "nanosleep failed with errno " << errno << endl;
+            break;
+        }
+    }
+
+    return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeWaitfor implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodeWaitfor::ASTNodeWaitfor( const yylloc_t& yylloc, Environment* env, std::vector< ASTNode* >& args )
+ : ASTNode( yylloc )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeWaitfor condition=[" << args[0] << "] timeout=[" << args[1]
+         << "] spin=[" << args[2] << "]" << endl;
+#endif
+
+    init( args );
+}
+
+ASTNodeWaitfor::ASTNodeWaitfor( const yylloc_t& yylloc, Environment* env, std::string result, std::vector< ASTNode* >& args )
+ : ASTNode( yylloc )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeWaitfor result=" << result << " condition=[" << args[0]
+         << "] timeout=[" << args[1] << "] spin=[" << args[2] << "]" << endl;
+#endif
+
+    Environment::var* var = env->alloc_var( result );
+    if( !var ) throw ASTExceptionNamingConflict( get_location(), result );
+
+    m_HasResult = true;
+    m_Slot = var->get_slot();
+
+    init( args );
+}
+
+void ASTNodeWaitfor::init( std::vector< ASTNode* >& args )
+{
+    add_child( args[0] );
+
+    if( args[1] ) {
+        m_HasTimeout = true;
+        add_child( args[1] );
+    }
+
+    if( args[2] ) {
+        m_HasSpin = true;
+        add_child( args[2] );
+    }
+}
+
+static uint64_t get_monotonic_time()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t ASTNodeWaitfor::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeWaitfor" << endl;
+#endif
+
+    int child = 1;
+    const uint64_t timeout = m_HasTimeout ? get_children()[child++]->execute() * 1000 : 0;
+    const uint64_t spin = (m_HasSpin ? get_children()[child++]->execute() : DEFAULT_SPIN) * 1000;
+
+    ASTNode* condition = get_children()[0];
+
+    const uint64_t start = get_monotonic_time();
+    uint64_t backoff = MIN_BACKOFF * 1000;
+    uint64_t result;
+
+    // busy polling during the spin time, then sleeping with exponentially growing intervals
+    for(;;) {
+        if( condition->execute() ) {
+            result = (get_monotonic_time() - start) / 1000;
+            break;
+        }
+
+        const uint64_t now = get_monotonic_time();
+
+        if( m_HasTimeout && now - start >= timeout ) {
+            result = TIMED_OUT;
+            break;
+        }
+
+        if( Environment::is_terminated() ) return 0;
+
+        if( now - start < spin ) continue;
+
+        uint64_t wakeup = now + backoff;
+        if( m_HasTimeout && wakeup > start + timeout ) wakeup = start + timeout;
+
+        struct timespec ts;
+        ts.tv_sec = wakeup / 1000000000;
+        ts.tv_nsec = wakeup % 1000000000;
+        clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr );
+
+        backoff = std::min( backoff * 2, MAX_BACKOFF * 1000 );
+    }
+
+    if( m_HasResult ) Environment::var::store( m_Slot, result );
+
+    return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeWaitirq implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodeWaitirq::ASTNodeWaitirq( const yylloc_t& yylloc, Environment* env, std::vector< std::string >& devices, ASTNode::ptr timeout )
+ : ASTNode( yylloc )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeWaitirq devices=" << devices.size() << " timeout=[" << timeout << "]" << endl;
+#endif
+
+    init( env, devices, timeout );
+}
+
+ASTNodeWaitirq::ASTNodeWaitirq( const yylloc_t& yylloc, Environment* env, std::string result, std::vector< std::string >& devices, ASTNode::ptr timeout )
+ : ASTNode( yylloc )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeWaitirq result=" << result << " devices=" << devices.size()
+         << " timeout=[" << timeout << "]" << endl;
+#endif
+
+    Environment::var* var = env->alloc_var( result );
+    if( !var ) throw ASTExceptionNamingConflict( get_location(), result );
+
+    m_HasResult = true;
+    m_Slot = var->get_slot();
+
+    init( env, devices, timeout );
+}
+
+ASTNodeWaitirq::~ASTNodeWaitirq()
+{
+    // the device files belong to the environment
+    if( m_Epoll >= 0 ) close( m_Epoll );
+}
+
+void ASTNodeWaitirq::init( Environment* env, std::vector< std::string >& devices, ASTNode::ptr timeout )
+{
+    m_Epoll = epoll_create1( EPOLL_CLOEXEC );
+    if( m_Epoll < 0 ) throw ASTExceptionFileAccess( get_location(), devices[0] );
+
+    for( std::string& device: devices ) {
+        int fd = env->open_irq_device( device );
+        if( fd < 0 ) throw ASTExceptionFileAccess( get_location(), device );
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = m_Fds.size();
+
+        // a device that is listed twice is only waited for once
+        if( epoll_ctl( m_Epoll, EPOLL_CTL_ADD, fd, &event ) < 0 && errno != EEXIST ) {
+            throw ASTExceptionFileAccess( get_location(), device );
+        }
+
+        m_Devices.push_back( device );
+        m_Fds.push_back( fd );
+    }
+
+    if( timeout ) {
+        m_HasTimeout = true;
+        add_child( timeout );
+    }
+}
+
+// UIO devices transfer the interrupt count as 32 bit value. eventfd, which can stand in for
+// a UIO device, rejects accesses of less than 64 bits with EINVAL.
+static ssize_t read_irq_count( int fd, uint64_t& count )
+{
+    uint32_t count32;
+    ssize_t ret = read( fd, &count32, sizeof(count32) );
+    if( ret == sizeof(count32) ) count = count32;
+    else if( ret < 0 && errno == EINVAL ) ret = read( fd, &count, sizeof(count) );
+
+    return ret;
+}
+
+static ssize_t write_irq_value( int fd, uint64_t value )
+{
+    uint32_t value32 = value;
+    ssize_t ret = write( fd, &value32, sizeof(value32) );
+    if( ret < 0 && errno == EINVAL ) ret = write( fd, &value, sizeof(value) );
+
+    return ret;
+}
+
+uint64_t ASTNodeWaitirq::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeWaitirq" << endl;
+#endif
+
+    const uint64_t timeout = m_HasTimeout ? get_children()[0]->execute() * 1000 : 0;
+    const uint64_t start = get_monotonic_time();
+
+    uint64_t result = TIMED_OUT;
+    Output::flush();
+
+    for(;;) {
+        // epoll_wait() takes milliseconds, round up to never wake up before the timeout expired
+        int timeout_ms = -1;
+        if( m_HasTimeout ) {
+            const uint64_t elapsed = get_monotonic_time() - start;
+            if( elapsed >= timeout ) break;
+            timeout_ms = std::min( (timeout - elapsed + 999999) / 1000000, (uint64_t)INT_MAX );
+        }
+
+        struct epoll_event events[ 16 ];
+        int num = epoll_wait( m_Epoll, events, 16, timeout_ms );
+
+        if( num < 0 ) {
+            if( errno != EINTR ) throw ASTExceptionFileAccess( get_location(), m_Devices[0] );
+            if( Environment::is_terminated() ) return 0;
+            continue;
+        }
+
+        // all signaled devices are read to acknowledge them, the result is the count of the
+        // first one in the order of the statement
+        size_t first = m_Fds.size();
+
+        for( int i = 0; i < num; i++ ) {
+            const size_t index = events[i].data.u32;
+            uint64_t count;
+
+            ssize_t ret = read_irq_count( m_Fds[ index ], count );
+            if( ret < 0 && errno == EAGAIN ) continue;
+            if( ret <= 0 ) throw ASTExceptionFileAccess( get_location(), m_Devices[ index ] );
+
+            if( index < first ) {
+                first = index;
+                result = count;
+            }
+        }
+
+        if( first < m_Fds.size() ) break;
+    }
+
+    if( m_HasResult ) Environment::var::store( m_Slot, result );
+
+    return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeIrqEnable implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodeIrqEnable::ASTNodeIrqEnable( const yylloc_t& yylloc, Environment* env, std::string device, ASTNode::ptr value )
+ : ASTNode( yylloc ),
+   m_Device( device )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeIrqEnable device=" << device << " value=[" << value << "]" << endl;
+#endif
+
+    m_Fd = env->open_irq_device( device );
+    if( m_Fd < 0 ) throw ASTExceptionFileAccess( get_location(), device );
+
+    add_child( value );
+}
+
+uint64_t ASTNodeIrqEnable::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeIrqEnable" << endl;
+#endif
+
+    const uint64_t value = get_children().size() > 0 ? get_children()[0]->execute() : 1;
+
+    if( write_irq_value( m_Fd, value ) <= 0 ) throw ASTExceptionFileAccess( get_location(), m_Device );
+
+    return 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeEvery implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ASTNodeEvery::ASTNodeEvery( const yylloc_t& yylloc, Environment* env, ASTNode::ptr period, std::string stats )
+ : ASTNode( yylloc )
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: creating ASTNodeEvery period=[" << period << "] stats=" << stats << endl;
+#endif
+
+    if( !stats.empty() ) {
+        static const char* members[ NUM_STATS ] = { ".count", ".missed", ".overrun", ".maxoverrun" };
+
+        for( int i = 0; i < NUM_STATS; i++ ) {
+            Environment::var* var = env->alloc_var( stats + members[i] );
+            if( !var ) throw ASTExceptionNamingConflict( get_location(), stats + members[i] );
+            m_Stats[i] = var->get_slot();
+        }
+
+        m_HasStats = true;
+    }
+
+    add_child( period );
+}
+
+uint64_t ASTNodeEvery::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeEvery" << endl;
+#endif
+
+    const uint64_t period = get_children()[0]->execute();
+    ASTNode* block = get_children()[1];
+
+    uint64_t deadline = start_schedule();
+
+    for(;;) {
+        uint64_t status = block->execute();
+        if( status == STATUS_BREAK ) break;
+        if( status != STATUS_NORMAL ) return status;
+
+        wait_deadline( deadline, period );
+        if( Environment::is_terminated() ) return STATUS_TERMINATE;
+    }
+
+    return STATUS_NORMAL;
+}
+
+void ASTNodeEvery::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    Bytecode::reg_t period = compiler.alloc_reg();
+    compiler.expression( get_children()[0], period );
+
+    Bytecode::reg_t deadline = compiler.alloc_reg();
+    compiler.emit( Bytecode::OP_EVERYINIT, deadline, period, 0, (uint64_t)this, this );
+
+    size_t loop = compiler.get_position();
+
+    compiler.begin_loop();
+    compiler.statement( get_children()[1] );
+    compiler.profile( this );
+    compiler.emit( Bytecode::OP_EVERYWAIT, deadline, period, 0, (uint64_t)this, this );
+    compiler.emit( Bytecode::OP_JMP, 0, 0, 0, loop, this );
+
+    compiler.end_loop( compiler.get_position() );
+
+    compiler.free_reg( period );
+}
+
+uint64_t ASTNodeEvery::start_schedule()
+{
+    if( m_HasStats ) {
+        for( int i = 0; i < NUM_STATS; i++ ) Environment::var::store( m_Stats[i], 0 );
+    }
+
+    // the first iteration starts immediately
+    return get_monotonic_time();
+}
+
+void ASTNodeEvery::wait_deadline( uint64_t& deadline, uint64_t period )
+{
+    const uint64_t interval = period * 1000;
+    deadline += interval;
+
+    // after an overrun, the missed deadlines are skipped to stay in phase with the schedule
+    const uint64_t now = get_monotonic_time();
+    uint64_t overrun = 0;
+    uint64_t missed = 0;
+
+    if( now > deadline ) {
+        overrun = now - deadline;
+        if( interval ) {
+            missed = overrun / interval + 1;
+            deadline += missed * interval;
+        }
+        else deadline = now;
+    }
+
+    if( m_HasStats ) {
+        Environment::var::store( m_Stats[ STAT_COUNT ], Environment::var::load( m_Stats[ STAT_COUNT ] ) + 1 );
+        Environment::var::store( m_Stats[ STAT_MISSED ], Environment::var::load( m_Stats[ STAT_MISSED ] ) + missed );
+        Environment::var::store( m_Stats[ STAT_OVERRUN ], overrun / 1000 );
+        if( overrun / 1000 > Environment::var::load( m_Stats[ STAT_MAXOVERRUN ] ) ) {
+            Environment::var::store( m_Stats[ STAT_MAXOVERRUN ], overrun / 1000 );
+        }
+    }
+
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000;
+    ts.tv_nsec = deadline % 1000000000;
 
-    if( mmap->has_failed() ) throw ASTExceptionBusError( get_location(), address, sizeof(T) );
+    // clock_nanosleep() returns the error code instead of setting errno
+    for(;;) {
+        int ret = clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr );
+        if( ret == 0 ) break;
+        if( ret != EINTR || Environment::is_terminated() ) break;
+    }
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
-// class ASTNodePrint implementation
+// class ASTNodeSample implementation
 //////////////////////////////////////////////////////////////////////////////
 
-ASTNodePrint::ASTNodePrint( const yylloc_t& yylloc )
+ASTNodeSample::ASTNodeSample( const yylloc_t& yylloc, Environment* env, int size_restriction, std::vector< ASTNode* >& addresses,
+                              ASTNode::ptr period, ASTNode::ptr count, std::string file, std::string stats )
  : ASTNode( yylloc ),
-   m_Text( "\n" )
+   m_Env( env ),
+   m_Width( get_access_size( size_restriction ) ),
+   m_NumAddresses( addresses.size() ),
+   m_File( file )
 {
 #ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: creating ASTNodePrint newline" << endl;
+    cerr << "AST[" << this << "]: creating ASTNodeSample addresses=" << addresses.size() << " period=[" << period
+         << "] count=[" << count << "] file=" << file << " stats=" << stats << endl;
 #endif
-}
 
-ASTNodePrint::ASTNodePrint( const yylloc_t& yylloc, std::string text )
- : ASTNode( yylloc ),
-   m_Text( text )
-{
-#ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: creating ASTNodePrint text=\"" << text << "\"" << endl;
-#endif
-}
+    if( !stats.empty() ) {
+        static const char* members[ NUM_STATS ] = { ".count", ".missed", ".dropped", ".rate" };
 
-ASTNodePrint::ASTNodePrint( const yylloc_t& yylloc, ASTNode::ptr expression, int modifier )
- : ASTNode( yylloc )
-{
-#ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: creating ASTNodePrint expression=[" << expression << "] modifier=0x"
-		 << hex << setw(2) << setfill('0') << modifier << dec << endl;
-#endif
+        for( int i = 0; i < NUM_STATS; i++ ) {
+            Environment::var* var = env->alloc_var( stats + members[i] );
+            if( !var ) throw ASTExceptionNamingConflict( get_location(), stats + members[i] );
+            m_Stats[i] = var->get_slot();
+        }
 
-	if( (modifier & MOD_SIZEMASK) == MOD_WORDSIZE ) {
-	    modifier &= ~MOD_SIZEMASK;
-	    modifier |= size_to_mod( Environment::get_default_size() );
-	}
+        m_HasStats = true;
+    }
 
-	add_child( expression );
-	m_Modifier = modifier;
+    for( ASTNode* address: addresses ) add_child( address );
+    add_child( period );
+    add_child( count );
 }
 
-uint64_t ASTNodePrint::execute()
+uint64_t ASTNodeSample::execute()
 {
 #ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: executing ASTNodePrint" << endl;
+    cerr << "AST[" << this << "]: executing ASTNodeSample" << endl;
 #endif
 
-	for( ASTNode::ptr node: get_children() ) print_value( cout, node->execute() );
-	cout << m_Text << flush;
+    std::vector< uint64_t > addresses;
+    for( size_t i = 0; i < m_NumAddresses; i++ ) {
+        void* address = (void*)get_children()[i]->execute();
+        if( !m_Env->get_mapping( address, m_Width ) ) throw ASTExceptionNoMapping( get_location(), address, m_Width );
+        addresses.push_back( (uint64_t)address );
+    }
 
-	return 0;
-}
+    const uint64_t period = get_children()[ m_NumAddresses ]->execute();
+    const uint64_t count = get_children()[ m_NumAddresses + 1 ]->execute();
 
-int ASTNodePrint::size_to_mod( int size )
-{
-	switch( size ) {
-    case T_8BIT: return MOD_8BIT;
-	case T_16BIT: return MOD_16BIT;
-	case T_32BIT: return MOD_32BIT;
-	case T_64BIT: return MOD_64BIT;
-	default: return 0;
-	}
+    Sampler sampler( addresses, m_Width, period * 1000 );
+    if( !sampler.start( m_File ) ) throw ASTExceptionFileAccess( get_location(), m_File );
+
+    uint64_t stats[ NUM_STATS ] = { 0 };
+
+    switch( m_Width ) {
+    case 1: capture< uint8_t >( sampler, addresses, period, count, stats ); break;
+    case 2: capture< uint16_t >( sampler, addresses, period, count, stats ); break;
+    case 4: capture< uint32_t >( sampler, addresses, period, count, stats ); break;
+    default: capture< uint64_t >( sampler, addresses, period, count, stats ); break;
+    }
+
+    if( !sampler.stop() ) throw ASTExceptionFileAccess( get_location(), m_File );
+
+    if( m_HasStats ) {
+        for( int i = 0; i < NUM_STATS; i++ ) Environment::var::store( m_Stats[i], stats[i] );
+    }
+
+    return 0;
 }
 
-void ASTNodePrint::print_value( std::ostream& out, uint64_t value )
+template< typename T >
+void ASTNodeSample::capture( Sampler& sampler, const std::vector< uint64_t >& addresses, uint64_t period, uint64_t count, uint64_t* stats )
 {
-	int size = 0;
-	int64_t nvalue;
+    // look up the mappings once, the capture loop only reads
+    const size_t num = addresses.size();
+    std::vector< MMap* > mmaps( num );
 
-	switch( m_Modifier & MOD_SIZEMASK ) {
-	case MOD_8BIT:
-		value &= 0xff;
-		nvalue = (int8_t)value;
-		size = 1;
-		break;
+    for( size_t i = 0; i < num; i++ ) mmaps[i] = m_Env->get_mapping( (void*)addresses[i], sizeof(T) );
 
-	case MOD_16BIT:
-		value &= 0xffff;
-		nvalue = (int16_t)value;
-		size = 2;
-		break;
+    // count is the number of periods of the schedule, or the number of samples without period
+    const uint64_t interval = period * 1000;
+    const uint64_t start = get_monotonic_time();
+    uint64_t deadline = start;
 
-	case MOD_32BIT:
-		value &= 0xffffffff;
-		nvalue = (int32_t)value;
-		size = 4;
-		break;
+    for( uint64_t slot = 0; slot < count && !Environment::is_terminated(); ) {
+        uint64_t now = get_monotonic_time();
 
-	case MOD_64BIT:
-		nvalue = (int64_t)value;
-		size = 8;
-		break;
-	}
+        if( interval ) {
+            if( deadline > now + SPIN_MARGIN * 1000 ) {
+                const uint64_t wakeup = deadline - SPIN_MARGIN * 1000;
 
-	switch( m_Modifier & MOD_TYPEMASK ) {
-	case MOD_HEX: {
-		const ios_base::fmtflags oldflags = out.flags( ios::hex | ios::right | ios::fixed );
-		out << "0x" << setw( 2 * size ) << setfill('0') << value;
-		out.flags( oldflags );
-		break;
-	}
+                struct timespec ts;
+                ts.tv_sec = wakeup / 1000000000;
+                ts.tv_nsec = wakeup % 1000000000;
+                clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr );
+            }
 
-	case MOD_DEC:
-	case MOD_NEG: {
-		const ios_base::fmtflags oldflags = out.flags( ios::dec | ios::right | ios::fixed );
-		if( (m_Modifier & MOD_TYPEMASK) == MOD_DEC ) out << value;
-		else out << nvalue;
-		out.flags( oldflags );
-		break;
-	}
+            do now = get_monotonic_time();
+            while( now < deadline );
+        }
 
-	case MOD_BIN: {
-		for( int i = size * 8 - 1; i >= 0; i-- ) {
-			out << ((value & ((uint64_t)1 << i)) ? '1' : '0');
-			if( i > 0 && i % 4 == 0 ) out << ' ';
-		}
-		break;
-	}
+        uint8_t* record = sampler.alloc_record();
 
-	case MOD_FLOAT: {
-	    assert( (m_Modifier & MOD_SIZEMASK) == MOD_64BIT );
-	    double d = *(double*)&value;
-	    out << d;
-	    break;
-	}
+        if( record ) {
+            *(uint64_t*)record = now - start;
 
-	}
+            T* values = (T*)(record + sizeof(uint64_t));
+            for( size_t i = 0; i < num; i++ ) {
+                values[i] = mmaps[i]->peek<T>( (void*)addresses[i] );
+                if( mmaps[i]->has_failed() ) throw ASTExceptionBusError( get_location(), (void*)addresses[i], sizeof(T) );
+            }
+
+            sampler.commit_record();
+            stats[ STAT_COUNT ]++;
+        }
+        else stats[ STAT_DROPPED ]++;
+
+        slot++;
+
+        if( interval ) {
+            deadline += interval;
+
+            // deadlines that have already passed are skipped to stay in phase with the schedule
+            now = get_monotonic_time();
+            if( now > deadline ) {
+                const uint64_t missed = std::min( (now - deadline) / interval + 1, count - slot );
+                stats[ STAT_MISSED ] += missed;
+                slot += missed;
+                deadline += missed * interval;
+            }
+        }
+    }
+
+    const uint64_t elapsed = get_monotonic_time() - start;
+    if( elapsed ) stats[ STAT_RATE ] = (uint64_t)( (double)stats[ STAT_COUNT ] * 1e9 / elapsed );
 }
 
 
 //////////////////////////////////////////////////////////////////////////////
-// class ASTNodeSleep implementation
+// class ASTNodeFlush implementation
 //////////////////////////////////////////////////////////////////////////////
 
-ASTNodeSleep::ASTNodeSleep( const yylloc_t& yylloc, ASTNode::ptr expression )
+ASTNodeFlush::ASTNodeFlush( const yylloc_t& yylloc )
  : ASTNode( yylloc )
 {
 #ifdef ASTDEBUG
-    cerr << "AST[" << this << "]: creating ASTNodeSleep expression=[" << expression << "]" << endl;
+    cerr << "AST[" << this << "]: creating ASTNodeFlush" << endl;
 #endif
-
-    add_child( expression );
 }
 
-uint64_t ASTNodeSleep::execute()
+uint64_t ASTNodeFlush::execute()
 {
 #ifdef ASTDEBUG
-    cerr << "AST[" << this << "]: executing ASTNodeSleep" << endl;
+    cerr << "AST[" << this << "]: executing ASTNodeFlush" << endl;
 #endif
 
-    uint64_t time = get_children()[0]->execute() * 1000;
-
-    struct timespec ts;
-    ts.tv_sec = time / 1000000000;
-    ts.tv_nsec = time % 1000000000;
-
-    for(;;) {
-        struct timespec remaining;
-        int ret = nanosleep( &ts, &remaining );
-        if( ret == 0 ) break;
-        if( errno == EINTR ) {
-            if( Environment::is_terminated() ) break;
-            ts = remaining;
-            continue;
-        }
-        else {
-            cerr << "nanosleep failed with errno " << errno << endl;
-            break;
-        }
-    }
+    Output::flush();
 
     return 0;
 }
@@ -635,11 +1666,13 @@ ASTNodeAssign::ASTNodeAssign( const yylloc_t& yylloc, Environment* env, std::str
 	cerr << "AST[" << this << "]: creating ASTNodeAssign name=" << name << " expression=[" << expression << "]" << endl;
 #endif
 
-	m_Var = env->alloc_var( name );
+	Environment::var* var = env->alloc_var( name );
 
 	add_child( expression );
 
-	if( !m_Var ) throw ASTExceptionNamingConflict( get_location(), name );
+	if( !var ) throw ASTExceptionNamingConflict( get_location(), name );
+
+	m_Slot = var->get_slot();
 }
 
 uint64_t ASTNodeAssign::execute()
@@ -648,12 +1681,17 @@ uint64_t ASTNodeAssign::execute()
 	cerr << "AST[" << this << "]: executing ASTNodeAssign" << endl;
 #endif
 
-	uint64_t value = get_children()[0]->execute();
-	if( m_Var ) m_Var->set( value );
+	Environment::var::store( m_Slot, get_children()[0]->execute() );
 
 	return 0;
 }
 
+void ASTNodeAssign::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    compiler.expression( get_children()[0], result );
+    if( !compiler.store_var( m_Slot, result, this ) ) ASTNode::compile( compiler, result );
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeStatic implementation
@@ -667,11 +1705,11 @@ ASTNodeStatic::ASTNodeStatic( const yylloc_t& yylloc, Environment* env, std::str
     cerr << "AST[" << this << "]: creating ASTNodeStatic name=" << name << " expression=[" << expression << "]" << endl;
 #endif
 
-    m_Var = env->alloc_static( name );
+    Environment::var* var = env->alloc_static( name );
 
     if( expression->is_constant() ) {
         try {
-            add_child( make_shared<ASTNodeConstant>( yylloc, expression->execute() ) );
+            add_child( make_node<ASTNodeConstant>( yylloc, expression->execute() ) );
         }
         catch( const ASTExceptionDivisionByZero& ex ) {
             throw ASTExceptionConstDivisionByZero( ex );
@@ -679,7 +1717,9 @@ ASTNodeStatic::ASTNodeStatic( const yylloc_t& yylloc, Environment* env, std::str
     }
     else add_child( expression );
 
-    if( !m_Var ) throw ASTExceptionNamingConflict( get_location(), name );
+    if( !var ) throw ASTExceptionNamingConflict( get_location(), name );
+
+    m_Slot = var->get_slot();
 }
 
 uint64_t ASTNodeStatic::execute()
@@ -689,8 +1729,7 @@ uint64_t ASTNodeStatic::execute()
 #endif
 
     if( !m_IsInitialized ) {
-        uint64_t value = get_children()[0]->execute();
-        if( m_Var ) m_Var->set( value );
+        Environment::var::store( m_Slot, get_children()[0]->execute() );
         m_IsInitialized = true;
     }
 
@@ -714,9 +1753,7 @@ ASTNodeDef::ASTNodeDef( const yylloc_t& yylloc, Environment* env, std::string na
     try {
         const uint64_t value = expression->execute();
 
-        Environment::var* def = env->alloc_def( name );
-        if( !def ) throw ASTExceptionNamingConflict( get_location(), name );
-        def->set( value );
+        if( !env->alloc_def( name, value ) ) throw ASTExceptionNamingConflict( get_location(), name );
     }
     catch( const ASTExceptionDivisionByZero& ex ) {
         throw ASTExceptionConstDivisionByZero( ex );
@@ -735,20 +1772,16 @@ ASTNodeDef::ASTNodeDef( const yylloc_t& yylloc, Environment* env, std::string na
     try {
         const uint64_t value = expression->execute();
 
-        Environment::var* def = env->alloc_def( name );
-        if( !def ) throw ASTExceptionNamingConflict( get_location(), name );
-        def->set( value );
+        if( !env->alloc_def( name, value ) ) throw ASTExceptionNamingConflict( get_location(), name );
 
         const Environment::var* from_base = env->get( from );
         if( !from_base || !from_base->is_def() ) throw ASTExceptionNamingConflict( get_location(), from );
 
-        const uint64_t from_value = from_base->get();
+        const uint64_t from_value = from_base->get_slot().value;
 
         for( string member: env->get_struct_members( from ) ) {
-            Environment::var* dst = env->alloc_def( name + '.' + member );
             const Environment::var* src = env->get( from + '.' + member );
-
-            dst->set( src->get() - from_value );
+            env->alloc_def( name + '.' + member, src->get_slot().value - from_value );
         }
     }
     catch( const ASTExceptionDivisionByZero& ex ) {
@@ -767,6 +1800,11 @@ uint64_t ASTNodeDef::execute()
 	return 0;
 }
 
+void ASTNodeDef::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    // nothing to do
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeMap implementation
@@ -829,6 +1867,11 @@ uint64_t ASTNodeMap::execute()
 	return 0;
 }
 
+void ASTNodeMap::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    // nothing to do
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeImport implementation
@@ -841,8 +1884,8 @@ ASTNodeImport::ASTNodeImport( const yylloc_t& yylloc, Environment* env, std::str
 	cerr << "AST[" << this << "]: creating ASTNodeImport file=" << file << endl;
 #endif
 
-	ASTNode::ptr yyroot = env->parse( get_location(), file.c_str(), true, run_once );
-	add_child( yyroot );
+	m_Unit = env->parse( get_location(), file.c_str(), true, run_once );
+	add_child( m_Unit.get() );
 }
 
 uint64_t ASTNodeImport::execute()
@@ -851,17 +1894,23 @@ uint64_t ASTNodeImport::execute()
 	cerr << "AST[" << this << "]: executing ASTNodeImport" << endl;
 #endif
 
-	try {
-		if( get_children().size() > 0 ) get_children()[0]->execute();
-	}
-    catch( ASTExceptionExit& ) {
-        // nothing to do
-    }
-	catch( ASTExceptionBreak& ) {
-		// nothing to do
-	}
+	if( get_children().size() == 0 ) return STATUS_NORMAL;
 
-	return 0;
+	// exit and break leave the imported file only
+	uint64_t status = get_children()[0]->execute();
+	if( status == STATUS_QUIT || status == STATUS_TERMINATE ) return status;
+
+	return STATUS_NORMAL;
+}
+
+void ASTNodeImport::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    if( get_children().size() == 0 ) return;
+
+    // exit and break leave the imported file only
+    compiler.begin_unit();
+    compiler.statement( get_children()[0] );
+    compiler.end_unit( compiler.get_position() );
 }
 
 
@@ -882,21 +1931,42 @@ ASTNodeUnaryOperator::ASTNodeUnaryOperator( const yylloc_t& yylloc, ASTNode::ptr
 	if( expression->is_constant() ) set_constant();
 }
 
-uint64_t ASTNodeUnaryOperator::execute()
+ASTNode::ptr ASTNodeUnaryOperator::create( const yylloc_t& yylloc, ASTNode::ptr expression, int op )
 {
-#ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: executing ASTNodeUnaryOperator" << endl;
-#endif
+    switch( op ) {
+    case T_MINUS: return make_node< ASTNodeUnary< T_MINUS > >( yylloc, expression );
+    case T_BIT_NOT: return make_node< ASTNodeUnary< T_BIT_NOT > >( yylloc, expression );
+    case T_LOG_NOT: return make_node< ASTNodeUnary< T_LOG_NOT > >( yylloc, expression );
+
+    default: throw ASTExceptionSyntaxError( yylloc );
+    }
+}
 
-	uint64_t r = get_children()[0]->execute();
+template< int OP >
+uint64_t ASTNodeUnaryOperator::evaluate( uint64_t r )
+{
+    switch( OP ) {
+    case T_MINUS: return -r;
+    case T_BIT_NOT: return ~r;
+    case T_LOG_NOT: return r ? 0 : 0xffffffffffffffff;
 
-	switch( m_Operator ) {
-	case T_MINUS: return -r;
-	case T_BIT_NOT: return ~r;
-	case T_LOG_NOT: return r ? 0 : 0xffffffffffffffff;
+    default: return 0;
+    }
+}
 
-	default: return 0;
-	}
+void ASTNodeUnaryOperator::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    Bytecode::opcode_t op;
+
+    switch( m_Operator ) {
+    case T_MINUS: op = Bytecode::OP_NEG; break;
+    case T_BIT_NOT: op = Bytecode::OP_NOT; break;
+    case T_LOG_NOT: op = Bytecode::OP_LNOT; break;
+    default: compiler.emit( Bytecode::OP_LOADK, result, 0, 0, 0, this ); return;
+    }
+
+    compiler.expression( get_children()[0], result );
+    compiler.emit( op, result, result, 0, 0, this );
 }
 
 ASTNode::ptr ASTNodeUnaryOperator::clone_to_const()
@@ -908,7 +1978,7 @@ ASTNode::ptr ASTNodeUnaryOperator::clone_to_const()
 #endif
 
     try {
-        return make_shared<ASTNodeConstant>( get_location(), execute() );
+        return make_node<ASTNodeConstant>( get_location(), execute() );
     }
     catch( const ASTExceptionDivisionByZero& ex ) {
         throw ASTExceptionConstDivisionByZero( ex );
@@ -916,6 +1986,26 @@ ASTNode::ptr ASTNodeUnaryOperator::clone_to_const()
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeUnary implementation
+//////////////////////////////////////////////////////////////////////////////
+
+template< int OP >
+ASTNodeUnary< OP >::ASTNodeUnary( const yylloc_t& yylloc, ASTNode::ptr expression )
+ : ASTNodeUnaryOperator( yylloc, expression, OP )
+{}
+
+template< int OP >
+uint64_t ASTNodeUnary< OP >::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeUnary<" << OP << ">" << endl;
+#endif
+
+    return evaluate< OP >( get_children()[0]->execute() );
+}
+
+
 /////////////////////////////////////////////////////////////////////////////
 // class ASTNodeBinaryOperator implementation
 //////////////////////////////////////////////////////////////////////////////
@@ -935,42 +2025,137 @@ ASTNodeBinaryOperator::ASTNodeBinaryOperator( const yylloc_t& yylloc, ASTNode::p
 	add_child( expression2 );
 }
 
-uint64_t ASTNodeBinaryOperator::execute()
+ASTNode::ptr ASTNodeBinaryOperator::create( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, int op )
 {
-#ifdef ASTDEBUG
-	cerr << "AST[" << this << "]: executing ASTNodeBinaryOperator" << endl;
-#endif
-
-	uint64_t r0 = get_children()[0]->execute();
-	uint64_t r1 = get_children()[1]->execute();
+    switch( op ) {
+    case T_PLUS: return create< T_PLUS >( yylloc, expression1, expression2 );
+    case T_MINUS: return create< T_MINUS >( yylloc, expression1, expression2 );
+    case T_MUL: return create< T_MUL >( yylloc, expression1, expression2 );
+    case T_DIV: return create< T_DIV >( yylloc, expression1, expression2 );
+    case T_MOD: return create< T_MOD >( yylloc, expression1, expression2 );
+    case T_LSHIFT: return create< T_LSHIFT >( yylloc, expression1, expression2 );
+    case T_RSHIFT: return create< T_RSHIFT >( yylloc, expression1, expression2 );
+    case T_LT: return create< T_LT >( yylloc, expression1, expression2 );
+    case T_GT: return create< T_GT >( yylloc, expression1, expression2 );
+    case T_LE: return create< T_LE >( yylloc, expression1, expression2 );
+    case T_GE: return create< T_GE >( yylloc, expression1, expression2 );
+    case T_EQ: return create< T_EQ >( yylloc, expression1, expression2 );
+    case T_NE: return create< T_NE >( yylloc, expression1, expression2 );
+    case T_SLT: return create< T_SLT >( yylloc, expression1, expression2 );
+    case T_SGT: return create< T_SGT >( yylloc, expression1, expression2 );
+    case T_SLE: return create< T_SLE >( yylloc, expression1, expression2 );
+    case T_SGE: return create< T_SGE >( yylloc, expression1, expression2 );
+    case T_BIT_AND: return create< T_BIT_AND >( yylloc, expression1, expression2 );
+    case T_BIT_XOR: return create< T_BIT_XOR >( yylloc, expression1, expression2 );
+    case T_BIT_OR: return create< T_BIT_OR >( yylloc, expression1, expression2 );
+    case T_LOG_AND: return create< T_LOG_AND >( yylloc, expression1, expression2 );
+    case T_LOG_XOR: return create< T_LOG_XOR >( yylloc, expression1, expression2 );
+    case T_LOG_OR: return create< T_LOG_OR >( yylloc, expression1, expression2 );
+
+    default: throw ASTExceptionSyntaxError( yylloc );
+    }
+}
 
-	switch( m_Operator ) {
-	case T_PLUS: return r0 + r1;
-	case T_MINUS: return r0 - r1;
-	case T_MUL: return r0 * r1;
-	case T_DIV: if( r1 != 0 ) return r0 / r1; else throw ASTExceptionDivisionByZero( get_location() );
-	case T_MOD: if( r1 != 0 ) return r0 % r1; else throw ASTExceptionDivisionByZero( get_location() );
-	case T_LSHIFT: return r0 << r1;
-	case T_RSHIFT: return r0 >> r1;
-	case T_LT: return (r0 < r1) ? 0xffffffffffffffff : 0;
-	case T_GT: return (r0 > r1) ? 0xffffffffffffffff : 0;
-	case T_LE: return (r0 <= r1) ? 0xffffffffffffffff : 0;
-	case T_GE: return (r0 >= r1) ? 0xffffffffffffffff : 0;
-	case T_EQ: return (r0 == r1) ? 0xffffffffffffffff : 0;
-	case T_NE: return (r0 != r1) ? 0xffffffffffffffff : 0;
+template< int OP >
+uint64_t ASTNodeBinaryOperator::evaluate( uint64_t r0, uint64_t r1 )
+{
+    switch( OP ) {
+    case T_PLUS: return r0 + r1;
+    case T_MINUS: return r0 - r1;
+    case T_MUL: return r0 * r1;
+    case T_DIV: if( r1 != 0 ) return r0 / r1; else throw ASTExceptionDivisionByZero( get_location() );
+    case T_MOD: if( r1 != 0 ) return r0 % r1; else throw ASTExceptionDivisionByZero( get_location() );
+    case T_LSHIFT: return r0 << r1;
+    case T_RSHIFT: return r0 >> r1;
+    case T_LT: return (r0 < r1) ? 0xffffffffffffffff : 0;
+    case T_GT: return (r0 > r1) ? 0xffffffffffffffff : 0;
+    case T_LE: return (r0 <= r1) ? 0xffffffffffffffff : 0;
+    case T_GE: return (r0 >= r1) ? 0xffffffffffffffff : 0;
+    case T_EQ: return (r0 == r1) ? 0xffffffffffffffff : 0;
+    case T_NE: return (r0 != r1) ? 0xffffffffffffffff : 0;
     case T_SLT: return ((int64_t)r0 < (int64_t)r1) ? 0xffffffffffffffff : 0;
     case T_SGT: return ((int64_t)r0 > (int64_t)r1) ? 0xffffffffffffffff : 0;
     case T_SLE: return ((int64_t)r0 <= (int64_t)r1) ? 0xffffffffffffffff : 0;
     case T_SGE: return ((int64_t)r0 >= (int64_t)r1) ? 0xffffffffffffffff : 0;
-	case T_BIT_AND: return r0 & r1;
-	case T_BIT_XOR: return r0 ^ r1;
-	case T_BIT_OR: return r0 | r1;
-	case T_LOG_AND: return ((r0 != 0) && (r1 != 0)) ? 0xffffffffffffffff : 0;
-	case T_LOG_XOR: return ((r0 != 0) && (r1 == 0) || (r0 == 0) && (r1 != 0)) ? 0xffffffffffffffff : 0;
-	case T_LOG_OR: return ((r0 != 0) || (r1 != 0)) ? 0xffffffffffffffff : 0;
+    case T_BIT_AND: return r0 & r1;
+    case T_BIT_XOR: return r0 ^ r1;
+    case T_BIT_OR: return r0 | r1;
+    case T_LOG_AND: return ((r0 != 0) && (r1 != 0)) ? 0xffffffffffffffff : 0;
+    case T_LOG_XOR: return ((r0 != 0) && (r1 == 0) || (r0 == 0) && (r1 != 0)) ? 0xffffffffffffffff : 0;
+    case T_LOG_OR: return ((r0 != 0) || (r1 != 0)) ? 0xffffffffffffffff : 0;
+
+    default: return 0;
+    }
+}
 
-	default: return 0;
-	}
+template< int OP >
+ASTNode::ptr ASTNodeBinaryOperator::create( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2 )
+{
+    // constant expressions are folded by the parent, and a constant divisor of zero
+    // has to raise the error when the expression is executed
+    if( expression1->is_constant() || !expression2->is_constant() ) return make_node< ASTNodeBinary< OP > >( yylloc, expression1, expression2 );
+
+    uint64_t value;
+    try {
+        value = expression2->execute();
+    }
+    catch( const ASTExceptionDivisionByZero& ex ) {
+        throw ASTExceptionConstDivisionByZero( ex );
+    }
+
+    if( (OP == T_DIV || OP == T_MOD) && value == 0 ) return make_node< ASTNodeBinary< OP > >( yylloc, expression1, expression2 );
+
+    ASTNodeVar::ptr var = dynamic_cast< ASTNodeVar::ptr >( expression1 );
+    if( var && var->is_plain() ) return make_node< ASTNodeBinaryVarConst< OP > >( yylloc, expression1, expression2, var->get_slot(), value );
+
+    return make_node< ASTNodeBinaryConst< OP > >( yylloc, expression1, expression2, value );
+}
+
+void ASTNodeBinaryOperator::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    Bytecode::opcode_t op;
+
+    switch( m_Operator ) {
+    case T_PLUS: op = Bytecode::OP_ADD; break;
+    case T_MINUS: op = Bytecode::OP_SUB; break;
+    case T_MUL: op = Bytecode::OP_MUL; break;
+    case T_DIV: op = Bytecode::OP_DIV; break;
+    case T_MOD: op = Bytecode::OP_MOD; break;
+    case T_LSHIFT: op = Bytecode::OP_SHL; break;
+    case T_RSHIFT: op = Bytecode::OP_SHR; break;
+    case T_LT: op = Bytecode::OP_LT; break;
+    case T_GT: op = Bytecode::OP_GT; break;
+    case T_LE: op = Bytecode::OP_LE; break;
+    case T_GE: op = Bytecode::OP_GE; break;
+    case T_EQ: op = Bytecode::OP_EQ; break;
+    case T_NE: op = Bytecode::OP_NE; break;
+    case T_SLT: op = Bytecode::OP_SLT; break;
+    case T_SGT: op = Bytecode::OP_SGT; break;
+    case T_SLE: op = Bytecode::OP_SLE; break;
+    case T_SGE: op = Bytecode::OP_SGE; break;
+    case T_BIT_AND: op = Bytecode::OP_AND; break;
+    case T_BIT_XOR: op = Bytecode::OP_XOR; break;
+    case T_BIT_OR: op = Bytecode::OP_OR; break;
+    case T_LOG_AND: op = Bytecode::OP_LAND; break;
+    case T_LOG_XOR: op = Bytecode::OP_LXOR; break;
+    case T_LOG_OR: op = Bytecode::OP_LOR; break;
+    default: compiler.emit( Bytecode::OP_LOADK, result, 0, 0, 0, this ); return;
+    }
+
+    compiler.expression( get_children()[0], result );
+
+    // a constant divisor of zero keeps the register form to raise the error at runtime
+    uint64_t value;
+    if( compiler.get_constant( get_children()[1], value ) &&
+        !((op == Bytecode::OP_DIV || op == Bytecode::OP_MOD) && value == 0) ) {
+        compiler.emit( Bytecode::with_constant( op ), result, result, 0, value, this );
+    }
+    else {
+        Bytecode::reg_t operand = compiler.alloc_reg();
+        compiler.expression( get_children()[1], operand );
+        compiler.emit( op, result, result, operand, 0, this );
+        compiler.free_reg( operand );
+    }
 }
 
 ASTNode::ptr ASTNodeBinaryOperator::clone_to_const()
@@ -982,7 +2167,7 @@ ASTNode::ptr ASTNodeBinaryOperator::clone_to_const()
 #endif
 
     try {
-        return make_shared<ASTNodeConstant>( get_location(), execute() );
+        return make_node<ASTNodeConstant>( get_location(), execute() );
     }
     catch( const ASTExceptionDivisionByZero& ex ) {
         throw ASTExceptionConstDivisionByZero( ex );
@@ -990,6 +2175,72 @@ ASTNode::ptr ASTNodeBinaryOperator::clone_to_const()
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeBinary implementation
+//////////////////////////////////////////////////////////////////////////////
+
+template< int OP >
+ASTNodeBinary< OP >::ASTNodeBinary( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2 )
+ : ASTNodeBinaryOperator( yylloc, expression1, expression2, OP )
+{}
+
+template< int OP >
+uint64_t ASTNodeBinary< OP >::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeBinary<" << OP << ">" << endl;
+#endif
+
+    uint64_t r0 = get_children()[0]->execute();
+    uint64_t r1 = get_children()[1]->execute();
+
+    return evaluate< OP >( r0, r1 );
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeBinaryConst implementation
+//////////////////////////////////////////////////////////////////////////////
+
+template< int OP >
+ASTNodeBinaryConst< OP >::ASTNodeBinaryConst( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, uint64_t value )
+ : ASTNodeBinaryOperator( yylloc, expression1, expression2, OP ),
+   m_Value( value )
+{}
+
+template< int OP >
+uint64_t ASTNodeBinaryConst< OP >::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeBinaryConst<" << OP << ">" << endl;
+#endif
+
+    return evaluate< OP >( get_children()[0]->execute(), m_Value );
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeBinaryVarConst implementation
+//////////////////////////////////////////////////////////////////////////////
+
+template< int OP >
+ASTNodeBinaryVarConst< OP >::ASTNodeBinaryVarConst( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, const Environment::var::slot_t& slot, uint64_t value )
+ : ASTNodeBinaryOperator( yylloc, expression1, expression2, OP ),
+   m_Slot( slot ),
+   m_Value( value )
+{}
+
+template< int OP >
+uint64_t ASTNodeBinaryVarConst< OP >::execute()
+{
+#ifdef ASTDEBUG
+    cerr << "AST[" << this << "]: executing ASTNodeBinaryVarConst<" << OP << ">" << endl;
+#endif
+
+    return evaluate< OP >( Environment::var::load( m_Slot ), m_Value );
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeRestriction implementation
 //////////////////////////////////////////////////////////////////////////////
@@ -1031,6 +2282,17 @@ uint64_t ASTNodeRestriction::execute()
 	return result;
 }
 
+void ASTNodeRestriction::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    compiler.expression( get_children()[0], result );
+
+    switch( m_SizeRestriction ) {
+    case T_8BIT: compiler.emit( Bytecode::OP_ANDK, result, result, 0, 0xff, this ); break;
+    case T_16BIT: compiler.emit( Bytecode::OP_ANDK, result, result, 0, 0xffff, this ); break;
+    case T_32BIT: compiler.emit( Bytecode::OP_ANDK, result, result, 0, 0xffffffff, this ); break;
+    }
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeVar implementation
@@ -1043,11 +2305,13 @@ ASTNodeVar::ASTNodeVar( const yylloc_t& yylloc, Environment* env, std::string na
 	cerr << "AST[" << this << "]: creating ASTNodeVar name=" << name << endl;
 #endif
 
-	m_Var = env->get( name );
+	const Environment::var* var = env->get( name );
 
-    if( !m_Var ) throw ASTExceptionUndefinedVar( get_location(), name );
+    if( !var ) throw ASTExceptionUndefinedVar( get_location(), name );
 
-    if( m_Var->is_def() ) set_constant();
+    // defs are folded into the slot, redefining them later does not change parsed code
+    m_Slot = var->get_slot();
+    if( var->is_def() ) set_constant();
 }
 
 ASTNodeVar::ASTNodeVar( const yylloc_t& yylloc, Environment* env, std::string name, ASTNode::ptr index )
@@ -1057,13 +2321,14 @@ ASTNodeVar::ASTNodeVar( const yylloc_t& yylloc, Environment* env, std::string na
 	cerr << "AST[" << this << "]: creating ASTNodeVar name=" << name << " index=[" << index << "]" << endl;
 #endif
 
-	m_Var = env->get( name );
+	const Environment::var* var = env->get( name );
 
 	add_child( index );
 
-    if( !m_Var ) throw ASTExceptionUndefinedVar( get_location(), name );
+    if( !var ) throw ASTExceptionUndefinedVar( get_location(), name );
 
-    if( m_Var->is_def() && index->is_constant() ) set_constant();
+    m_Slot = var->get_slot();
+    if( var->is_def() && index->is_constant() ) set_constant();
 }
 
 uint64_t ASTNodeVar::execute()
@@ -1075,8 +2340,25 @@ uint64_t ASTNodeVar::execute()
 	uint64_t offset = 0;
 	if( get_children().size() > 0 ) offset = get_children()[0]->execute();
 
-	if( m_Var ) return m_Var->get() + offset;
-	else return 0;
+	return Environment::var::load( m_Slot ) + offset;
+}
+
+void ASTNodeVar::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    compiler.load_var( m_Slot, result, this );
+
+    if( get_children().size() > 0 ) {
+        uint64_t offset;
+        if( compiler.get_constant( get_children()[0], offset ) ) {
+            compiler.emit( Bytecode::OP_ADDK, result, result, 0, offset, this );
+        }
+        else {
+            Bytecode::reg_t index = compiler.alloc_reg();
+            compiler.expression( get_children()[0], index );
+            compiler.emit( Bytecode::OP_ADD, result, result, index, 0, this );
+            compiler.free_reg( index );
+        }
+    }
 }
 
 
@@ -1116,3 +2398,8 @@ uint64_t ASTNodeConstant::execute()
 
 	return m_Value;
 };
+
+void ASTNodeConstant::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    compiler.emit( Bytecode::OP_LOADK, result, 0, 0, m_Value, this );
+}
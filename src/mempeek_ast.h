@@ -28,6 +28,8 @@
 
 #include "mempeek_parser.h"
 #include "environment.h"
+#include "bytecode.h"
+#include "ast_arena.h"
 
 #include <ostream>
 #include <string>
@@ -48,7 +50,9 @@
 
 class ASTNode {
 public:
-    typedef std::shared_ptr<ASTNode> ptr;
+    // nodes are owned by their ASTArena, external references use std::shared_ptr<ASTNode>
+    // handles that share ownership of the arena
+    typedef ASTNode* ptr;
 
 	ASTNode( const yylloc_t& yylloc );
 	virtual ~ASTNode();
@@ -57,13 +61,33 @@ public:
 
 	void add_child( ASTNode::ptr node );
 
+	// completion status returned by execute() of statements, expressions return their value
+	enum status_t : uint64_t { STATUS_NORMAL = 0, STATUS_BREAK, STATUS_EXIT, STATUS_QUIT, STATUS_TERMINATE };
+
 	virtual uint64_t execute() = 0;
 
+	// emit bytecode for this node, the default executes the node through the AST interpreter
+	virtual void compile( BytecodeCompiler& compiler, Bytecode::reg_t result );
+
 	bool is_constant();
 	virtual ASTNode::ptr clone_to_const();
 
 protected:
-	typedef std::vector< ASTNode::ptr > nodelist_t;
+	// flat child array allocated in the arena
+	class nodelist_t {
+	public:
+	    ASTNode* const* begin() const;
+	    ASTNode* const* end() const;
+	    size_t size() const;
+	    ASTNode* operator[]( size_t index ) const;
+
+	private:
+	    friend class ASTNode;
+
+	    ASTNode** m_Nodes = nullptr;
+	    uint32_t m_Size = 0;
+	    uint32_t m_Capacity = 0;
+	};
 
 	const nodelist_t& get_children();
 
@@ -88,12 +112,13 @@ private:
 template< size_t NUM_ARGS >
 class ASTNodeBuiltin : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeBuiltin> ptr;
-    typedef uint64_t args_t[NUM_ARGS];
+    typedef ASTNodeBuiltin* ptr;
+    typedef uint64_t args_t[ NUM_ARGS > 0 ? NUM_ARGS : 1 ];
 
     ASTNodeBuiltin( const yylloc_t& yylloc, std::function< uint64_t( const args_t& ) > builtin );
 
     uint64_t execute() override;
+    void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
 private:
     std::function< uint64_t( const args_t& ) > m_Builtin;
@@ -106,11 +131,12 @@ private:
 
 class ASTNodeBreak : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeBreak> ptr;
+    typedef ASTNodeBreak* ptr;
 
     ASTNodeBreak( const yylloc_t& yylloc, int token );
 
     uint64_t execute() override;
+    void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
 private:
     int m_Token;
@@ -123,11 +149,18 @@ private:
 
 class ASTNodeBlock : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeBlock> ptr;
+    typedef ASTNodeBlock* ptr;
 
-	ASTNodeBlock( const yylloc_t& yylloc );
+	// the parts of a single statement, like the arguments of print, share one profiler marker
+	ASTNodeBlock( const yylloc_t& yylloc, bool is_statement = false );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
+
+	bool is_statement();
+
+private:
+	bool m_IsStatement;
 };
 
 
@@ -137,22 +170,36 @@ public:
 
 class ASTNodeSubroutine : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeSubroutine> ptr;
+    typedef ASTNodeSubroutine* ptr;
 
-    ASTNodeSubroutine( const yylloc_t& yylloc, std::weak_ptr<ASTNode> body, VarStorage* vars,
+    ASTNodeSubroutine( const yylloc_t& yylloc, std::string name, std::shared_ptr<ASTNode> body, VarStorage* vars,
                        std::vector< Environment::var* >& params, Environment::var* retval = nullptr );
 
     uint64_t execute() override;
+    void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
+
+    const std::string& get_name();
+    bool is_dropped();
+    ASTNode* get_body();
+    const std::weak_ptr<ASTNode>& get_body_handle();
+    VarStorage* get_local_vars();
+    const std::vector< Environment::var::slot_t >& get_params();
+    bool is_function();
+    const Environment::var::slot_t& get_retval();
 
 private:
+    std::string m_Name;
     VarStorage* m_LocalVars;
 
-    std::vector< Environment::var* > m_Params;
-    Environment::var* m_Retval;
+    std::vector< Environment::var::slot_t > m_Params;
+    Environment::var::slot_t m_Retval;
+    bool m_IsFunction;
 
-    // use weak_ptr for subroutine body to break circular references of recursive
-    // calls, a shared_ptr to the body remains in class SubroutineManager
+    // the body lives in an arena of its own that is held by class SubroutineManager,
+    // the weak_ptr detects dropped subroutines and breaks circular references of recursive calls.
+    // Subroutines are dropped by the parser only, a body is never released while it is running.
     std::weak_ptr<ASTNode> m_Body;
+    ASTNode* m_BodyNode;
 
 };
 
@@ -163,16 +210,17 @@ private:
 
 class ASTNodeAssign : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeAssign> ptr;
+    typedef ASTNodeAssign* ptr;
 
     ASTNodeAssign( const yylloc_t& yylloc, Environment* env, std::string name, ASTNode::ptr expression );
 
     uint64_t execute() override;
+    void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
-    Environment::var* get_var();
+    const Environment::var::slot_t& get_slot();
 
 private:
-    Environment::var* m_Var;
+    Environment::var::slot_t m_Slot;
 };
 
 
@@ -182,17 +230,15 @@ private:
 
 class ASTNodeStatic : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeStatic> ptr;
+    typedef ASTNodeStatic* ptr;
 
     ASTNodeStatic( const yylloc_t& yylloc, Environment* env, std::string name, ASTNode::ptr expression );
 
     uint64_t execute() override;
 
-    Environment::var* get_var();
-
 private:
     bool m_IsInitialized;
-    Environment::var* m_Var;
+    Environment::var::slot_t m_Slot;
 };
 
 
@@ -202,12 +248,13 @@ private:
 
 class ASTNodeIf : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeIf> ptr;
+    typedef ASTNodeIf* ptr;
 
 	ASTNodeIf( const yylloc_t& yylloc, ASTNode::ptr condition, ASTNode::ptr then_block );
 	ASTNodeIf( const yylloc_t& yylloc, ASTNode::ptr condition, ASTNode::ptr then_block, ASTNode::ptr else_block  );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 };
 
 
@@ -217,11 +264,12 @@ public:
 
 class ASTNodeWhile : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeWhile> ptr;
+    typedef ASTNodeWhile* ptr;
 
 	ASTNodeWhile( const yylloc_t& yylloc, ASTNode::ptr condition, ASTNode::ptr block );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 };
 
 
@@ -231,15 +279,16 @@ public:
 
 class ASTNodeFor : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeFor> ptr;
+    typedef ASTNodeFor* ptr;
 
     ASTNodeFor( const yylloc_t& yylloc, ASTNodeAssign::ptr var, ASTNode::ptr to );
     ASTNodeFor( const yylloc_t& yylloc, ASTNodeAssign::ptr var, ASTNode::ptr to, ASTNode::ptr step );
 
     uint64_t execute() override;
+    void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
 private:
-    Environment::var* m_Var;
+    Environment::var::slot_t m_Slot;
 };
 
 
@@ -249,38 +298,134 @@ private:
 
 class ASTNodePeek : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodePeek> ptr;
+    typedef ASTNodePeek* ptr;
 
-	ASTNodePeek( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction );
+    // creates the node class of the access size, see ASTNodePeekT
+    static ASTNode::ptr create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction );
 
-	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
-private:
-	template< typename T> uint64_t peek();
+protected:
+	ASTNodePeek( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction, const Environment::mapping_cache_t& cache );
+
+	template< typename T, typename A > uint64_t peek( MMap* mmap, A addr, void* phys_addr );
 
 	Environment* m_Env;
+	Environment::mapping_cache_t m_Cache;
+
+private:
+	template< typename T > static ASTNode::ptr create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction,
+	                                                  const Environment::mapping_cache_t& cache );
+
 	int m_SizeRestriction;
 };
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodePeekT
+//////////////////////////////////////////////////////////////////////////////
+
+// one node class per access size. IS_BOUND sites have a constant address that was bound
+// to its mapping at parse time, they do not execute the address.
+
+template< typename T, bool IS_BOUND >
+class ASTNodePeekT : public ASTNodePeek {
+public:
+    typedef ASTNodePeekT* ptr;
+
+    ASTNodePeekT( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, int size_restriction, const Environment::mapping_cache_t& cache );
+
+    uint64_t execute() override;
+};
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodePoke
 //////////////////////////////////////////////////////////////////////////////
 
 class ASTNodePoke : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodePoke> ptr;
+    typedef ASTNodePoke* ptr;
 
-	ASTNodePoke( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, int size_restriction );
-	ASTNodePoke( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask, int size_restriction );
+    // creates the node class of the access size and kind, see ASTNodePokeT
+    static ASTNode::ptr create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, int size_restriction, bool is_atomic );
+    static ASTNode::ptr create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask, int size_restriction, bool is_atomic );
 
-	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
+
+	typedef enum { WRITE, MODIFY, MODIFY_ATOMIC } access_t;
+
+protected:
+	ASTNodePoke( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask,
+	             int size_restriction, bool is_atomic, const Environment::mapping_cache_t& cache );
+
+	template< access_t ACCESS, typename T, typename A > void poke( MMap* mmap, A addr, void* phys_addr, T value );
+
+	Environment* m_Env;
+	Environment::mapping_cache_t m_Cache;
 
 private:
-	template< typename T> void poke();
+	template< typename T > static ASTNode::ptr create( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask,
+	                                                  int size_restriction, bool is_atomic, const Environment::mapping_cache_t& cache );
 
-    Environment* m_Env;
 	int m_SizeRestriction;
+	bool m_IsAtomic;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodePokeT
+//////////////////////////////////////////////////////////////////////////////
+
+// one node class per access size and kind of write, IS_BOUND like ASTNodePeekT. atomic
+// pokes always have a mask.
+
+template< typename T, bool IS_BOUND, ASTNodePoke::access_t ACCESS >
+class ASTNodePokeT : public ASTNodePoke {
+public:
+    typedef ASTNodePokeT* ptr;
+
+    ASTNodePokeT( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr value, ASTNode::ptr mask,
+                  int size_restriction, const Environment::mapping_cache_t& cache );
+
+    uint64_t execute() override;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeMemBlock
+//////////////////////////////////////////////////////////////////////////////
+
+class ASTNodeMemBlock : public ASTNode {
+public:
+    typedef ASTNodeMemBlock* ptr;
+
+    // memdump
+    ASTNodeMemBlock( const yylloc_t& yylloc, Environment* env, int operation, int size_restriction,
+                     ASTNode::ptr address, ASTNode::ptr size );
+
+    // memfill with a value, memcopy with a source address
+    ASTNodeMemBlock( const yylloc_t& yylloc, Environment* env, int operation, int size_restriction,
+                     ASTNode::ptr address, ASTNode::ptr arg, ASTNode::ptr size );
+
+    // memload and memsave
+    ASTNodeMemBlock( const yylloc_t& yylloc, Environment* env, int operation, int size_restriction,
+                     ASTNode::ptr address, ASTNode::ptr size, std::string file );
+
+    uint64_t execute() override;
+
+private:
+    MMap* get_mapping( void* address, size_t size );
+
+    void dump( void* address, size_t size );
+    void copy( MMap* dst_mmap, void* address, MMap* src_mmap, void* source, size_t size );
+    void load( void* address, size_t size );
+    void save( void* address, size_t size );
+
+    Environment* m_Env;
+    int m_Operation;
+    size_t m_Width;
+    std::string m_File;
 };
 
 
@@ -290,7 +435,7 @@ private:
 
 class ASTNodePrint : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodePrint> ptr;
+    typedef ASTNodePrint* ptr;
 
 	enum {
 		MOD_DEC = 0x01,
@@ -314,12 +459,12 @@ public:
 	ASTNodePrint( const yylloc_t& yylloc, ASTNode::ptr expression, int modifier );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
 	static int size_to_mod( int size );
+	static void print_value( uint64_t value, int modifier );
 
 private:
-	void print_value( std::ostream& out, uint64_t value );
-
 	int m_Modifier = MOD_DEC | MOD_32BIT;
 	std::string m_Text = "";
 };
@@ -331,7 +476,7 @@ private:
 
 class ASTNodeSleep : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeSleep> ptr;
+    typedef ASTNodeSleep* ptr;
 
     ASTNodeSleep( const yylloc_t& yylloc, ASTNode::ptr expression );
 
@@ -339,18 +484,178 @@ public:
 };
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeWaitfor
+//////////////////////////////////////////////////////////////////////////////
+
+class ASTNodeWaitfor : public ASTNode {
+public:
+    typedef ASTNodeWaitfor* ptr;
+
+    // args are the condition and the optional timeout and spin time, missing ones are nullptr
+    ASTNodeWaitfor( const yylloc_t& yylloc, Environment* env, std::vector< ASTNode* >& args );
+    ASTNodeWaitfor( const yylloc_t& yylloc, Environment* env, std::string result, std::vector< ASTNode* >& args );
+
+    uint64_t execute() override;
+
+    static const uint64_t TIMED_OUT = (uint64_t)-1;
+
+private:
+    void init( std::vector< ASTNode* >& args );
+
+    // all times in microseconds
+    static const uint64_t DEFAULT_SPIN = 100;
+    static const uint64_t MIN_BACKOFF = 1;
+    static const uint64_t MAX_BACKOFF = 1000;
+
+    bool m_HasTimeout = false;
+    bool m_HasSpin = false;
+
+    bool m_HasResult = false;
+    Environment::var::slot_t m_Slot;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeWaitirq
+//////////////////////////////////////////////////////////////////////////////
+
+class ASTNodeWaitirq : public ASTNode {
+public:
+    typedef ASTNodeWaitirq* ptr;
+
+    // timeout is nullptr when waiting forever
+    ASTNodeWaitirq( const yylloc_t& yylloc, Environment* env, std::vector< std::string >& devices, ASTNode::ptr timeout );
+    ASTNodeWaitirq( const yylloc_t& yylloc, Environment* env, std::string result, std::vector< std::string >& devices, ASTNode::ptr timeout );
+    ~ASTNodeWaitirq();
+
+    uint64_t execute() override;
+
+    static const uint64_t TIMED_OUT = (uint64_t)-1;
+
+private:
+    void init( Environment* env, std::vector< std::string >& devices, ASTNode::ptr timeout );
+
+    std::vector< std::string > m_Devices;
+    std::vector< int > m_Fds;
+    int m_Epoll = -1;
+
+    bool m_HasTimeout = false;
+
+    bool m_HasResult = false;
+    Environment::var::slot_t m_Slot;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeIrqEnable
+//////////////////////////////////////////////////////////////////////////////
+
+class ASTNodeIrqEnable : public ASTNode {
+public:
+    typedef ASTNodeIrqEnable* ptr;
+
+    // value is nullptr to write 1, which enables the interrupt of UIO devices
+    ASTNodeIrqEnable( const yylloc_t& yylloc, Environment* env, std::string device, ASTNode::ptr value );
+
+    uint64_t execute() override;
+
+private:
+    std::string m_Device;
+    int m_Fd;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeEvery
+//////////////////////////////////////////////////////////////////////////////
+
+class ASTNodeEvery : public ASTNode {
+public:
+    typedef ASTNodeEvery* ptr;
+
+    // stats is the name prefix of the statistics variables, empty if not requested
+    // the block is added as child after parsing it, the statistics variables must exist before
+    ASTNodeEvery( const yylloc_t& yylloc, Environment* env, ASTNode::ptr period, std::string stats );
+
+    uint64_t execute() override;
+    void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
+
+    // deadline schedule, used by execute() and the bytecode VM
+    // deadlines are absolute monotonic times in nanoseconds, the period is in microseconds
+    uint64_t start_schedule();
+    void wait_deadline( uint64_t& deadline, uint64_t period );
+
+private:
+    enum { STAT_COUNT, STAT_MISSED, STAT_OVERRUN, STAT_MAXOVERRUN, NUM_STATS };
+
+    bool m_HasStats = false;
+    Environment::var::slot_t m_Stats[ NUM_STATS ];
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeSample
+//////////////////////////////////////////////////////////////////////////////
+
+class Sampler;
+
+class ASTNodeSample : public ASTNode {
+public:
+    typedef ASTNodeSample* ptr;
+
+    // stats is the name prefix of the statistics variables, empty if not requested
+    ASTNodeSample( const yylloc_t& yylloc, Environment* env, int size_restriction, std::vector< ASTNode* >& addresses,
+                   ASTNode::ptr period, ASTNode::ptr count, std::string file, std::string stats );
+
+    uint64_t execute() override;
+
+private:
+    enum { STAT_COUNT, STAT_MISSED, STAT_DROPPED, STAT_RATE, NUM_STATS };
+
+    template< typename T > void capture( Sampler& sampler, const std::vector< uint64_t >& addresses,
+                                         uint64_t period, uint64_t count, uint64_t* stats );
+
+    // sleeping ends this many microseconds before a deadline, the rest is busy waiting
+    static const uint64_t SPIN_MARGIN = 100;
+
+    Environment* m_Env;
+    size_t m_Width;
+    size_t m_NumAddresses;
+    std::string m_File;
+
+    bool m_HasStats = false;
+    Environment::var::slot_t m_Stats[ NUM_STATS ];
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeFlush
+//////////////////////////////////////////////////////////////////////////////
+
+class ASTNodeFlush : public ASTNode {
+public:
+    typedef ASTNodeFlush* ptr;
+
+    ASTNodeFlush( const yylloc_t& yylloc );
+
+    uint64_t execute() override;
+};
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeDef
 //////////////////////////////////////////////////////////////////////////////
 
 class ASTNodeDef : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeDef> ptr;
+    typedef ASTNodeDef* ptr;
 
 	ASTNodeDef( const yylloc_t& yylloc, Environment* env, std::string name, ASTNode::ptr address );
 	ASTNodeDef( const yylloc_t& yylloc, Environment* env, std::string name, ASTNode::ptr address, std::string from );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 };
 
 
@@ -360,12 +665,13 @@ public:
 
 class ASTNodeMap : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeMap> ptr;
+    typedef ASTNodeMap* ptr;
 
 	ASTNodeMap( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr size );
     ASTNodeMap( const yylloc_t& yylloc, Environment* env, ASTNode::ptr address, ASTNode::ptr size, std::string device );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 };
 
 
@@ -375,11 +681,16 @@ public:
 
 class ASTNodeImport : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeImport> ptr;
+    typedef ASTNodeImport* ptr;
 
 	ASTNodeImport( const yylloc_t& yylloc, Environment* env, std::string file, bool run_once );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
+
+private:
+	// keeps the arena of the imported file alive
+	std::shared_ptr<ASTNode> m_Unit;
 };
 
 
@@ -389,49 +700,141 @@ public:
 
 class ASTNodeUnaryOperator : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeUnaryOperator> ptr;
+    typedef ASTNodeUnaryOperator* ptr;
 
-	ASTNodeUnaryOperator( const yylloc_t& yylloc, ASTNode::ptr expression, int op );
+    // creates the node class of the operator, see ASTNodeUnary
+    static ASTNode::ptr create( const yylloc_t& yylloc, ASTNode::ptr expression, int op );
 
-	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
     ASTNode::ptr clone_to_const() override;
 
+protected:
+	ASTNodeUnaryOperator( const yylloc_t& yylloc, ASTNode::ptr expression, int op );
+
+	template< int OP > static uint64_t evaluate( uint64_t r );
+
 private:
 	int m_Operator;
 };
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeUnary
+//////////////////////////////////////////////////////////////////////////////
+
+// one node class per operator, the operator is resolved when the node is created
+
+template< int OP >
+class ASTNodeUnary : public ASTNodeUnaryOperator {
+public:
+    typedef ASTNodeUnary* ptr;
+
+    ASTNodeUnary( const yylloc_t& yylloc, ASTNode::ptr expression );
+
+    uint64_t execute() override;
+};
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeBinaryOperator
 //////////////////////////////////////////////////////////////////////////////
 
 class ASTNodeBinaryOperator : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeBinaryOperator> ptr;
+    typedef ASTNodeBinaryOperator* ptr;
 
-	ASTNodeBinaryOperator( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, int op );
+    // creates the node class of the operator, see ASTNodeBinary. a constant right operand
+    // selects ASTNodeBinaryConst, or ASTNodeBinaryVarConst when the left one is a var.
+    static ASTNode::ptr create( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, int op );
 
-	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
 	ASTNode::ptr clone_to_const() override;
 
+protected:
+	ASTNodeBinaryOperator( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, int op );
+
+	template< int OP > uint64_t evaluate( uint64_t r0, uint64_t r1 );
+
 private:
+	template< int OP > static ASTNode::ptr create( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2 );
+
 	int m_Operator;
 };
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeBinary
+//////////////////////////////////////////////////////////////////////////////
+
+// one node class per operator, the operator is resolved when the node is created
+
+template< int OP >
+class ASTNodeBinary : public ASTNodeBinaryOperator {
+public:
+    typedef ASTNodeBinary* ptr;
+
+    ASTNodeBinary( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2 );
+
+    uint64_t execute() override;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeBinaryConst
+//////////////////////////////////////////////////////////////////////////////
+
+// expression OP constant, e.g. "x + 1" or "peek( REG ) == 0". the constant is kept as
+// second child for compile().
+
+template< int OP >
+class ASTNodeBinaryConst : public ASTNodeBinaryOperator {
+public:
+    typedef ASTNodeBinaryConst* ptr;
+
+    ASTNodeBinaryConst( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, uint64_t value );
+
+    uint64_t execute() override;
+
+private:
+    uint64_t m_Value;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeBinaryVarConst
+//////////////////////////////////////////////////////////////////////////////
+
+// var OP constant, e.g. "flags & 0x80", reads the var without executing its node
+
+template< int OP >
+class ASTNodeBinaryVarConst : public ASTNodeBinaryOperator {
+public:
+    typedef ASTNodeBinaryVarConst* ptr;
+
+    ASTNodeBinaryVarConst( const yylloc_t& yylloc, ASTNode::ptr expression1, ASTNode::ptr expression2, const Environment::var::slot_t& slot, uint64_t value );
+
+    uint64_t execute() override;
+
+private:
+    Environment::var::slot_t m_Slot;
+    uint64_t m_Value;
+};
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeRestriction
 //////////////////////////////////////////////////////////////////////////////
 
 class ASTNodeRestriction : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeRestriction> ptr;
+    typedef ASTNodeRestriction* ptr;
 
 	ASTNodeRestriction( const yylloc_t& yylloc, ASTNode::ptr node, int size_restriction );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
 private:
 	int m_SizeRestriction;
@@ -444,15 +847,20 @@ private:
 
 class ASTNodeVar : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeVar> ptr;
+    typedef ASTNodeVar* ptr;
 
 	ASTNodeVar( const yylloc_t& yylloc, Environment* env, std::string name );
 	ASTNodeVar( const yylloc_t& yylloc, Environment* env, std::string name, ASTNode::ptr index );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
+
+    // a var without index
+    bool is_plain();
+    const Environment::var::slot_t& get_slot();
 
 private:
-	const Environment::var* m_Var;
+	Environment::var::slot_t m_Slot;
 };
 
 
@@ -462,12 +870,13 @@ private:
 
 class ASTNodeConstant : public ASTNode {
 public:
-    typedef std::shared_ptr<ASTNodeConstant> ptr;
+    typedef ASTNodeConstant* ptr;
 
 	ASTNodeConstant( const yylloc_t& yylloc, std::string str, bool is_float = false );
     ASTNodeConstant( const yylloc_t& yylloc, uint64_t value );
 
 	uint64_t execute() override;
+	void compile( BytecodeCompiler& compiler, Bytecode::reg_t result ) override;
 
 private:
     uint64_t m_Value;
@@ -497,9 +906,20 @@ inline void ASTNode::add_child( ASTNode::ptr node )
     if( node ) {
         if( node->m_IsConstant ) {
             ASTNode::ptr constnode = node->clone_to_const();
-            m_Children.push_back( constnode ? constnode : node );
+            if( constnode ) node = constnode;
+        }
+
+        if( m_Children.m_Size == m_Children.m_Capacity ) {
+            // grow in the arena, the old array is released with the arena
+            uint32_t capacity = m_Children.m_Capacity ? 2 * m_Children.m_Capacity : 2;
+            ASTNode** nodes = (ASTNode**)ASTArena::get_current()->allocate( capacity * sizeof(ASTNode*) );
+            for( uint32_t i = 0; i < m_Children.m_Size; i++ ) nodes[i] = m_Children.m_Nodes[i];
+
+            m_Children.m_Nodes = nodes;
+            m_Children.m_Capacity = capacity;
         }
-        else m_Children.push_back( node );
+
+        m_Children.m_Nodes[ m_Children.m_Size++ ] = node;
     }
 }
 
@@ -514,13 +934,108 @@ inline void ASTNode::set_constant()
 }
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNode::nodelist_t inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline ASTNode* const* ASTNode::nodelist_t::begin() const
+{
+    return m_Nodes;
+}
+
+inline ASTNode* const* ASTNode::nodelist_t::end() const
+{
+    return m_Nodes + m_Size;
+}
+
+inline size_t ASTNode::nodelist_t::size() const
+{
+    return m_Size;
+}
+
+inline ASTNode* ASTNode::nodelist_t::operator[]( size_t index ) const
+{
+    return m_Nodes[ index ];
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeBlock inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline bool ASTNodeBlock::is_statement()
+{
+    return m_IsStatement;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeSubroutine inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline const std::string& ASTNodeSubroutine::get_name()
+{
+    return m_Name;
+}
+
+inline bool ASTNodeSubroutine::is_dropped()
+{
+    return m_Body.expired();
+}
+
+inline ASTNode* ASTNodeSubroutine::get_body()
+{
+    return m_BodyNode;
+}
+
+inline const std::weak_ptr<ASTNode>& ASTNodeSubroutine::get_body_handle()
+{
+    return m_Body;
+}
+
+inline VarStorage* ASTNodeSubroutine::get_local_vars()
+{
+    return m_LocalVars;
+}
+
+inline const std::vector< Environment::var::slot_t >& ASTNodeSubroutine::get_params()
+{
+    return m_Params;
+}
+
+inline bool ASTNodeSubroutine::is_function()
+{
+    return m_IsFunction;
+}
+
+inline const Environment::var::slot_t& ASTNodeSubroutine::get_retval()
+{
+    return m_Retval;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class ASTNodeAssign inline functions
 //////////////////////////////////////////////////////////////////////////////
 
-inline Environment::var* ASTNodeAssign::get_var()
+inline const Environment::var::slot_t& ASTNodeAssign::get_slot()
 {
-    return m_Var;
+    return m_Slot;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ASTNodeVar inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline bool ASTNodeVar::is_plain()
+{
+    return get_children().size() == 0;
+}
+
+inline const Environment::var::slot_t& ASTNodeVar::get_slot()
+{
+    return m_Slot;
 }
 
 
@@ -547,10 +1062,28 @@ uint64_t inline ASTNodeBuiltin< NUM_ARGS >::execute()
 
     assert( get_children().size() == NUM_ARGS );
 
-    uint64_t args[ NUM_ARGS ];
+    args_t args;
     for( size_t i = 0; i < NUM_ARGS; i++ ) args[i] = get_children()[i]->execute();
     return m_Builtin( args );
 }
 
+template< size_t NUM_ARGS >
+inline void ASTNodeBuiltin< NUM_ARGS >::compile( BytecodeCompiler& compiler, Bytecode::reg_t result )
+{
+    assert( get_children().size() == NUM_ARGS );
+
+    Bytecode::reg_t args = compiler.alloc_reg();
+    for( size_t i = 1; i < NUM_ARGS; i++ ) compiler.alloc_reg();
+    for( size_t i = 0; i < NUM_ARGS; i++ ) compiler.expression( get_children()[i], args + i );
+
+    std::function< uint64_t( const args_t& ) > builtin = m_Builtin;
+    size_t index = compiler.add_builtin( [ builtin ] ( const uint64_t* values ) {
+        return builtin( *(const args_t*)values );
+    } );
+
+    compiler.emit( Bytecode::OP_BUILTIN, result, args, NUM_ARGS, index, this );
+    compiler.free_reg( args );
+}
+
 
 #endif // __mempeek_ast_h__
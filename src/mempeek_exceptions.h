@@ -80,8 +80,6 @@ class ASTRuntimeException : public ASTException {};
 // ASTNode control flow exceptions
 //////////////////////////////////////////////////////////////////////////////
 
-class ASTExceptionExit : public ASTControlflowException {};
-class ASTExceptionBreak : public ASTControlflowException {};
 class ASTExceptionQuit : public ASTControlflowException {};
 class ASTExceptionTerminate : public ASTControlflowException {};
 
@@ -188,6 +186,51 @@ public:
 
 };
 
+class ASTExceptionNoBlockMapping : public ASTRuntimeException {
+public:
+	ASTExceptionNoBlockMapping( const yylloc_t& location, void* address, size_t size )
+	{
+		loc( location );
+		msg( "no mapping found for $0 bytes at address $1", size, address );
+	}
+};
+
+class ASTExceptionBlockBusError : public ASTRuntimeException {
+public:
+	ASTExceptionBlockBusError( const yylloc_t& location, void* address, size_t size )
+	{
+		loc( location );
+		msg( "failed access to $0 bytes at address $1", size, address );
+	}
+};
+
+class ASTExceptionBlockAlignment : public ASTRuntimeException {
+public:
+	ASTExceptionBlockAlignment( const yylloc_t& location, size_t size, size_t width )
+	{
+		loc( location );
+		msg( "block size $0 is not a multiple of the $1 bit access size", size, width * 8 );
+	}
+};
+
+class ASTExceptionBlockAddressAlignment : public ASTRuntimeException {
+public:
+	ASTExceptionBlockAddressAlignment( const yylloc_t& location, void* address, size_t width )
+	{
+		loc( location );
+		msg( "address $0 is not aligned to the $1 bit access size", address, width * 8 );
+	}
+};
+
+class ASTExceptionFileAccess : public ASTRuntimeException {
+public:
+	ASTExceptionFileAccess( const yylloc_t& location, std::string file )
+	{
+		loc( location );
+		msg( "failed to access file \"$0\"", file );
+	}
+};
+
 class ASTExceptionDroppedSubroutine : public ASTRuntimeException {
 public:
     ASTExceptionDroppedSubroutine( const yylloc_t& location )
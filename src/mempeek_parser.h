@@ -28,12 +28,11 @@
 
 #include <string>
 #include <vector>
-#include <memory>
 
 class ASTNode;
 class Environment;
 
-typedef std::shared_ptr<ASTNode> yynodeptr_t;
+typedef ASTNode* yynodeptr_t;
 
 typedef void* yyscan_t;
 
@@ -42,12 +41,33 @@ typedef struct {
     int token = 0;
     yynodeptr_t node = nullptr;
     std::vector< yynodeptr_t > nodelist;
+    std::vector< std::string > valuelist;
 } yyvalue_t;
 
 typedef Environment* yyenv_t;
 
 typedef struct {
-	std::string file;
+    int token;
+    int line;
+    std::string value;
+} yytoken_t;
+
+typedef std::vector< yytoken_t > yytokens_t;
+
+// token source of the parser. tokens are read from the flex scanner and optionally
+// recorded for the script cache, or they are replayed from the script cache.
+typedef struct {
+    yyscan_t scanner;
+    const char* file;
+    yytokens_t* recorded;
+    const yytokens_t* replayed;
+    size_t pos;
+    bool terminated;        // set by the scanner when it stops at an unknown token
+    bool after_poke;        // the last token was poke or its size
+} yylexer_t;
+
+typedef struct {
+	const char* file;       // interned by Environment::intern_filename()
 	int first_line;
 	int last_line;
 } yylloc_t;
@@ -31,59 +31,327 @@
 #include <unistd.h>
 #include <fcntl.h>
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
 
 
+//////////////////////////////////////////////////////////////////////////////
+// block access kernels
+//////////////////////////////////////////////////////////////////////////////
+
+template< typename T >
+static void copy_words( volatile void* dst, const volatile void* src, size_t size )
+{
+    volatile T* d = (volatile T*)dst;
+    const volatile T* s = (const volatile T*)src;
+    size_t num = size / sizeof(T);
+
+    // copy backwards when the destination overlaps the end of the source
+    if( d > s && d < s + num ) while( num-- > 0 ) d[ num ] = s[ num ];
+    else for( size_t i = 0; i < num; i++ ) d[i] = s[i];
+}
+
+template< typename T >
+static void fill_words( volatile void* dst, T value, size_t size )
+{
+    volatile T* d = (volatile T*)dst;
+    for( size_t i = 0; i < size / sizeof(T); i++ ) d[i] = value;
+}
+
+static void copy_block( volatile void* dst, const volatile void* src, size_t size, size_t width )
+{
+    switch( width ) {
+    case 1: copy_words< uint8_t >( dst, src, size ); break;
+    case 2: copy_words< uint16_t >( dst, src, size ); break;
+    case 4: copy_words< uint32_t >( dst, src, size ); break;
+    case 8: copy_words< uint64_t >( dst, src, size ); break;
+    default: memmove( (void*)dst, (const void*)src, size ); break;
+    }
+}
+
+static void fill_block( volatile void* dst, uint64_t value, size_t size, size_t width )
+{
+    switch( width ) {
+    case 1: fill_words< uint8_t >( dst, value, size ); break;
+    case 2: fill_words< uint16_t >( dst, value, size ); break;
+    case 4: fill_words< uint32_t >( dst, value, size ); break;
+    case 8: fill_words< uint64_t >( dst, value, size ); break;
+    default: memset( (void*)dst, (uint8_t)value, size ); break;
+    }
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class MMap implementation
 //////////////////////////////////////////////////////////////////////////////
 
-sig_atomic_t MMap::s_SignalEnable = 0;
+volatile sig_atomic_t MMap::s_SignalEnable = 0;
 sigjmp_buf MMap::s_SignalRecovery;
 
 
+MMap::MMap( void* phys_addr, size_t size )
+ : m_PhysAddr( (uintptr_t)phys_addr ),
+   m_Size( size )
+{
+}
+
 MMap* MMap::create( void* phys_addr, size_t size )
 {
-    return create( phys_addr, size, "/dev/mem" );
+    return create( phys_addr, size, "mem:" );
 }
 
 
 MMap* MMap::create( void* phys_addr, size_t size, const char* device )
 {
-    int fd = open( device, O_RDWR );
+    if( !strncmp( device, "sim:", 4 ) ) return create_simulated( phys_addr, size, device + 4 );
+    if( !strncmp( device, "uio:", 4 ) ) return create_uio( phys_addr, size, device + 4 );
+
+    const uintptr_t page_addr = (uintptr_t)phys_addr - (uintptr_t)phys_addr % getpagesize();
+    const off_t required_size = (uintptr_t)phys_addr + size;
+    int fd;
+
+    if( !strcmp( device, "mem:" ) ) fd = open( "/dev/mem", O_RDWR );
+    else if( !strncmp( device, "file:", 5 ) ) fd = open( device + 5, O_RDWR );
+    else if( !strncmp( device, "memfd:", 6 ) ) {
+        fd = memfd_create( device + 6, 0 );
+        if( fd >= 0 && ftruncate( fd, required_size ) < 0 ) {
+            close( fd );
+            return nullptr;
+        }
+    }
+    else if( !strncmp( device, "shm:", 4 ) ) {
+        // the object is grown to cover the mapping, but never shrunk
+        fd = shm_open( device + 4, O_RDWR | O_CREAT, 0600 );
+        struct stat st;
+        if( fd >= 0 && (fstat( fd, &st ) < 0 || (st.st_size < required_size && ftruncate( fd, required_size ) < 0)) ) {
+            close( fd );
+            return nullptr;
+        }
+    }
+    else fd = open( device, O_RDWR );
+
     if( fd < 0 ) return nullptr;
 
-    MMap* mmap = new MMap;
+    MMap* mmap = create_mapping( phys_addr, size, fd, page_addr, page_addr );
+    close( fd );
 
-    const int pagesize = getpagesize();
+    return mmap;
+}
+
+
+bool MMap::parse_uio_device( const char* device, std::string& file, int& map_index )
+{
+    // <dev>[:<map>], where dev is a device number or a device file
+    file = device;
+    map_index = 0;
+
+    std::string::size_type pos = file.rfind( ':' );
+    if( pos != std::string::npos ) {
+        char* end;
+        map_index = strtol( file.c_str() + pos + 1, &end, 10 );
+        if( *end || pos + 1 == file.length() ) return false;
+        file.erase( pos );
+    }
+
+    if( !file.empty() && file.find_first_not_of( "0123456789" ) == std::string::npos ) file = "/dev/uio" + file;
+
+    return !file.empty();
+}
+
+
+std::string MMap::get_device_file( const char* device )
+{
+    std::string file;
+    int map_index;
+
+    if( !strcmp( device, "mem:" ) ) return "/dev/mem";
+    if( !strncmp( device, "file:", 5 ) ) return device + 5;
+    if( !strncmp( device, "uio:", 4 ) ) return parse_uio_device( device + 4, file, map_index ) ? file : "";
+    if( !strncmp( device, "memfd:", 6 ) || !strncmp( device, "shm:", 4 ) || !strncmp( device, "sim:", 4 ) ) return "";
+
+    return device;
+}
+
+
+MMap* MMap::create_simulated( void* phys_addr, size_t size, const char* options )
+{
+    // <offset>=<type>[,...] gives the register at offset a behavior other than RAM
+    static const struct {
+        const char* name;
+        SimulatedMMap::read_callback_t read;
+        SimulatedMMap::write_callback_t write;
+    } s_Types[] = {
+        { "ro", nullptr, [] ( uint64_t old_value, uint64_t ) { return old_value; } },
+        { "wo", [] ( uint64_t& ) { return (uint64_t)0; }, nullptr },
+        { "rc", [] ( uint64_t& value ) { uint64_t ret = value; value = 0; return ret; }, nullptr },
+        { "inc", [] ( uint64_t& value ) { return value++; }, nullptr },
+        { nullptr, nullptr, nullptr }
+    };
+
+    SimulatedMMap* mmap = new SimulatedMMap( phys_addr, size );
+
+    std::string list = options;
+    std::string::size_type pos = 0;
+
+    while( pos < list.length() ) {
+        std::string::size_type next = list.find( ',', pos );
+        if( next == std::string::npos ) next = list.length();
+
+        std::string option = list.substr( pos, next - pos );
+        std::string::size_type eq = option.find( '=' );
+        pos = next + 1;
+
+        char* end;
+        uintptr_t offset = strtoull( option.c_str(), &end, 0 );
+
+        // the offset has to be followed by the type, a trailing comma is not allowed
+        bool valid = eq != 0 && eq != std::string::npos && end == option.c_str() + eq && offset < size && pos != list.length();
+
+        int i = 0;
+        if( valid ) {
+            while( s_Types[i].name && option.compare( eq + 1, std::string::npos, s_Types[i].name ) ) i++;
+            valid = s_Types[i].name != nullptr;
+        }
+
+        if( !valid ) {
+            delete mmap;
+            return nullptr;
+        }
+
+        mmap->set_callbacks( (uint8_t*)phys_addr + offset, s_Types[i].read, s_Types[i].write );
+    }
+
+    return mmap;
+}
+
+
+MMap* MMap::create_uio( void* phys_addr, size_t size, const char* device )
+{
+    std::string dev;
+    int map_index;
+
+    if( !parse_uio_device( device, dev, map_index ) ) return nullptr;
+
+    // the UIO memory maps start at the physical address listed in sysfs, without it the
+    // addresses are offsets into the memory map
+    uintptr_t map_addr = 0;
+
+    std::string::size_type name = dev.rfind( '/' );
+    std::string sysfs = "/sys/class/uio/" + dev.substr( name == std::string::npos ? 0 : name + 1 ) +
+                        "/maps/map" + std::to_string( map_index ) + "/addr";
+
+    FILE* file = fopen( sysfs.c_str(), "r" );
+    if( file ) {
+        unsigned long long addr;
+        if( fscanf( file, "%llx", &addr ) == 1 ) map_addr = addr;
+        fclose( file );
+    }
+
+    const uintptr_t page_addr = map_addr - map_addr % getpagesize();
+    if( (uintptr_t)phys_addr < page_addr ) return nullptr;
+
+    int fd = open( dev.c_str(), O_RDWR );
+    if( fd < 0 ) return nullptr;
+
+    // the mmap offset selects the memory map of the UIO device
+    MMap* mmap = create_mapping( phys_addr, size, fd, page_addr, (off_t)map_index * getpagesize() );
+    close( fd );
+
+    return mmap;
+}
+
+
+MMap* MMap::create_mapping( void* phys_addr, size_t size, int fd, uintptr_t base_addr, off_t file_offset )
+{
+    MMap* mmap = new MMap( phys_addr, size );
 
-    mmap->m_PhysAddr = (uintptr_t)phys_addr;
-    mmap->m_Size = size;
-    mmap->m_PageOffset = mmap->m_PhysAddr % pagesize;
+    const int pagesize = getpagesize();
 
-    const uintptr_t page_addr = mmap->m_PhysAddr - mmap->m_PageOffset;
+    // the mapping starts at base_addr, which is mapped to file_offset
+    mmap->m_PageOffset = mmap->m_PhysAddr - base_addr;
 
     mmap->m_MappingSize = size + mmap->m_PageOffset;
     mmap->m_MappingSize -= mmap->m_MappingSize % pagesize;
     if( mmap->m_MappingSize < size + mmap->m_PageOffset ) mmap->m_MappingSize += pagesize;
 
-    mmap->m_VirtAddr = ::mmap( 0, mmap->m_MappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, page_addr );
-
-    close(fd);
+    void* virt_addr = ::mmap( 0, mmap->m_MappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, file_offset );
 
-    if( mmap->m_VirtAddr == MAP_FAILED ) {
+    if( virt_addr == MAP_FAILED ) {
         delete mmap;
         return nullptr;
     }
-    else return mmap;
+
+    mmap->m_VirtAddr = virt_addr;
+    return mmap;
 }
 
 
 MMap::~MMap()
 {
-	munmap( m_VirtAddr, m_MappingSize );
+	if( m_VirtAddr ) munmap( m_VirtAddr, m_MappingSize );
+}
+
+uint64_t MMap::read_register( void* phys_addr, size_t width )
+{
+    return 0;
+}
+
+void MMap::write_register( void* phys_addr, size_t width, uint64_t value )
+{
+}
+
+void MMap::read( void* phys_addr, void* buffer, size_t size, size_t width )
+{
+    if( !m_VirtAddr ) {
+        if( !width ) width = 1;
+        for( size_t offset = 0; offset < size; offset += width ) {
+            uint64_t value = read_register( (uint8_t*)phys_addr + offset, width );
+            memcpy( (uint8_t*)buffer + offset, &value, width );
+        }
+        return;
+    }
+
+    m_HasFailed = false;
+    s_SignalEnable = 1;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) copy_block( buffer, get_virtual_address( phys_addr ), size, width );
+    else m_HasFailed = true;
+    s_SignalEnable = 0;
+}
+
+void MMap::write( void* phys_addr, const volatile void* buffer, size_t size, size_t width )
+{
+    if( !m_VirtAddr ) {
+        if( !width ) width = 1;
+        for( size_t offset = 0; offset < size; offset += width ) {
+            uint64_t value = 0;
+            memcpy( &value, (const uint8_t*)buffer + offset, width );
+            write_register( (uint8_t*)phys_addr + offset, width, value );
+        }
+        return;
+    }
+
+    m_HasFailed = false;
+    s_SignalEnable = 1;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) copy_block( get_virtual_address( phys_addr ), buffer, size, width );
+    else m_HasFailed = true;
+    s_SignalEnable = 0;
+}
+
+void MMap::fill( void* phys_addr, uint64_t value, size_t size, size_t width )
+{
+    if( !m_VirtAddr ) {
+        if( !width ) width = 1;
+        for( size_t offset = 0; offset < size; offset += width ) write_register( (uint8_t*)phys_addr + offset, width, value );
+        return;
+    }
+
+    m_HasFailed = false;
+    s_SignalEnable = 1;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) fill_block( get_virtual_address( phys_addr ), value, size, width );
+    else m_HasFailed = true;
+    s_SignalEnable = 0;
 }
 
 void MMap::enable_signal_handler()
@@ -93,7 +361,7 @@ void MMap::enable_signal_handler()
     struct sigaction sa;
 
     sigemptyset( &sa.sa_mask );
-    sa.sa_flags = 0;
+    sa.sa_flags = SA_NODEFER;
     sa.sa_handler = signal_handler;
 
     sigaction( SIGBUS, &sa, nullptr );
@@ -113,4 +381,61 @@ void MMap::disable_signal_handler()
 void MMap::signal_handler( int )
 {
     if( s_SignalEnable ) siglongjmp( s_SignalRecovery, 1);
+
+    // a fault outside of a protected access would be raised again as soon as we
+    // return, so let the default action terminate the process instead
+    signal( SIGBUS, SIG_DFL );
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class SimulatedMMap implementation
+//////////////////////////////////////////////////////////////////////////////
+
+SimulatedMMap::SimulatedMMap( void* phys_addr, size_t size )
+ : MMap( phys_addr, size ),
+   m_Registers( size )
+{
+}
+
+void SimulatedMMap::set_callbacks( void* phys_addr, read_callback_t read, write_callback_t write )
+{
+    callbacks_t& callbacks = m_Callbacks[ (uintptr_t)phys_addr - (uintptr_t)get_base_address() ];
+    callbacks.read = read;
+    callbacks.write = write;
+}
+
+uint64_t SimulatedMMap::read_register( void* phys_addr, size_t width )
+{
+    const size_t offset = (uintptr_t)phys_addr - (uintptr_t)get_base_address();
+
+    uint64_t value = 0;
+    memcpy( &value, m_Registers.data() + offset, width );
+
+    if( !m_Callbacks.empty() ) {
+        auto iter = m_Callbacks.find( offset );
+        if( iter != m_Callbacks.end() && iter->second.read ) {
+            uint64_t stored_value = value;
+            value = iter->second.read( stored_value );
+            memcpy( m_Registers.data() + offset, &stored_value, width );
+        }
+    }
+
+    return value;
+}
+
+void SimulatedMMap::write_register( void* phys_addr, size_t width, uint64_t value )
+{
+    const size_t offset = (uintptr_t)phys_addr - (uintptr_t)get_base_address();
+
+    if( !m_Callbacks.empty() ) {
+        auto iter = m_Callbacks.find( offset );
+        if( iter != m_Callbacks.end() && iter->second.write ) {
+            uint64_t old_value = 0;
+            memcpy( &old_value, m_Registers.data() + offset, width );
+            value = iter->second.write( old_value, value );
+        }
+    }
+
+    memcpy( m_Registers.data() + offset, &value, width );
 }
@@ -26,26 +26,50 @@
 #ifndef __mmap_h__
 #define __mmap_h__
 
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+
 #include <stdint.h>
 #include <stddef.h>
 #include <setjmp.h>
 #include <signal.h>
+#include <sys/types.h>
 
 
 //////////////////////////////////////////////////////////////////////////////
 // class MMap
 //////////////////////////////////////////////////////////////////////////////
 
+// a mapping of a physical address range. The backend is selected by a prefix of the device:
+//
+//     mem:                 physical memory through /dev/mem
+//     uio:<dev>[:<map>]    UIO device /dev/uio<dev> or device file <dev>, memory map number <map>
+//     file:<path>          regular file or device file, mapped at the offset of the address
+//     memfd:<name>         anonymous memory of this process
+//     shm:<name>           POSIX shared memory object, created when it does not exist
+//     sim:                 simulated register file, see class SimulatedMMap
+//
+// a device without prefix is mapped like "file:". All backends except the simulated one
+// map the memory into the address space and share the inline access functions below.
+
 class MMap {
 public:
     static MMap* create( void* phys_addr, size_t size );
     static MMap* create( void* phys_addr, size_t size, const char* device );
 
-	~MMap();
+	virtual ~MMap();
 
 	void* get_base_address();
 	size_t get_size();
 
+	bool contains( void* phys_addr, size_t size );
+
+	// nullptr when the backend is not memory mapped
+	volatile void* get_virtual_address( void* phys_addr );
+	bool is_memory_mapped();
+
     bool has_failed();
 
 	template< typename T > T peek( void* phys_addr );
@@ -55,24 +79,63 @@ public:
 	template< typename T > void clear( void* phys_addr, T value );
 	template< typename T > void toggle( void* phys_addr, T value );
 
+	// replace the bits selected by mask with one read and one write, or with a compare and
+	// swap loop when other processes modify the same memory concurrently
+	template< typename T > void modify( void* phys_addr, T value, T mask );
+	template< typename T > void modify_atomic( void* phys_addr, T value, T mask );
+
+	// access to an address that was translated by get_virtual_address() before
+	template< typename T > T peek( volatile void* virt_addr );
+	template< typename T > void poke( volatile void* virt_addr, T value );
+
+	template< typename T > void set( volatile void* virt_addr, T value );
+	template< typename T > void clear( volatile void* virt_addr, T value );
+
+	template< typename T > void modify( volatile void* virt_addr, T value, T mask );
+	template< typename T > void modify_atomic( volatile void* virt_addr, T value, T mask );
+
+	// block access to size bytes with a fixed access width in bytes. width 0 selects the
+	// fastest access with any width and alignment, which is not suitable for most devices.
+	// the source of write() may be the virtual address of another mapping.
+	void read( void* phys_addr, void* buffer, size_t size, size_t width );
+	void write( void* phys_addr, const volatile void* buffer, size_t size, size_t width );
+	void fill( void* phys_addr, uint64_t value, size_t size, size_t width );
+
+	// file of a backend with a device file, for other uses like waiting for interrupts.
+	// empty when the backend has no device file.
+	static std::string get_device_file( const char* device );
+
 	static void enable_signal_handler();
 	static void disable_signal_handler();
 
+protected:
+	MMap( void* phys_addr, size_t size );
+
+	// register access of backends that are not memory mapped
+	virtual uint64_t read_register( void* phys_addr, size_t width );
+	virtual void write_register( void* phys_addr, size_t width, uint64_t value );
+
 private:
-	MMap() {}
+	static MMap* create_mapping( void* phys_addr, size_t size, int fd, uintptr_t base_addr, off_t file_offset );
+	static MMap* create_uio( void* phys_addr, size_t size, const char* device );
+	static MMap* create_simulated( void* phys_addr, size_t size, const char* options );
+	static bool parse_uio_device( const char* device, std::string& file, int& map_index );
 
 	static void signal_handler( int );
 
 	uintptr_t m_PhysAddr;
 	size_t m_Size;
-	size_t m_PageOffset;
+	size_t m_PageOffset = 0;
 
-	void* m_VirtAddr;
-	size_t m_MappingSize;
+	void* m_VirtAddr = nullptr;
+	size_t m_MappingSize = 0;
 
 	bool m_HasFailed = false;
 
-	static sig_atomic_t s_SignalEnable;
+	// accesses arm the recovery point without saving the signal mask, that would be a
+	// syscall per access. SIGBUS is not blocked while the handler runs (SA_NODEFER),
+	// so the mask is unchanged when the handler jumps back.
+	static volatile sig_atomic_t s_SignalEnable;
 	static sigjmp_buf s_SignalRecovery;
 
 	MMap( const MMap& ) = delete;
@@ -80,6 +143,40 @@ private:
 };
 
 
+//////////////////////////////////////////////////////////////////////////////
+// class SimulatedMMap
+//////////////////////////////////////////////////////////////////////////////
+
+// register file in process memory to run scripts without hardware. Registers behave like
+// RAM unless callbacks are installed. A read callback gets the stored value, which it may
+// change, and returns the value read. A write callback gets the stored and the written value
+// and returns the value to store. MMap::create() installs callbacks for the register types
+// given in the device name.
+
+class SimulatedMMap : public MMap {
+public:
+    typedef std::function< uint64_t( uint64_t& value ) > read_callback_t;
+    typedef std::function< uint64_t( uint64_t old_value, uint64_t value ) > write_callback_t;
+
+    SimulatedMMap( void* phys_addr, size_t size );
+
+    void set_callbacks( void* phys_addr, read_callback_t read, write_callback_t write );
+
+protected:
+    uint64_t read_register( void* phys_addr, size_t width ) override;
+    void write_register( void* phys_addr, size_t width, uint64_t value ) override;
+
+private:
+    typedef struct {
+        read_callback_t read;
+        write_callback_t write;
+    } callbacks_t;
+
+    std::vector< uint8_t > m_Registers;
+    std::map< size_t, callbacks_t > m_Callbacks;
+};
+
+
 //////////////////////////////////////////////////////////////////////////////
 // class MMap inline functions
 //////////////////////////////////////////////////////////////////////////////
@@ -94,6 +191,22 @@ inline size_t MMap::get_size()
 	return m_Size;
 }
 
+inline bool MMap::contains( void* phys_addr, size_t size )
+{
+    return (uintptr_t)phys_addr >= m_PhysAddr && (uintptr_t)phys_addr + size <= m_PhysAddr + m_Size;
+}
+
+inline volatile void* MMap::get_virtual_address( void* phys_addr )
+{
+    if( !m_VirtAddr ) return nullptr;
+    return (uint8_t*)m_VirtAddr + ((uintptr_t)phys_addr - m_PhysAddr + m_PageOffset);
+}
+
+inline bool MMap::is_memory_mapped()
+{
+    return m_VirtAddr != nullptr;
+}
+
 inline bool MMap::has_failed()
 {
     return m_HasFailed;
@@ -107,14 +220,74 @@ inline bool MMap::has_failed()
 template< typename T >
 inline T MMap::peek( void* phys_addr )
 {
-	uintptr_t offset = (uintptr_t)phys_addr - m_PhysAddr + m_PageOffset;
-	volatile T* virt_addr = (T*)((uint8_t*)m_VirtAddr + offset);
+    if( !m_VirtAddr ) return read_register( phys_addr, sizeof(T) );
+	return peek<T>( get_virtual_address( phys_addr ) );
+}
+
+template< typename T >
+inline void MMap::poke( void* phys_addr, T value )
+{
+    if( !m_VirtAddr ) write_register( phys_addr, sizeof(T), value );
+    else poke<T>( get_virtual_address( phys_addr ), value );
+}
+
+template< typename T >
+inline void MMap::set( void* phys_addr, T value )
+{
+    if( !m_VirtAddr ) write_register( phys_addr, sizeof(T), read_register( phys_addr, sizeof(T) ) | value );
+    else set<T>( get_virtual_address( phys_addr ), value );
+}
+
+template< typename T >
+inline void MMap::clear( void* phys_addr, T value )
+{
+    if( !m_VirtAddr ) write_register( phys_addr, sizeof(T), read_register( phys_addr, sizeof(T) ) & ~(uint64_t)value );
+    else clear<T>( get_virtual_address( phys_addr ), value );
+}
+
+template< typename T >
+inline void MMap::modify( void* phys_addr, T value, T mask )
+{
+    if( !m_VirtAddr ) {
+        const uint64_t old = read_register( phys_addr, sizeof(T) );
+        write_register( phys_addr, sizeof(T), (old & ~(uint64_t)mask) | (value & mask) );
+    }
+    else modify<T>( get_virtual_address( phys_addr ), value, mask );
+}
+
+template< typename T >
+inline void MMap::modify_atomic( void* phys_addr, T value, T mask )
+{
+    // registers of backends without memory mapping are not shared with other processes
+    if( !m_VirtAddr ) modify<T>( phys_addr, value, mask );
+    else modify_atomic<T>( get_virtual_address( phys_addr ), value, mask );
+}
 
+template< typename T >
+inline void MMap::toggle( void* phys_addr, T value )
+{
+    if( !m_VirtAddr ) {
+        write_register( phys_addr, sizeof(T), read_register( phys_addr, sizeof(T) ) ^ value );
+        return;
+    }
+
+	volatile T* virt_addr = (volatile T*)get_virtual_address( phys_addr );
+
+    m_HasFailed = false;
+    s_SignalEnable = 1;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) *virt_addr ^= value;
+    else m_HasFailed = true;
+    s_SignalEnable = 0;
+}
+
+template< typename T >
+inline T MMap::peek( volatile void* virt_addr )
+{
 	T ret = 0;
 
     m_HasFailed = false;
     s_SignalEnable = 1;
-    if( sigsetjmp( s_SignalRecovery, 1 ) == 0 ) ret = *virt_addr;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) ret = *(volatile T*)virt_addr;
     else m_HasFailed = true;
     s_SignalEnable = 0;
 
@@ -122,53 +295,59 @@ inline T MMap::peek( void* phys_addr )
 }
 
 template< typename T >
-inline void MMap::poke( void* phys_addr, T value )
+inline void MMap::poke( volatile void* virt_addr, T value )
 {
-	uintptr_t offset = (uintptr_t)phys_addr - m_PhysAddr + m_PageOffset;
-	volatile T* virt_addr = (T*)((uint8_t*)m_VirtAddr + offset);
-
 	m_HasFailed = false;
 	s_SignalEnable = 1;
-    if( sigsetjmp( s_SignalRecovery, 1 ) == 0 ) *virt_addr = value;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) *(volatile T*)virt_addr = value;
     else m_HasFailed = true;
     s_SignalEnable = 0;
 }
 
 template< typename T >
-inline void MMap::set( void* phys_addr, T value )
+inline void MMap::set( volatile void* virt_addr, T value )
 {
-	uintptr_t offset = (uintptr_t)phys_addr - m_PhysAddr + m_PageOffset;
-	volatile T* virt_addr = (T*)((uint8_t*)m_VirtAddr + offset);
-
     m_HasFailed = false;
     s_SignalEnable = 1;
-    if( sigsetjmp( s_SignalRecovery, 1 ) == 0 ) *virt_addr |= value;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) *(volatile T*)virt_addr |= value;
     else m_HasFailed = true;
     s_SignalEnable = 0;
 }
 
 template< typename T >
-inline void MMap::clear( void* phys_addr, T value )
+inline void MMap::clear( volatile void* virt_addr, T value )
 {
-	uintptr_t offset = (uintptr_t)phys_addr - m_PhysAddr + m_PageOffset;
-	volatile T* virt_addr = (T*)((uint8_t*)m_VirtAddr + offset);
-
     m_HasFailed = false;
     s_SignalEnable = 1;
-    if( sigsetjmp( s_SignalRecovery, 1 ) == 0 ) *virt_addr &= ~value;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) *(volatile T*)virt_addr &= ~value;
     else m_HasFailed = true;
     s_SignalEnable = 0;
 }
 
 template< typename T >
-inline void MMap::toggle( void* phys_addr, T value )
+inline void MMap::modify( volatile void* virt_addr, T value, T mask )
 {
-	uintptr_t offset = (uintptr_t)phys_addr - m_PhysAddr + m_PageOffset;
-	volatile T* virt_addr = (T*)((uint8_t*)m_VirtAddr + offset);
+    m_HasFailed = false;
+    s_SignalEnable = 1;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) {
+        volatile T* addr = (volatile T*)virt_addr;
+        *addr = (*addr & ~mask) | (value & mask);
+    }
+    else m_HasFailed = true;
+    s_SignalEnable = 0;
+}
 
+template< typename T >
+inline void MMap::modify_atomic( volatile void* virt_addr, T value, T mask )
+{
     m_HasFailed = false;
     s_SignalEnable = 1;
-    if( sigsetjmp( s_SignalRecovery, 1 ) == 0 ) *virt_addr ^= value;
+    if( sigsetjmp( s_SignalRecovery, 0 ) == 0 ) {
+        volatile T* addr = (volatile T*)virt_addr;
+        T old = __atomic_load_n( addr, __ATOMIC_RELAXED );
+        while( !__atomic_compare_exchange_n( addr, &old, (T)((old & ~mask) | (value & mask)), false,
+                                             __ATOMIC_SEQ_CST, __ATOMIC_RELAXED ) );
+    }
     else m_HasFailed = true;
     s_SignalEnable = 0;
 }
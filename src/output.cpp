@@ -0,0 +1,94 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "output.h"
+
+#include <iostream>
+
+#include <stdio.h>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Output implementation
+//////////////////////////////////////////////////////////////////////////////
+
+char Output::s_Buffer[ BUFFER_SIZE ];
+size_t Output::s_Pos = 0;
+bool Output::s_IsLineBuffered = true;
+
+const char Output::s_HexDigits[16] = {
+    '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'
+};
+
+const char Output::s_DecPairs[200] = {
+    '0','0', '0','1', '0','2', '0','3', '0','4', '0','5', '0','6', '0','7', '0','8', '0','9',
+    '1','0', '1','1', '1','2', '1','3', '1','4', '1','5', '1','6', '1','7', '1','8', '1','9',
+    '2','0', '2','1', '2','2', '2','3', '2','4', '2','5', '2','6', '2','7', '2','8', '2','9',
+    '3','0', '3','1', '3','2', '3','3', '3','4', '3','5', '3','6', '3','7', '3','8', '3','9',
+    '4','0', '4','1', '4','2', '4','3', '4','4', '4','5', '4','6', '4','7', '4','8', '4','9',
+    '5','0', '5','1', '5','2', '5','3', '5','4', '5','5', '5','6', '5','7', '5','8', '5','9',
+    '6','0', '6','1', '6','2', '6','3', '6','4', '6','5', '6','6', '6','7', '6','8', '6','9',
+    '7','0', '7','1', '7','2', '7','3', '7','4', '7','5', '7','6', '7','7', '7','8', '7','9',
+    '8','0', '8','1', '8','2', '8','3', '8','4', '8','5', '8','6', '8','7', '8','8', '8','9',
+    '9','0', '9','1', '9','2', '9','3', '9','4', '9','5', '9','6', '9','7', '9','8', '9','9'
+};
+
+const char Output::s_BinNibbles[16][4] = {
+    { '0','0','0','0' }, { '0','0','0','1' }, { '0','0','1','0' }, { '0','0','1','1' },
+    { '0','1','0','0' }, { '0','1','0','1' }, { '0','1','1','0' }, { '0','1','1','1' },
+    { '1','0','0','0' }, { '1','0','0','1' }, { '1','0','1','0' }, { '1','0','1','1' },
+    { '1','1','0','0' }, { '1','1','0','1' }, { '1','1','1','0' }, { '1','1','1','1' }
+};
+
+
+void Output::write_through( const char* str, size_t len )
+{
+    flush();
+
+    if( len > BUFFER_SIZE ) cout.rdbuf()->sputn( str, len );
+    else {
+        memcpy( s_Buffer, str, len );
+        s_Pos = len;
+    }
+}
+
+void Output::flt( double value )
+{
+    // same format as the default ostream formatting of doubles
+    char tmp[32];
+    int len = snprintf( tmp, sizeof(tmp), "%g", value );
+    write( tmp, len );
+}
+
+void Output::flush()
+{
+    // written through the streambuf of cout, that might be a teebuf to a log file
+    if( s_Pos > 0 ) cout.rdbuf()->sputn( s_Buffer, s_Pos );
+    s_Pos = 0;
+
+    cout.flush();
+}
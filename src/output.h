@@ -0,0 +1,182 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __output_h__
+#define __output_h__
+
+#include <string>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Output
+//////////////////////////////////////////////////////////////////////////////
+
+// formats the output of print and memdump into a large buffer that is written to cout
+// when it is full, at the end of each print statement when line buffering is enabled,
+// and on explicit flush. everything else that writes to cout or cerr must flush first.
+
+class Output {
+public:
+    static void set_line_buffered( bool line_buffered );
+    static bool is_line_buffered();
+
+    static void put( char c );
+    static void write( const char* str, size_t len );
+    static void write( const std::string& str );
+
+    static void hex( uint64_t value, int digits );
+    static void hex_digits( uint64_t value, int digits );
+    static void dec( uint64_t value );
+    static void dec_signed( int64_t value );
+    static void bin( uint64_t value, int bits );
+    static void flt( double value );
+
+    // end of a print statement, flushes when line buffered
+    static void end_statement();
+    static void flush();
+
+private:
+    enum { BUFFER_SIZE = 65536 };
+
+    static char* reserve( size_t len );
+    static void write_through( const char* str, size_t len );
+
+    static char s_Buffer[ BUFFER_SIZE ];
+    static size_t s_Pos;
+    static bool s_IsLineBuffered;
+
+    static const char s_HexDigits[16];
+    static const char s_DecPairs[200];
+    static const char s_BinNibbles[16][4];
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Output inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline void Output::set_line_buffered( bool line_buffered )
+{
+    s_IsLineBuffered = line_buffered;
+}
+
+inline bool Output::is_line_buffered()
+{
+    return s_IsLineBuffered;
+}
+
+inline char* Output::reserve( size_t len )
+{
+    if( s_Pos + len > BUFFER_SIZE ) flush();
+    return s_Buffer + s_Pos;
+}
+
+inline void Output::put( char c )
+{
+    *reserve( 1 ) = c;
+    s_Pos++;
+}
+
+inline void Output::write( const char* str, size_t len )
+{
+    if( len > BUFFER_SIZE - s_Pos ) write_through( str, len );
+    else {
+        memcpy( s_Buffer + s_Pos, str, len );
+        s_Pos += len;
+    }
+}
+
+inline void Output::write( const std::string& str )
+{
+    write( str.c_str(), str.length() );
+}
+
+inline void Output::hex( uint64_t value, int digits )
+{
+    write( "0x", 2 );
+    hex_digits( value, digits );
+}
+
+inline void Output::hex_digits( uint64_t value, int digits )
+{
+    char* p = reserve( digits );
+    for( int i = digits - 1; i >= 0; i--, value >>= 4 ) p[i] = s_HexDigits[ value & 0xf ];
+    s_Pos += digits;
+}
+
+inline void Output::dec( uint64_t value )
+{
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+
+    while( value >= 100 ) {
+        p -= 2;
+        memcpy( p, s_DecPairs + (value % 100) * 2, 2 );
+        value /= 100;
+    }
+
+    if( value >= 10 ) {
+        p -= 2;
+        memcpy( p, s_DecPairs + value * 2, 2 );
+    }
+    else *--p = '0' + value;
+
+    write( p, tmp + sizeof(tmp) - p );
+}
+
+inline void Output::dec_signed( int64_t value )
+{
+    if( value < 0 ) {
+        put( '-' );
+        dec( -(uint64_t)value );
+    }
+    else dec( value );
+}
+
+inline void Output::bin( uint64_t value, int bits )
+{
+    // groups of four bits separated by blanks
+    char* p = reserve( bits / 4 * 5 );
+
+    for( int i = bits - 4; i >= 0; i -= 4 ) {
+        memcpy( p, s_BinNibbles[ (value >> i) & 0xf ], 4 );
+        p += 4;
+        if( i > 0 ) *p++ = ' ';
+    }
+
+    s_Pos = p - s_Buffer;
+}
+
+inline void Output::end_statement()
+{
+    if( s_IsLineBuffered ) flush();
+}
+
+
+#endif // __output_h__
@@ -37,14 +37,41 @@ using namespace std;
 
 int yylex( yyvalue_t*, YYLTYPE*, yyscan_t );
 
-void yyerror( YYLTYPE* yylloc, yyscan_t, yyenv_t, yynodeptr_t&, const char* ) { throw ASTExceptionSyntaxError( *yylloc ); }
+static int next_token( yyvalue_t* yylval, YYLTYPE* yylloc, yylexer_t* lexer )
+{
+    if( lexer->replayed ) {
+        if( lexer->pos >= lexer->replayed->size() ) return 0;
+
+        const yytoken_t& token = (*lexer->replayed)[ lexer->pos++ ];
+        yylval->value = token.value;
+        yylval->token = token.token;
+        yylloc->file = lexer->file;
+        yylloc->first_line = yylloc->last_line = token.line;
+
+        return token.token;
+    }
+
+    int token = yylex( yylval, yylloc, lexer->scanner );
+    if( lexer->recorded && token != 0 ) lexer->recorded->push_back( { token, yylloc->first_line, yylval->value } );
+
+    return token;
+}
+
+// words that are only keywords at one place of the grammar are scanned as identifiers, so
+// they can still be used as names everywhere else
+static void expect_keyword( const YYLTYPE& yylloc, const yyvalue_t& token, const char* keyword )
+{
+    if( token.value != keyword ) throw ASTExceptionSyntaxError( yylloc );
+}
+
+void yyerror( YYLTYPE* yylloc, yylexer_t*, yyenv_t, yynodeptr_t&, const char* ) { throw ASTExceptionSyntaxError( *yylloc ); }
 
 %}
 
 %define api.value.type { yyvalue_t }
 %define api.pure full
-%parse-param { yyscan_t scanner } { yyenv_t env } { yynodeptr_t& yyroot }
-%lex-param { yyscan_t scanner }
+%parse-param { yylexer_t* lexer } { yyenv_t env } { yynodeptr_t& yyroot }
+%lex-param { yylexer_t* lexer }
 
 %token T_DEF T_FROM
 %token T_MAP
@@ -54,12 +81,17 @@ void yyerror( YYLTYPE* yylloc, yyscan_t, yyenv_t, yynodeptr_t&, const char* ) {
 %token T_EXIT T_GLOBAL T_STATIC
 %token T_IMPORT T_RUN
 %token T_PEEK
-%token T_POKE T_MASK
+%token T_POKE T_MASK T_ATOMIC
+%token T_MEMDUMP T_MEMFILL T_MEMCOPY T_MEMLOAD T_MEMSAVE
 %token T_IF T_THEN T_ELSE T_ENDIF
 %token T_WHILE T_DO T_ENDWHILE
 %token T_FOR T_TO T_STEP T_ENDFOR
 %token T_PRINT T_DEC T_HEX T_BIN T_NEG T_FLOAT T_NOENDL
-%token T_SLEEP
+%token T_SLEEP T_FLUSH
+%token T_WAITFOR
+%token T_WAITIRQ T_IRQENABLE
+%token T_EVERY T_ENDEVERY
+%token T_SAMPLE
 %token T_BREAK T_QUIT
 %token T_PRAGMA T_WORDSIZE T_LOADPATH
 
@@ -74,6 +106,24 @@ void yyerror( YYLTYPE* yylloc, yyscan_t, yyenv_t, yynodeptr_t&, const char* ) {
 
 %token T_END_OF_STATEMENT
 
+%code {
+
+// contextual keywords need the token numbers, which are defined after the prologue
+static int yylex( yyvalue_t* yylval, YYLTYPE* yylloc, yylexer_t* lexer )
+{
+    int token = next_token( yylval, yylloc, lexer );
+
+    // atomic is only a keyword directly after poke and its size, elsewhere it is a name
+    if( token == T_IDENTIFIER && lexer->after_poke && yylval->value == "atomic" ) yylval->token = token = T_ATOMIC;
+
+    lexer->after_poke = token == T_POKE ||
+                        (lexer->after_poke && (token == T_8BIT || token == T_16BIT || token == T_32BIT || token == T_64BIT));
+
+    return token;
+}
+
+}
+
 %start start
 
 %%
@@ -81,15 +131,15 @@ void yyerror( YYLTYPE* yylloc, yyscan_t, yyenv_t, yynodeptr_t&, const char* ) {
 start : toplevel_block                                  { yyroot = $1.node; }
       ;
 
-toplevel_block : toplevel_statement                     { $$.node = make_shared<ASTNodeBlock>( @$ ); $$.node->add_child( $1.node ); }
+toplevel_block : toplevel_statement                     { $$.node = make_node<ASTNodeBlock>( @$ ); $$.node->add_child( $1.node ); }
                | toplevel_block toplevel_statement      { $$.node = $1.node; $$.node->add_child( $2.node ); }
                ;
 
-block : statement                                       { $$.node = make_shared<ASTNodeBlock>( @$ ); $$.node->add_child( $1.node ); }
+block : statement                                       { $$.node = make_node<ASTNodeBlock>( @$ ); $$.node->add_child( $1.node ); }
       | block statement                                 { $$.node = $1.node; $$.node->add_child( $2.node ); }
       ;
 
-subroutine_block :                                          { $$.node = make_shared<ASTNodeBlock>( @$ ); env->set_subroutine_body( $$.node ); }
+subroutine_block :                                          { $$.node = make_node<ASTNodeBlock>( @$ ); env->set_subroutine_body( $$.node ); }
                    subroutine_statement                     { $$.node = $1.node; $$.node->add_child( $2.node ); }
                  | subroutine_block subroutine_statement    { $$.node = $1.node; $$.node->add_child( $2.node ); }
                  ;
@@ -107,21 +157,32 @@ toplevel_statement : statement                          { $$.node = $1.node; }
 statement : %empty                                          { $$.node = nullptr; }
           | assign_stmt T_END_OF_STATEMENT                  { $$.node = $1.node; } 
           | poke_stmt T_END_OF_STATEMENT                    { $$.node = $1.node; }
+          | memblock_stmt T_END_OF_STATEMENT                { $$.node = $1.node; }
+          | sample_stmt T_END_OF_STATEMENT                  { $$.node = $1.node; }
           | print_stmt T_END_OF_STATEMENT                   { $$.node = $1.node; }
           | sleep_stmt T_END_OF_STATEMENT                   { $$.node = $1.node; }
-          | T_EXIT T_END_OF_STATEMENT                       { $$.node = make_shared<ASTNodeBreak>( @1, T_EXIT ); }
-          | T_BREAK T_END_OF_STATEMENT                      { $$.node = make_shared<ASTNodeBreak>( @1, T_BREAK ); }
-          | T_QUIT T_END_OF_STATEMENT                       { $$.node = make_shared<ASTNodeBreak>( @1, T_QUIT ); }
+          | waitfor_stmt T_END_OF_STATEMENT                 { $$.node = make_node<ASTNodeWaitfor>( @$, env, $1.nodelist ); }
+          | plain_identifier T_ASSIGN
+            waitfor_stmt T_END_OF_STATEMENT                 { $$.node = make_node<ASTNodeWaitfor>( @$, env, $1.value, $3.nodelist ); }
+          | waitirq_stmt T_END_OF_STATEMENT                 { $$.node = make_node<ASTNodeWaitirq>( @$, env, $1.valuelist, $1.node ); }
+          | plain_identifier T_ASSIGN
+            waitirq_stmt T_END_OF_STATEMENT                 { $$.node = make_node<ASTNodeWaitirq>( @$, env, $1.value, $3.valuelist, $3.node ); }
+          | irqenable_stmt T_END_OF_STATEMENT               { $$.node = $1.node; }
+          | T_EXIT T_END_OF_STATEMENT                       { $$.node = make_node<ASTNodeBreak>( @1, T_EXIT ); }
+          | T_BREAK T_END_OF_STATEMENT                      { $$.node = make_node<ASTNodeBreak>( @1, T_BREAK ); }
+          | T_QUIT T_END_OF_STATEMENT                       { $$.node = make_node<ASTNodeBreak>( @1, T_QUIT ); }
+          | T_FLUSH T_END_OF_STATEMENT                      { $$.node = make_node<ASTNodeFlush>( @1 ); }
           | if_block                                        { $$.node = $1.node; }
           | while_block                                     { $$.node = $1.node; }
           | for_block                                       { $$.node = $1.node; }
+          | every_block                                     { $$.node = $1.node; }
           | plain_identifier proc_params T_END_OF_STATEMENT { $$.node = env->get_procedure( @1, $1.value, $2.nodelist ); if( !$$.node ) throw ASTExceptionSyntaxError( @1 ); }
           ;
 
 subroutine_statement : statement                                    { $$.node = $1.node; }
                      | T_GLOBAL plain_identifier T_END_OF_STATEMENT { if( !env->alloc_global( $2.value ) ) throw ASTExceptionNamingConflict( @1, $2.value ); }
                      | T_STATIC plain_identifier
-                       T_ASSIGN expression T_END_OF_STATEMENT       { $$.node = make_shared<ASTNodeStatic>( @1, env, $2.value, $4.node ); }
+                       T_ASSIGN expression T_END_OF_STATEMENT       { $$.node = make_node<ASTNodeStatic>( @1, env, $2.value, $4.node ); }
                      ;
 
 proc_def : T_DEFPROC plain_identifier                   { env->enter_subroutine_context( @1, $2.value, false ); }
@@ -158,10 +219,10 @@ func_params : %empty
             | func_params ',' expression                { $$.nodelist = std::move( $1.nodelist ); $$.nodelist.push_back( $3.node ); }
             ;
 
-if_block : if_def statement                                             { $$.node = make_shared<ASTNodeIf>( @$, $1.node, $2.node ); }
-         | if_def statement else_def                                    { $$.node = make_shared<ASTNodeIf>( @$, $1.node, $2.node, $3.node ); }
-         | if_def T_END_OF_STATEMENT block T_ENDIF T_END_OF_STATEMENT   { $$.node = make_shared<ASTNodeIf>( @$, $1.node, $3.node ); }
-         | if_def T_END_OF_STATEMENT block else_def                     { $$.node = make_shared<ASTNodeIf>( @$, $1.node, $3.node, $4.node ); }
+if_block : if_def statement                                             { $$.node = make_node<ASTNodeIf>( @$, $1.node, $2.node ); }
+         | if_def statement else_def                                    { $$.node = make_node<ASTNodeIf>( @$, $1.node, $2.node, $3.node ); }
+         | if_def T_END_OF_STATEMENT block T_ENDIF T_END_OF_STATEMENT   { $$.node = make_node<ASTNodeIf>( @$, $1.node, $3.node ); }
+         | if_def T_END_OF_STATEMENT block else_def                     { $$.node = make_node<ASTNodeIf>( @$, $1.node, $3.node, $4.node ); }
          ;
 
 if_def : T_IF expression T_THEN                         { $$.node = $2.node; }
@@ -171,10 +232,10 @@ else_def : T_ELSE statement                                             { $$.nod
          | T_ELSE T_END_OF_STATEMENT block T_ENDIF T_END_OF_STATEMENT   { $$.node = $3.node; }
          ; 
 
-while_block : T_WHILE expression T_DO statement         { $$.node = make_shared<ASTNodeWhile>( @$, $2.node, $4.node ); }
+while_block : T_WHILE expression T_DO statement         { $$.node = make_node<ASTNodeWhile>( @$, $2.node, $4.node ); }
             | T_WHILE expression T_DO T_END_OF_STATEMENT
                   block
-              T_ENDWHILE T_END_OF_STATEMENT             { $$.node = make_shared<ASTNodeWhile>( @$, $2.node, $5.node ); }
+              T_ENDWHILE T_END_OF_STATEMENT             { $$.node = make_node<ASTNodeWhile>( @$, $2.node, $5.node ); }
             ;
 
 for_block : for_def statement                           { $$.node = $1.node; $$.node->add_child( $2.node ); }
@@ -183,19 +244,32 @@ for_block : for_def statement                           { $$.node = $1.node; $$.
             T_ENDFOR T_END_OF_STATEMENT                 { $$.node = $1.node; $$.node->add_child( $3.node ); }
           ;
 
-for_def : T_FOR plain_identifier T_FROM expression T_TO expression T_DO                     { $$.node = make_shared<ASTNodeFor>( @$, make_shared<ASTNodeAssign>( @2, env, $2.value, $4.node ), $6.node ); }
-        | T_FOR plain_identifier T_FROM expression T_TO expression T_STEP expression T_DO   { $$.node = make_shared<ASTNodeFor>( @$, make_shared<ASTNodeAssign>( @2, env, $2.value, $4.node ), $6.node, $8.node ); }
+for_def : T_FOR plain_identifier T_FROM expression T_TO expression T_DO                     { $$.node = make_node<ASTNodeFor>( @$, make_node<ASTNodeAssign>( @2, env, $2.value, $4.node ), $6.node ); }
+        | T_FOR plain_identifier T_FROM expression T_TO expression T_STEP expression T_DO   { $$.node = make_node<ASTNodeFor>( @$, make_node<ASTNodeAssign>( @2, env, $2.value, $4.node ), $6.node, $8.node ); }
         ;
 
-assign_stmt : plain_identifier T_ASSIGN expression      { $$.node = make_shared<ASTNodeAssign>( @$, env, $1.value, $3.node ); }
+every_block : every_def statement                       { $$.node = $1.node; $$.node->add_child( $2.node ); }
+            | every_def T_END_OF_STATEMENT
+                  block
+              T_ENDEVERY T_END_OF_STATEMENT             { $$.node = $1.node; $$.node->add_child( $3.node ); }
+            ;
+
+every_def : T_EVERY expression stats_name T_DO          { $$.node = make_node<ASTNodeEvery>( @$, env, $2.node, $3.value ); }
+          ;
+
+stats_name : %empty                                     { $$.value = ""; }
+           | T_IDENTIFIER plain_identifier              { expect_keyword( @1, $1, "stats" ); $$.value = $2.value; }
+           ;
 
-def_stmt : T_DEF plain_identifier expression                            { $$.node = make_shared<ASTNodeDef>( @$, env, $2.value, $3.node ); }
-         | T_DEF struct_identifier expression                           { $$.node = make_shared<ASTNodeDef>( @$, env, $2.value, $3.node ); }
-         | T_DEF plain_identifier expression T_FROM plain_identifier    { $$.node = make_shared<ASTNodeDef>( @$, env, $2.value, $3.node, $5.value ); }
+assign_stmt : plain_identifier T_ASSIGN expression      { $$.node = make_node<ASTNodeAssign>( @$, env, $1.value, $3.node ); }
+
+def_stmt : T_DEF plain_identifier expression                            { $$.node = make_node<ASTNodeDef>( @$, env, $2.value, $3.node ); }
+         | T_DEF struct_identifier expression                           { $$.node = make_node<ASTNodeDef>( @$, env, $2.value, $3.node ); }
+         | T_DEF plain_identifier expression T_FROM plain_identifier    { $$.node = make_node<ASTNodeDef>( @$, env, $2.value, $3.node, $5.value ); }
          ;
 
-map_stmt : T_MAP expression expression                  { $$.node = make_shared<ASTNodeMap>( @$, env, $2.node, $3.node ); }
-         | T_MAP expression expression T_STRING         { $$.node = make_shared<ASTNodeMap>( @$, env, $2.node, $3.node, $4.value.substr( 1, $4.value.length() - 2 ) ); }
+map_stmt : T_MAP expression expression                  { $$.node = make_node<ASTNodeMap>( @$, env, $2.node, $3.node ); }
+         | T_MAP expression expression T_STRING         { $$.node = make_node<ASTNodeMap>( @$, env, $2.node, $3.node, $4.value.substr( 1, $4.value.length() - 2 ) ); }
          ;
 
 pragma_stmt : T_PRAGMA T_PRINT print_float              { env->set_default_modifier( $3.token | ASTNodePrint::MOD_64BIT ); }
@@ -209,14 +283,39 @@ drop_stmt : T_DROP plain_identifier                     { if( !env->drop_procedu
           | T_DROP plain_identifier '(' ')'             { if( !env->drop_function( $2.value ) ) throw ASTExceptionNamingConflict( @1, $2.value ); }
           ;
 
-import_stmt : T_IMPORT T_STRING                         { $$.node = make_shared<ASTNodeImport>( @$, env, $2.value.substr( 1, $2.value.length() - 2 ), true ); }
-            | T_RUN T_STRING                            { $$.node = make_shared<ASTNodeImport>( @$, env, $2.value.substr( 1, $2.value.length() - 2 ), false ); }
+import_stmt : T_IMPORT T_STRING                         { $$.node = make_node<ASTNodeImport>( @$, env, $2.value.substr( 1, $2.value.length() - 2 ), true ); }
+            | T_RUN T_STRING                            { $$.node = make_node<ASTNodeImport>( @$, env, $2.value.substr( 1, $2.value.length() - 2 ), false ); }
             ;
 
-poke_stmt : poke_token expression expression                        { $$.node = make_shared<ASTNodePoke>( @$, env, $2.node, $3.node, $1.token ); }
-          | poke_token expression expression T_MASK expression      { $$.node = make_shared<ASTNodePoke>( @$, env, $2.node, $3.node, $5.node, $1.token ); }
+poke_stmt : poke_token expression expression                                { $$.node = ASTNodePoke::create( @$, env, $2.node, $3.node, $1.token, false ); }
+          | poke_token expression expression T_MASK expression              { $$.node = ASTNodePoke::create( @$, env, $2.node, $3.node, $5.node, $1.token, false ); }
+          | poke_token T_ATOMIC expression expression                       { $$.node = ASTNodePoke::create( @$, env, $3.node, $4.node, $1.token, true ); }
+          | poke_token T_ATOMIC expression expression T_MASK expression     { $$.node = ASTNodePoke::create( @$, env, $3.node, $4.node, $6.node, $1.token, true ); }
           ;
 
+memblock_stmt : T_MEMDUMP memblock_size expression expression                { $$.node = make_node<ASTNodeMemBlock>( @$, env, T_MEMDUMP, $2.token, $3.node, $4.node ); }
+              | T_MEMFILL memblock_size expression expression expression     { $$.node = make_node<ASTNodeMemBlock>( @$, env, T_MEMFILL, $2.token, $3.node, $4.node, $5.node ); }
+              | T_MEMCOPY memblock_size expression expression expression     { $$.node = make_node<ASTNodeMemBlock>( @$, env, T_MEMCOPY, $2.token, $3.node, $4.node, $5.node ); }
+              | T_MEMLOAD memblock_size expression expression T_STRING       { $$.node = make_node<ASTNodeMemBlock>( @$, env, T_MEMLOAD, $2.token, $3.node, $4.node, $5.value.substr( 1, $5.value.length() - 2 ) ); }
+              | T_MEMSAVE memblock_size expression expression T_STRING       { $$.node = make_node<ASTNodeMemBlock>( @$, env, T_MEMSAVE, $2.token, $3.node, $4.node, $5.value.substr( 1, $5.value.length() - 2 ) ); }
+              ;
+
+sample_stmt : sample_token sample_addrs T_EVERY expression T_FOR expression T_IDENTIFIER T_STRING stats_name
+                                                        { expect_keyword( @7, $7, "into" ); $$.node = make_node<ASTNodeSample>( @$, env, $1.token, $2.nodelist, $4.node, $6.node, $8.value.substr( 1, $8.value.length() - 2 ), $9.value ); }
+            ;
+
+sample_token : T_SAMPLE                                 { $$.token = Environment::get_default_size(); }
+             | T_SAMPLE size_suffix                     { $$.token = $2.token; }
+             ;
+
+sample_addrs : expression                               { $$.nodelist.push_back( $1.node ); }
+             | sample_addrs expression                  { $$.nodelist = std::move( $1.nodelist ); $$.nodelist.push_back( $2.node ); }
+             ;
+
+memblock_size : %empty                                  { $$.token = 0; }
+              | size_suffix                             { $$.token = $1.token; }
+              ;
+
 poke_token : T_POKE                                     { $$.token = Environment::get_default_size(); }
            | T_POKE size_suffix                         { $$.token = $2.token; }
            ;
@@ -227,16 +326,16 @@ size_suffix : T_8BIT                                    { $$.token = $1.token; }
             | T_64BIT                                   { $$.token = $1.token; }
             ;
 
-print_stmt : T_PRINT print_args                         { $$.node = $2.node; $$.node->add_child( make_shared<ASTNodePrint>( @$ ) ); }
+print_stmt : T_PRINT print_args                         { $$.node = $2.node; $$.node->add_child( make_node<ASTNodePrint>( @$ ) ); }
            | T_PRINT print_args T_NOENDL                { $$.node = $2.node; }
            ;
 
-print_args : %empty                                     { $$.node = make_shared<ASTNodeBlock>( @$ ); $$.token = env->get_default_modifier(); }
+print_args : %empty                                     { $$.node = make_node<ASTNodeBlock>( @$, true ); $$.token = env->get_default_modifier(); }
            | print_args print_float                     { $$.node = $1.node; $$.token = $2.token | ASTNodePrint::MOD_64BIT; }
            | print_args print_format                    { $$.node = $1.node; $$.token = $2.token | ASTNodePrint::MOD_WORDSIZE; }
            | print_args print_format print_size         { $$.node = $1.node; $$.token = $2.token | $3.token; }
-           | print_args expression                      { $$.node = $1.node; $$.token = $1.token; $$.node->add_child( make_shared<ASTNodePrint>( @2, $2.node, $$.token ) ); }
-           | print_args T_STRING                        { $$.node = $1.node; $$.token = $1.token; $$.node->add_child( make_shared<ASTNodePrint>( @2, $2.value.substr( 1, $2.value.length() - 2 ) ) ); }
+           | print_args expression                      { $$.node = $1.node; $$.token = $1.token; $$.node->add_child( make_node<ASTNodePrint>( @2, $2.node, $$.token ) ); }
+           | print_args T_STRING                        { $$.node = $1.node; $$.token = $1.token; $$.node->add_child( make_node<ASTNodePrint>( @2, $2.value.substr( 1, $2.value.length() - 2 ) ) ); }
            ;
 
 print_float : T_FLOAT                                   { $$.token = ASTNodePrint::MOD_FLOAT; }
@@ -254,61 +353,82 @@ print_size : T_8BIT                                     { $$.token = ASTNodePrin
            | T_64BIT                                    { $$.token = ASTNodePrint::MOD_64BIT; }
            ;
 
-sleep_stmt : T_SLEEP expression                         { $$.node = make_shared<ASTNodeSleep>( @$, $2.node ); }
+sleep_stmt : T_SLEEP expression                         { $$.node = make_node<ASTNodeSleep>( @$, $2.node ); }
            ;
 
-expression : expression T_LOG_OR and_expr               { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-           | expression T_LOG_XOR and_expr              { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
+waitfor_stmt : T_WAITFOR expression                     { $$.nodelist = { $2.node, nullptr, nullptr }; }
+             | T_WAITFOR expression T_IDENTIFIER expression
+                                                        { if( $3.value == "spin" ) $$.nodelist = { $2.node, nullptr, $4.node };
+                                                          else { expect_keyword( @3, $3, "timeout" ); $$.nodelist = { $2.node, $4.node, nullptr }; } }
+             | T_WAITFOR expression T_IDENTIFIER expression T_IDENTIFIER expression
+                                                        { expect_keyword( @3, $3, "timeout" ); expect_keyword( @5, $5, "spin" ); $$.nodelist = { $2.node, $4.node, $6.node }; }
+             ;
+
+waitirq_stmt : T_WAITIRQ irq_devices                   { $$.valuelist = std::move( $2.valuelist ); $$.node = nullptr; }
+             | T_WAITIRQ irq_devices T_IDENTIFIER expression
+                                                        { expect_keyword( @3, $3, "timeout" ); $$.valuelist = std::move( $2.valuelist ); $$.node = $4.node; }
+             ;
+
+irq_devices : T_STRING                                  { $$.valuelist.push_back( $1.value.substr( 1, $1.value.length() - 2 ) ); }
+            | irq_devices T_STRING                      { $$.valuelist = std::move( $1.valuelist ); $$.valuelist.push_back( $2.value.substr( 1, $2.value.length() - 2 ) ); }
+            ;
+
+irqenable_stmt : T_IRQENABLE T_STRING                   { $$.node = make_node<ASTNodeIrqEnable>( @$, env, $2.value.substr( 1, $2.value.length() - 2 ), nullptr ); }
+               | T_IRQENABLE T_STRING expression        { $$.node = make_node<ASTNodeIrqEnable>( @$, env, $2.value.substr( 1, $2.value.length() - 2 ), $3.node ); }
+               ;
+
+expression : expression T_LOG_OR and_expr               { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+           | expression T_LOG_XOR and_expr              { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
            | and_expr                                   { $$.node = $1.node; }
            ;
 
-and_expr : and_expr T_LOG_AND comp_expr                 { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
+and_expr : and_expr T_LOG_AND comp_expr                 { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
          | comp_expr                                    { $$.node = $1.node; }
          ;
 
-comp_expr : add_expr T_LT add_expr                      { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_GT add_expr                      { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_LE add_expr                      { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_GE add_expr                      { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_EQ add_expr                      { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_NE add_expr                      { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_SLT add_expr                     { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_SGT add_expr                     { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_SLE add_expr                     { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-          | add_expr T_SGE add_expr                     { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
+comp_expr : add_expr T_LT add_expr                      { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_GT add_expr                      { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_LE add_expr                      { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_GE add_expr                      { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_EQ add_expr                      { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_NE add_expr                      { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_SLT add_expr                     { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_SGT add_expr                     { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_SLE add_expr                     { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+          | add_expr T_SGE add_expr                     { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
           | add_expr                                    { $$.node = $1.node; }
           ;
 
-add_expr : add_expr T_PLUS mul_expr                     { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-         | add_expr T_MINUS mul_expr                    { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-         | add_expr T_BIT_OR mul_expr                   { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-         | add_expr T_BIT_XOR mul_expr                  { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
+add_expr : add_expr T_PLUS mul_expr                     { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+         | add_expr T_MINUS mul_expr                    { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+         | add_expr T_BIT_OR mul_expr                   { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+         | add_expr T_BIT_XOR mul_expr                  { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
          | mul_expr                                     { $$.node = $1.node; }
          ;
 
-mul_expr : mul_expr T_MUL shift_expr                    { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-         | mul_expr T_DIV shift_expr                    { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); }
-         | mul_expr T_MOD shift_expr                    { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); }
-         | mul_expr T_BIT_AND shift_expr                { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); }
+mul_expr : mul_expr T_MUL shift_expr                    { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+         | mul_expr T_DIV shift_expr                    { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); }
+         | mul_expr T_MOD shift_expr                    { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); }
+         | mul_expr T_BIT_AND shift_expr                { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); }
          | shift_expr                                   { $$.node = $1.node; }
          ; 
 
-shift_expr : shift_expr T_LSHIFT unary_expr             { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
-           | shift_expr T_RSHIFT unary_expr             { $$.node = make_shared<ASTNodeBinaryOperator>( @$, $1.node, $3.node, $2.token ); } 
+shift_expr : shift_expr T_LSHIFT unary_expr             { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
+           | shift_expr T_RSHIFT unary_expr             { $$.node = ASTNodeBinaryOperator::create( @$, $1.node, $3.node, $2.token ); } 
            | unary_expr                                 { $$.node = $1.node; }
            ;
 
-unary_expr : T_MINUS atomic_expr                        { $$.node = make_shared<ASTNodeUnaryOperator>( @$, $2.node, $1.token ); }
-           | T_BIT_NOT atomic_expr                      { $$.node = make_shared<ASTNodeUnaryOperator>( @$, $2.node, $1.token ); }
-           | T_LOG_NOT atomic_expr                      { $$.node = make_shared<ASTNodeUnaryOperator>( @$, $2.node, $1.token ); }
+unary_expr : T_MINUS atomic_expr                        { $$.node = ASTNodeUnaryOperator::create( @$, $2.node, $1.token ); }
+           | T_BIT_NOT atomic_expr                      { $$.node = ASTNodeUnaryOperator::create( @$, $2.node, $1.token ); }
+           | T_LOG_NOT atomic_expr                      { $$.node = ASTNodeUnaryOperator::create( @$, $2.node, $1.token ); }
            | atomic_expr                                { $$.node = $1.node; }
            ;
 
-atomic_expr : T_CONSTANT                                { $$.node = make_shared<ASTNodeConstant>( @$, $1.value ); }
-            | T_FCONST                                  { $$.node = make_shared<ASTNodeConstant>( @$, $1.value, true ); }
+atomic_expr : T_CONSTANT                                { $$.node = make_node<ASTNodeConstant>( @$, $1.value ); }
+            | T_FCONST                                  { $$.node = make_node<ASTNodeConstant>( @$, $1.value, true ); }
             | identifier                                { $$.node = $1.node; }
             | '(' expression ')'                        { $$.node = $2.node; }
-            | peek_token '(' expression ')'             { $$.node = make_shared<ASTNodePeek>( @$, env, $3.node, $1.token ); }
+            | peek_token '(' expression ')'             { $$.node = ASTNodePeek::create( @$, env, $3.node, $1.token ); }
             | plain_identifier '(' func_params ')'      { $$.node = env->get_function( @1, $1.value, $3.nodelist ); if( !$$.node ) throw ASTExceptionSyntaxError( @1 ); }
             ;
 
@@ -317,11 +437,11 @@ peek_token : T_PEEK                                     { $$.token = Environment
            ;
 
 identifier : index_identifier                           { $$.node = $1.node; }
-           | index_identifier size_suffix               { $$.node = make_shared<ASTNodeRestriction>( @$, $1.node, $2.token ); }
+           | index_identifier size_suffix               { $$.node = make_node<ASTNodeRestriction>( @$, $1.node, $2.token ); }
            ;
 
-index_identifier : base_identifier                      { $$.node = make_shared<ASTNodeVar>( @$, env, $1.value ); }
-                 | base_identifier '[' expression ']'   { $$.node = make_shared<ASTNodeVar>( @$, env, $1.value, $3.node ); }
+index_identifier : base_identifier                      { $$.node = make_node<ASTNodeVar>( @$, env, $1.value ); }
+                 | base_identifier '[' expression ']'   { $$.node = make_node<ASTNodeVar>( @$, env, $1.value, $3.node ); }
                  ;
 
 base_identifier : struct_identifier                     { $$.value = $1.value; }
@@ -0,0 +1,231 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "profiler.h"
+
+#include "mmap.h"
+
+#include <fstream>
+#include <algorithm>
+
+#include <stdio.h>
+#include <assert.h>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Profiler implementation
+//////////////////////////////////////////////////////////////////////////////
+
+Profiler::Profiler()
+{}
+
+Profiler::~Profiler()
+{
+    for( auto& child: m_Root.children ) delete_node( child.second );
+}
+
+Profiler::line_t* Profiler::get_line( const yylloc_t& location )
+{
+    const char* file = location.file ? location.file : "";
+
+    auto iter = m_Lines.find( make_pair( file, location.first_line ) );
+    if( iter != m_Lines.end() ) return &iter->second;
+
+    line_t& line = m_Lines[ make_pair( file, location.first_line ) ];
+    line = { file, location.first_line, 0, 0, 0, 0 };
+
+    return &line;
+}
+
+const std::string* Profiler::get_frame_name( std::string name )
+{
+    return &*m_FrameNames.insert( name ).first;
+}
+
+void Profiler::begin_run( const char* file )
+{
+    assert( m_Frames.empty() );
+
+    // commands are profiled in a frame of their own, scripts in the frame of their file
+    m_Node = get_child( &m_Root, get_frame_name( file && *file ? file : "command" ) );
+    m_Line = nullptr;
+    m_SliceStart = now();
+}
+
+void Profiler::end_run()
+{
+    // subroutines that were left by an exception or by termination
+    while( !m_Frames.empty() ) leave_subroutine();
+
+    close_slice( now() );
+
+    m_Node = nullptr;
+    m_Line = nullptr;
+}
+
+void Profiler::enter_line( line_t* line )
+{
+    close_slice( now() );
+
+    m_Line = line;
+    line->count++;
+}
+
+void Profiler::begin_memory_access()
+{
+    m_MemoryStart = now();
+}
+
+void Profiler::end_memory_access( MMap* mmap, bool is_poke )
+{
+    mapping_t& mapping = m_Mappings[ mmap ];
+
+    if( is_poke ) mapping.pokes++;
+    else mapping.peeks++;
+    mapping.ns += now() - m_MemoryStart;
+}
+
+void Profiler::enter_subroutine( const std::string* name )
+{
+    const uint64_t time = now();
+    close_slice( time );
+
+    m_Frames.push_back( { m_Node, m_Line, time, m_Line ? m_Line->self_ns : 0 } );
+    if( m_Line ) m_Line->active++;
+
+    m_Node = get_child( m_Node, name );
+    m_Line = nullptr;
+}
+
+void Profiler::leave_subroutine()
+{
+    assert( !m_Frames.empty() );
+
+    const uint64_t time = now();
+    close_slice( time );
+
+    frame_t& frame = m_Frames.back();
+
+    // the outermost call of a line is accounted only, the self time of the line in
+    // recursive calls is part of its self time already
+    if( frame.line && --frame.line->active == 0 ) {
+        frame.line->callee_ns += (time - frame.start) - (frame.line->self_ns - frame.line_self_ns);
+    }
+
+    m_Node = frame.node;
+    m_Line = frame.line;
+
+    m_Frames.pop_back();
+}
+
+bool Profiler::write( const std::string& file )
+{
+    bool ret = write_report( file );
+    return write_folded( file + ".folded" ) && ret;
+}
+
+Profiler::stack_node_t* Profiler::get_child( stack_node_t* node, const std::string* name )
+{
+    stack_node_t*& child = node->children[ name ];
+    if( !child ) child = new stack_node_t;
+
+    return child;
+}
+
+bool Profiler::write_report( const std::string& file )
+{
+    ofstream out( file );
+    if( !out ) return false;
+
+    vector< const line_t* > lines;
+    for( auto& line: m_Lines ) {
+        if( line.second.count > 0 ) lines.push_back( &line.second );
+    }
+
+    sort( lines.begin(), lines.end(), [] ( const line_t* a, const line_t* b ) {
+        return a->self_ns + a->callee_ns > b->self_ns + b->callee_ns;
+    } );
+
+    char buf[ 128 ];
+
+    out << "# lines sorted by total time, count is the number of statements executed on the line\n";
+    out << "# and the total time includes the subroutines called on the line\n";
+    out << "#        count     total ms      self ms  location\n";
+
+    for( const line_t* line: lines ) {
+        snprintf( buf, sizeof(buf), "%14llu %12.3f %12.3f  ", (unsigned long long)line->count,
+                  (line->self_ns + line->callee_ns) / 1e6, line->self_ns / 1e6 );
+        out << buf << (*line->file ? line->file : "command") << ':' << line->line << '\n';
+    }
+
+    if( !m_Mappings.empty() ) {
+        out << "\n# mappings\n";
+        out << "#        peeks        pokes      time ms  mapping\n";
+
+        for( auto& mapping: m_Mappings ) {
+            snprintf( buf, sizeof(buf), "%14llu %12llu %12.3f  0x%llx+0x%llx", (unsigned long long)mapping.second.peeks,
+                      (unsigned long long)mapping.second.pokes, mapping.second.ns / 1e6,
+                      (unsigned long long)(uintptr_t)mapping.first->get_base_address(),
+                      (unsigned long long)mapping.first->get_size() );
+            out << buf << '\n';
+        }
+    }
+
+    out.close();
+    return !out.fail();
+}
+
+bool Profiler::write_folded( const std::string& file )
+{
+    ofstream out( file );
+    if( !out ) return false;
+
+    for( auto& child: m_Root.children ) write_folded( out, child.second, *child.first );
+
+    out.close();
+    return !out.fail();
+}
+
+void Profiler::write_folded( std::ostream& out, const stack_node_t* node, const std::string& path )
+{
+    // one stack per line of a subroutine, the samples are microseconds
+    for( auto& line: node->self_ns ) {
+        const uint64_t us = line.second / 1000;
+        if( us == 0 ) continue;
+
+        out << path << ';' << (*line.first->file ? line.first->file : "command") << ':' << line.first->line
+            << ' ' << us << '\n';
+    }
+
+    for( auto& child: node->children ) write_folded( out, child.second, path + ';' + *child.first );
+}
+
+void Profiler::delete_node( stack_node_t* node )
+{
+    for( auto& child: node->children ) delete_node( child.second );
+    delete node;
+}
@@ -0,0 +1,156 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __profiler_h__
+#define __profiler_h__
+
+#include "mempeek_parser.h"
+
+#include <string>
+#include <ostream>
+#include <vector>
+#include <map>
+#include <set>
+#include <utility>
+
+#include <stdint.h>
+#include <time.h>
+
+class MMap;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Profiler
+//////////////////////////////////////////////////////////////////////////////
+
+// collects execution counts and wall time of script lines, subroutines and mappings.
+// The bytecode compiler emits the profiling instructions only when a profiler is set,
+// scripts that are not profiled execute the same code as before.
+//
+// The time between two line markers is the self time of the first line. Calls are
+// accounted to the calling line as well, recursive calls are counted once.
+
+class Profiler {
+public:
+    typedef struct {
+        const char* file;
+        int line;
+        uint64_t count;
+        uint64_t self_ns;
+        uint64_t callee_ns;
+        unsigned int active;
+    } line_t;
+
+    Profiler();
+    ~Profiler();
+
+    // interface for BytecodeCompiler, the returned records stay valid for the lifetime of the profiler
+    line_t* get_line( const yylloc_t& location );
+    const std::string* get_frame_name( std::string name );
+
+    // interface for BytecodeVM
+    void begin_run( const char* file );
+    void end_run();
+
+    void enter_line( line_t* line );
+    void enter_subroutine( const std::string* name );
+    void leave_subroutine();
+
+    void begin_memory_access();
+    void end_memory_access( MMap* mmap, bool is_poke );
+
+    // writes the report sorted by total time to file and the folded stacks to file.folded
+    bool write( const std::string& file );
+
+private:
+    typedef struct stack_node_t {
+        std::map< const std::string*, stack_node_t* > children;
+        std::map< line_t*, uint64_t > self_ns;
+    } stack_node_t;
+
+    typedef struct {
+        stack_node_t* node;
+        line_t* line;
+        uint64_t start;
+        uint64_t line_self_ns;
+    } frame_t;
+
+    typedef struct {
+        uint64_t peeks;
+        uint64_t pokes;
+        uint64_t ns;
+    } mapping_t;
+
+    static uint64_t now();
+
+    void close_slice( uint64_t time );
+    stack_node_t* get_child( stack_node_t* node, const std::string* name );
+
+    bool write_report( const std::string& file );
+    bool write_folded( const std::string& file );
+    void write_folded( std::ostream& out, const stack_node_t* node, const std::string& path );
+    void delete_node( stack_node_t* node );
+
+    std::map< std::pair< const char*, int >, line_t > m_Lines;
+    std::set< std::string > m_FrameNames;
+    std::map< MMap*, mapping_t > m_Mappings;
+
+    stack_node_t m_Root;
+    std::vector< frame_t > m_Frames;
+
+    stack_node_t* m_Node = nullptr;
+    line_t* m_Line = nullptr;
+    uint64_t m_SliceStart = 0;
+    uint64_t m_MemoryStart = 0;
+
+    Profiler( const Profiler& ) = delete;
+    Profiler& operator=( const Profiler& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Profiler inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t Profiler::now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+inline void Profiler::close_slice( uint64_t time )
+{
+    if( m_Line ) {
+        const uint64_t ns = time - m_SliceStart;
+        m_Line->self_ns += ns;
+        m_Node->self_ns[ m_Line ] += ns;
+    }
+
+    m_SliceStart = time;
+}
+
+
+#endif // __profiler_h__
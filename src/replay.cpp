@@ -0,0 +1,321 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+// replays memory access traces recorded with "mempeek -t <file>" against a backend and
+// compares traces. it does not link the interpreter, only the mapping backends.
+
+#include "trace.h"
+#include "mmap.h"
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <unistd.h>
+
+using namespace std;
+
+
+typedef struct {
+    uint64_t base;
+    uint64_t size;
+    MMap* mmap;
+} mapping_t;
+
+static const size_t MAX_REPORTED = 10;
+
+
+static void print_usage( const char* name )
+{
+    printf( "Usage: %s [options] trace\n"
+            "       %s -c trace1 trace2\n"
+            "\n"
+            "Options:\n"
+            "    -d <device> Replay against the mapping backend <device>, default is \"sim:\"\n"
+            "    -n <count>  Replay the trace <count> times\n"
+            "    -c          Compare two traces and report the accesses that differ\n"
+            "    -h          Print usage\n", name, name );
+}
+
+static const char* type_name( uint8_t type )
+{
+    switch( type ) {
+    case Trace::READ: return "peek";
+    case Trace::WRITE: return "poke";
+    case Trace::MODIFY: return "modify";
+    case Trace::MODIFY_ATOMIC: return "atomic";
+    default: return "?";
+    }
+}
+
+static string format_access( TraceReader& trace, const Trace::record_t& record )
+{
+    char buf[ 128 ];
+    const int digits = record.width * 2;
+
+    int len = snprintf( buf, sizeof(buf), "%s:%d 0x%llx %s 0x%0*llx", type_name( record.type ), record.width * 8,
+                        (unsigned long long)record.address, record.type == Trace::READ ? "->" : "<-", digits,
+                        (unsigned long long)record.value );
+
+    if( record.type == Trace::MODIFY || record.type == Trace::MODIFY_ATOMIC ) {
+        snprintf( buf + len, sizeof(buf) - len, " mask 0x%0*llx", digits, (unsigned long long)record.mask );
+    }
+
+    return trace.get_location( record ) + ": " + buf;
+}
+
+static double get_recorded_ms( TraceReader& trace )
+{
+    const size_t num = trace.get_num_records();
+    if( num == 0 ) return 0;
+
+    const Trace::record_t* records = trace.get_records();
+    return (records[ num - 1 ].time + records[ num - 1 ].duration - records[0].time) / 1e6;
+}
+
+static bool open_trace( TraceReader& trace, const char* file )
+{
+    if( trace.open( file ) ) return true;
+
+    fprintf( stderr, "cannot read trace %s\n", file );
+    return false;
+}
+
+// the accessed pages are merged to ranges, each one is mapped on its own
+static bool create_mappings( TraceReader& trace, const char* device, vector< mapping_t >& mappings )
+{
+    const uint64_t page_size = getpagesize();
+    const Trace::record_t* records = trace.get_records();
+
+    set< uint64_t > pages;
+    for( size_t i = 0; i < trace.get_num_records(); i++ ) {
+        pages.insert( records[i].address / page_size );
+        pages.insert( (records[i].address + records[i].width - 1) / page_size );
+    }
+
+    for( uint64_t page: pages ) {
+        if( !mappings.empty() && mappings.back().base + mappings.back().size == page * page_size ) mappings.back().size += page_size;
+        else mappings.push_back( { page * page_size, page_size, nullptr } );
+    }
+
+    for( mapping_t& mapping: mappings ) {
+        mapping.mmap = MMap::create( (void*)mapping.base, mapping.size, device );
+        if( !mapping.mmap ) {
+            fprintf( stderr, "cannot map 0x%llx+0x%llx on %s\n", (unsigned long long)mapping.base,
+                     (unsigned long long)mapping.size, device );
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static MMap* find_mapping( const vector< mapping_t >& mappings, uint64_t address )
+{
+    size_t lo = 0, hi = mappings.size();
+    while( hi - lo > 1 ) {
+        size_t mid = (lo + hi) / 2;
+        if( mappings[ mid ].base <= address ) lo = mid;
+        else hi = mid;
+    }
+
+    return mappings[ lo ].mmap;
+}
+
+template< typename T >
+static uint64_t replay_access( MMap* mmap, const Trace::record_t& record )
+{
+    void* addr = (void*)record.address;
+
+    switch( record.type ) {
+    case Trace::READ: return mmap->peek<T>( addr );
+    case Trace::WRITE: mmap->poke<T>( addr, record.value ); break;
+    case Trace::MODIFY: mmap->modify<T>( addr, record.value, record.mask ); break;
+    case Trace::MODIFY_ATOMIC: mmap->modify_atomic<T>( addr, record.value, record.mask ); break;
+    }
+
+    return record.value;
+}
+
+static int replay( const char* file, const char* device, unsigned long count )
+{
+    TraceReader trace;
+    if( !open_trace( trace, file ) ) return 2;
+
+    const size_t num = trace.get_num_records();
+    const Trace::record_t* records = trace.get_records();
+
+    printf( "%s: %llu accesses recorded in %.3f ms", file, (unsigned long long)num, get_recorded_ms( trace ) );
+    if( trace.get_num_dropped() ) printf( ", %llu accesses were not recorded", (unsigned long long)trace.get_num_dropped() );
+    printf( "\n" );
+
+    if( num == 0 ) return 0;
+
+    vector< mapping_t > mappings;
+    if( !create_mappings( trace, device, mappings ) ) return 2;
+
+    // the mappings are looked up before, the replay loop measures the accesses only
+    vector< MMap* > mmaps( num );
+    for( size_t i = 0; i < num; i++ ) mmaps[i] = find_mapping( mappings, records[i].address );
+
+    MMap::enable_signal_handler();
+
+    uint64_t num_reads = 0;
+    uint64_t num_mismatches = 0;
+    const uint64_t start = Trace::now();
+
+    for( unsigned long pass = 0; pass < count; pass++ ) {
+        for( size_t i = 0; i < num; i++ ) {
+            const Trace::record_t& record = records[i];
+            uint64_t value;
+
+            switch( record.width ) {
+            case 1: value = replay_access<uint8_t>( mmaps[i], record ); break;
+            case 2: value = replay_access<uint16_t>( mmaps[i], record ); break;
+            case 4: value = replay_access<uint32_t>( mmaps[i], record ); break;
+            default: value = replay_access<uint64_t>( mmaps[i], record ); break;
+            }
+
+            if( mmaps[i]->has_failed() ) {
+                fprintf( stderr, "bus error: %s\n", format_access( trace, record ).c_str() );
+                return 2;
+            }
+
+            // reads of the first pass are checked against the recorded values
+            if( pass == 0 && record.type == Trace::READ ) num_reads++;
+            if( pass == 0 && value != record.value ) {
+                if( num_mismatches++ < MAX_REPORTED ) {
+                    printf( "access %llu differs, read 0x%0*llx: %s\n", (unsigned long long)i, record.width * 2,
+                            (unsigned long long)value, format_access( trace, record ).c_str() );
+                }
+            }
+        }
+    }
+
+    const double ms = (Trace::now() - start) / 1e6;
+    const double total = (double)num * count;
+
+    printf( "replayed %.0f accesses on %s in %.3f ms, %.2f M accesses/s, %llu of %llu reads differ\n",
+            total, device, ms, ms > 0 ? total / ms / 1e3 : 0.0, (unsigned long long)num_mismatches,
+            (unsigned long long)num_reads );
+
+    for( mapping_t& mapping: mappings ) delete mapping.mmap;
+
+    return num_mismatches ? 1 : 0;
+}
+
+static bool is_same_access( const Trace::record_t& a, const Trace::record_t& b )
+{
+    return a.address == b.address && a.width == b.width && a.type == b.type && a.value == b.value && a.mask == b.mask;
+}
+
+static int compare( const char* file1, const char* file2 )
+{
+    TraceReader trace1, trace2;
+    if( !open_trace( trace1, file1 ) || !open_trace( trace2, file2 ) ) return 2;
+
+    const size_t num1 = trace1.get_num_records();
+    const size_t num2 = trace2.get_num_records();
+    const Trace::record_t* records1 = trace1.get_records();
+    const Trace::record_t* records2 = trace2.get_records();
+
+    printf( "%s: %llu accesses recorded in %.3f ms\n", file1, (unsigned long long)num1, get_recorded_ms( trace1 ) );
+    printf( "%s: %llu accesses recorded in %.3f ms\n", file2, (unsigned long long)num2, get_recorded_ms( trace2 ) );
+
+    // the accesses are compared in order, timing is not compared
+    const size_t num = num1 < num2 ? num1 : num2;
+    uint64_t num_different = 0;
+
+    for( size_t i = 0; i < num; i++ ) {
+        if( is_same_access( records1[i], records2[i] ) ) continue;
+
+        if( num_different++ < MAX_REPORTED ) {
+            printf( "access %llu differs:\n  %s\n  %s\n", (unsigned long long)i,
+                    format_access( trace1, records1[i] ).c_str(), format_access( trace2, records2[i] ).c_str() );
+        }
+    }
+
+    if( num1 != num2 ) {
+        const char* longer = num1 > num2 ? file1 : file2;
+        TraceReader& trace = num1 > num2 ? trace1 : trace2;
+        const Trace::record_t& record = (num1 > num2 ? records1 : records2)[ num ];
+
+        printf( "%s has %llu more accesses, starting with\n  %s\n", longer,
+                (unsigned long long)(num1 > num2 ? num1 - num2 : num2 - num1), format_access( trace, record ).c_str() );
+    }
+
+    if( num_different == 0 && num1 == num2 ) {
+        printf( "traces are identical\n" );
+        return 0;
+    }
+
+    printf( "%llu of %llu accesses differ\n", (unsigned long long)num_different, (unsigned long long)num );
+    return 1;
+}
+
+int main( int argc, char** argv )
+{
+    const char* device = "sim:";
+    unsigned long count = 1;
+    bool is_compare = false;
+    vector< const char* > files;
+
+    for( int i = 1; i < argc; i++ ) {
+        if( strcmp( argv[i], "-h" ) == 0 ) {
+            print_usage( argv[0] );
+            return 0;
+        }
+        else if( strcmp( argv[i], "-c" ) == 0 ) is_compare = true;
+        else if( strcmp( argv[i], "-d" ) == 0 || strcmp( argv[i], "-n" ) == 0 ) {
+            if( i + 1 >= argc ) {
+                fprintf( stderr, argv[i][1] == 'd' ? "missing device\n" : "missing count\n" );
+                return 2;
+            }
+
+            if( argv[i][1] == 'd' ) device = argv[++i];
+            else {
+                char* end;
+                count = strtoul( argv[++i], &end, 0 );
+                if( *end || count == 0 ) {
+                    fprintf( stderr, "invalid count\n" );
+                    return 2;
+                }
+            }
+        }
+        else files.push_back( argv[i] );
+    }
+
+    if( files.size() != (is_compare ? 2u : 1u) ) {
+        print_usage( argv[0] );
+        return 2;
+    }
+
+    if( is_compare ) return compare( files[0], files[1] );
+    else return replay( files[0], device, count );
+}
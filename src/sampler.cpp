@@ -0,0 +1,131 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "sampler.h"
+
+#include <algorithm>
+
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Sampler implementation
+//////////////////////////////////////////////////////////////////////////////
+
+Sampler::Sampler( const std::vector< uint64_t >& addresses, size_t width, uint64_t period )
+ : m_Addresses( addresses ),
+   m_Width( width ),
+   m_Period( period ),
+   m_RecordSize( sizeof(uint64_t) + addresses.size() * width ),
+   m_Ring( RING_RECORDS * m_RecordSize ),
+   m_Head( 0 ),
+   m_Tail( 0 ),
+   m_Stop( false ),
+   m_HasFailed( false )
+{
+}
+
+Sampler::~Sampler()
+{
+    stop();
+}
+
+bool Sampler::start( const std::string& file )
+{
+    m_File.open( file.c_str(), ios::out | ios::binary | ios::trunc );
+    if( !m_File ) return false;
+
+    struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t width;
+        uint32_t num_addresses;
+        uint32_t reserved;
+        uint64_t period;
+    } header;
+
+    memcpy( header.magic, "MPSAMPLE", sizeof(header.magic) );
+    header.version = 1;
+    header.width = m_Width;
+    header.num_addresses = m_Addresses.size();
+    header.reserved = 0;
+    header.period = m_Period;
+
+    m_File.write( (const char*)&header, sizeof(header) );
+    m_File.write( (const char*)m_Addresses.data(), m_Addresses.size() * sizeof(uint64_t) );
+    if( !m_File ) return false;
+
+    m_Writer = thread( &Sampler::writer, this );
+
+    return true;
+}
+
+bool Sampler::stop()
+{
+    if( m_Writer.joinable() ) {
+        m_Stop.store( true, memory_order_release );
+        m_Writer.join();
+    }
+
+    if( m_File.is_open() ) {
+        m_File.close();
+        if( m_File.fail() ) m_HasFailed = true;
+    }
+
+    return !m_HasFailed;
+}
+
+void Sampler::writer()
+{
+    uint64_t tail = m_Tail.load( memory_order_relaxed );
+
+    for(;;) {
+        // read the stop flag first, records committed before it was set are seen below
+        const bool stop = m_Stop.load( memory_order_acquire );
+        const uint64_t head = m_Head.load( memory_order_acquire );
+
+        if( head == tail ) {
+            if( stop ) break;
+            usleep( WRITER_IDLE );
+            continue;
+        }
+
+        // write everything up to the end of the ring in one chunk
+        const uint64_t index = tail % RING_RECORDS;
+        const uint64_t count = std::min( head - tail, RING_RECORDS - index );
+
+        // after a write error the records are still consumed to keep the producer running
+        if( !m_HasFailed ) {
+            m_File.write( (const char*)m_Ring.data() + index * m_RecordSize, count * m_RecordSize );
+            if( !m_File ) m_HasFailed = true;
+        }
+
+        tail += count;
+        m_Tail.store( tail, memory_order_release );
+    }
+}
@@ -0,0 +1,119 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __sampler_h__
+#define __sampler_h__
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <fstream>
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Sampler
+//////////////////////////////////////////////////////////////////////////////
+
+// single producer, single consumer ring of fixed size sample records. The interpreter thread
+// captures the records, a writer thread streams them to the file in large chunks.
+//
+// file format, all values in host byte order:
+//     header   char magic[8] = "MPSAMPLE", uint32_t version, uint32_t width in bytes,
+//              uint32_t number of addresses, uint32_t reserved, uint64_t period in ns
+//     address  uint64_t for each sampled address
+//     record   uint64_t time in ns since start, width bytes for each sampled address
+
+class Sampler {
+public:
+    Sampler( const std::vector< uint64_t >& addresses, size_t width, uint64_t period );
+    ~Sampler();
+
+    // opens the file and starts the writer thread
+    bool start( const std::string& file );
+
+    // stops the writer thread after all records are written, false on write errors
+    bool stop();
+
+    // producer side: get space for the next record, nullptr when the ring is full
+    uint8_t* alloc_record();
+    void commit_record();
+
+private:
+    enum { RING_RECORDS = 65536 };
+    static const unsigned int WRITER_IDLE = 1000;    // microseconds
+
+    void writer();
+
+    std::vector< uint64_t > m_Addresses;
+    size_t m_Width;
+    uint64_t m_Period;
+
+    size_t m_RecordSize;
+    std::vector< uint8_t > m_Ring;
+
+    // free running record counters, the producer owns m_Head, the consumer owns m_Tail
+    std::atomic< uint64_t > m_Head;
+    std::atomic< uint64_t > m_Tail;
+    uint64_t m_CachedTail = 0;
+
+    std::atomic< bool > m_Stop;
+    std::atomic< bool > m_HasFailed;
+
+    std::ofstream m_File;
+    std::thread m_Writer;
+
+    Sampler( const Sampler& ) = delete;
+    Sampler& operator=( const Sampler& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Sampler inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint8_t* Sampler::alloc_record()
+{
+    const uint64_t head = m_Head.load( std::memory_order_relaxed );
+
+    // the tail is reloaded only when the cached copy says the ring is full
+    if( head - m_CachedTail == RING_RECORDS ) {
+        m_CachedTail = m_Tail.load( std::memory_order_acquire );
+        if( head - m_CachedTail == RING_RECORDS ) return nullptr;
+    }
+
+    return m_Ring.data() + (head % RING_RECORDS) * m_RecordSize;
+}
+
+inline void Sampler::commit_record()
+{
+    m_Head.store( m_Head.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
+}
+
+
+#endif // __sampler_h__
@@ -0,0 +1,142 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "script_cache.h"
+#include "version.h"
+
+#include <vector>
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ScriptCache implementation
+//////////////////////////////////////////////////////////////////////////////
+
+static const char s_Magic[8] = { 'M', 'P', 'T', 'O', 'K', 'E', 'N', 'S' };
+
+
+ScriptCache::ScriptCache( std::string path )
+ : m_Path( path )
+{
+    if( m_Path.length() > 0 && m_Path.back() != '/' ) m_Path += '/';
+}
+
+bool ScriptCache::load( const std::string& key, yytokens_t& tokens )
+{
+    FILE* file = fopen( get_filename( key ).c_str(), "rb" );
+    if( !file ) return false;
+
+    vector< char > buffer;
+    char chunk[ 65536 ];
+    size_t len;
+    while( (len = fread( chunk, 1, sizeof(chunk), file )) > 0 ) buffer.insert( buffer.end(), chunk, chunk + len );
+    fclose( file );
+
+    const char* p = buffer.data();
+    const char* end = p + buffer.size();
+
+    auto get_u32 = [ &p, end ] ( uint32_t& value ) {
+        if( end - p < 4 ) return false;
+        memcpy( &value, p, 4 );
+        p += 4;
+        return true;
+    };
+
+    // header
+    if( end - p < (ptrdiff_t)sizeof(s_Magic) || memcmp( p, s_Magic, sizeof(s_Magic) ) != 0 ) return false;
+    p += sizeof(s_Magic);
+
+    string build_id = get_build_id();
+    uint32_t build_id_len;
+    if( !get_u32( build_id_len ) || build_id_len != build_id.length() ) return false;
+    if( (size_t)(end - p) < build_id_len || memcmp( p, build_id.c_str(), build_id_len ) != 0 ) return false;
+    p += build_id_len;
+
+    uint32_t num_tokens;
+    if( !get_u32( num_tokens ) ) return false;
+
+    // tokens
+    tokens.clear();
+    tokens.reserve( num_tokens );
+
+    for( uint32_t i = 0; i < num_tokens; i++ ) {
+        uint32_t token, line, value_len;
+        if( !get_u32( token ) || !get_u32( line ) || !get_u32( value_len ) ) return false;
+        if( (size_t)(end - p) < value_len ) return false;
+
+        tokens.push_back( { (int)token, (int)line, string( p, value_len ) } );
+        p += value_len;
+    }
+
+    return p == end;
+}
+
+void ScriptCache::store( const std::string& key, const yytokens_t& tokens )
+{
+    string buffer( s_Magic, sizeof(s_Magic) );
+
+    auto put_u32 = [ &buffer ] ( uint32_t value ) {
+        buffer.append( (const char*)&value, 4 );
+    };
+
+    string build_id = get_build_id();
+    put_u32( build_id.length() );
+    buffer += build_id;
+
+    put_u32( tokens.size() );
+    for( auto& token: tokens ) {
+        put_u32( token.token );
+        put_u32( token.line );
+        put_u32( token.value.length() );
+        buffer += token.value;
+    }
+
+    // written to a temporary file first, concurrent instances never see a partial file
+    string filename = get_filename( key );
+    string tmpname = filename + "." + to_string( getpid() );
+
+    FILE* file = fopen( tmpname.c_str(), "wb" );
+    if( !file ) return;
+
+    bool is_written = fwrite( buffer.data(), 1, buffer.length(), file ) == buffer.length();
+    if( fclose( file ) != 0 ) is_written = false;
+
+    if( !is_written || rename( tmpname.c_str(), filename.c_str() ) != 0 ) unlink( tmpname.c_str() );
+}
+
+std::string ScriptCache::get_filename( const std::string& key )
+{
+    return m_Path + key + ".tokens";
+}
+
+std::string ScriptCache::get_build_id()
+{
+    return string( RELEASE_VERSION ) + " " + BUILD_NO + " " + BUILD_DATE;
+}
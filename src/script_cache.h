@@ -0,0 +1,65 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __script_cache_h__
+#define __script_cache_h__
+
+#include "mempeek_parser.h"
+
+#include <string>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ScriptCache
+//////////////////////////////////////////////////////////////////////////////
+
+// directory of the token streams of scripts, keyed by the hash of the script content.
+// a cached script is parsed without running the scanner. the AST itself can not be
+// cached, its nodes refer to the vars, mappings and subroutines of the environment.
+//
+// file format, all values in host byte order:
+//     header   char magic[8] = "MPTOKENS", uint32_t length of the build id, build id,
+//              uint32_t number of tokens
+//     token    int32_t token, int32_t line, uint32_t length of the value, value
+//
+// a file written by another build of mempeek is a miss, the token numbers may differ.
+
+class ScriptCache {
+public:
+    ScriptCache( std::string path );
+
+    bool load( const std::string& key, yytokens_t& tokens );
+    void store( const std::string& key, const yytokens_t& tokens );
+
+private:
+    std::string get_filename( const std::string& key );
+
+    static std::string get_build_id();
+
+    std::string m_Path;
+};
+
+
+#endif // __script_cache_h__
@@ -0,0 +1,131 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "script_file.h"
+
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ScriptFile implementation
+//////////////////////////////////////////////////////////////////////////////
+
+ScriptFile::ScriptFile()
+ : m_Buffer( nullptr ),
+   m_Size( 0 ),
+   m_MappedSize( 0 )
+{}
+
+ScriptFile::~ScriptFile()
+{
+    if( m_MappedSize ) munmap( m_Buffer, m_MappedSize );
+    else free( m_Buffer );
+}
+
+bool ScriptFile::open( const std::string& filename )
+{
+    int fd = ::open( filename.c_str(), O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return false;
+
+    struct stat buf;
+    if( fstat( fd, &buf ) != 0 || S_ISDIR( buf.st_mode ) ) {
+        close( fd );
+        return false;
+    }
+
+    if( !S_ISREG( buf.st_mode ) || buf.st_size == 0 ) {
+        bool ret = read( fd );
+        close( fd );
+        return ret;
+    }
+
+    size_t pagesize = sysconf( _SC_PAGESIZE );
+    size_t size = buf.st_size;
+    size_t mapped_size = (size + 2 + pagesize - 1) / pagesize * pagesize;
+
+    // the anonymous mapping provides the zeroed bytes behind the end of the file
+    void* base = mmap( nullptr, mapped_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+    if( base == MAP_FAILED ) {
+        close( fd );
+        return false;
+    }
+
+    if( mmap( base, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0 ) == MAP_FAILED ) {
+        munmap( base, mapped_size );
+        bool ret = read( fd );
+        close( fd );
+        return ret;
+    }
+
+    close( fd );
+
+    m_Buffer = (char*)base;
+    m_Size = size;
+    m_MappedSize = mapped_size;
+
+    return true;
+}
+
+bool ScriptFile::read( int fd )
+{
+    size_t capacity = 65536;
+    char* buffer = (char*)malloc( capacity );
+    size_t size = 0;
+
+    for(;;) {
+        if( capacity - size <= 2 ) {
+            capacity *= 2;
+            buffer = (char*)realloc( buffer, capacity );
+        }
+
+        ssize_t len = ::read( fd, buffer + size, capacity - size - 2 );
+        if( len < 0 && errno == EINTR ) continue;
+        if( len < 0 ) {
+            free( buffer );
+            return false;
+        }
+        if( len == 0 ) break;
+
+        size += len;
+    }
+
+    buffer[ size ] = 0;
+    buffer[ size + 1 ] = 0;
+
+    m_Buffer = buffer;
+    m_Size = size;
+
+    return true;
+}
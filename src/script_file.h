@@ -0,0 +1,84 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __script_file_h__
+#define __script_file_h__
+
+#include <string>
+
+#include <stddef.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ScriptFile
+//////////////////////////////////////////////////////////////////////////////
+
+// content of a script, read once for hashing and for the scanner. regular files are
+// mapped privately on top of an anonymous mapping that is one page larger, so the two
+// NUL bytes yy_scan_buffer() requires follow the content without copying the file.
+// everything else is read into a heap buffer. the buffer is writable, the scanner
+// modifies it in place.
+
+class ScriptFile {
+public:
+    ScriptFile();
+    ~ScriptFile();
+
+    bool open( const std::string& filename );
+
+    // the content followed by two NUL bytes
+    char* get_buffer();
+
+    // size of the content without the NUL bytes
+    size_t get_size();
+
+private:
+    bool read( int fd );
+
+    char* m_Buffer;
+    size_t m_Size;
+    size_t m_MappedSize;
+
+    ScriptFile( const ScriptFile& ) = delete;
+    ScriptFile& operator=( const ScriptFile& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ScriptFile inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline char* ScriptFile::get_buffer()
+{
+    return m_Buffer;
+}
+
+inline size_t ScriptFile::get_size()
+{
+    return m_Size;
+}
+
+
+#endif // __script_file_h__
@@ -0,0 +1,263 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "server.h"
+#include "environment.h"
+#include "output.h"
+
+#include <iostream>
+#include <streambuf>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class FrameBuf
+//////////////////////////////////////////////////////////////////////////////
+
+// streambuf that sends everything written to it as frames of one type. when the
+// client went away the output is discarded and the running script is terminated.
+
+class FrameBuf : public std::streambuf {
+public:
+    FrameBuf( int fd, ServerProtocol::frame_t type );
+
+protected:
+    int_type overflow( int_type ch ) override;
+    std::streamsize xsputn( const char* s, std::streamsize n ) override;
+    int sync() override;
+
+private:
+    enum { BUFFER_SIZE = 8192 };
+
+    void send( const char* s, size_t n );
+
+    int m_Socket;
+    ServerProtocol::frame_t m_Type;
+    bool m_IsBroken;
+
+    char m_Buffer[ BUFFER_SIZE ];
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class FrameBuf implementation
+//////////////////////////////////////////////////////////////////////////////
+
+FrameBuf::FrameBuf( int fd, ServerProtocol::frame_t type )
+ : m_Socket( fd ),
+   m_Type( type ),
+   m_IsBroken( false )
+{
+    setp( m_Buffer, m_Buffer + BUFFER_SIZE );
+}
+
+FrameBuf::int_type FrameBuf::overflow( int_type ch )
+{
+    sync();
+
+    if( !traits_type::eq_int_type( ch, traits_type::eof() ) ) {
+        *pptr() = traits_type::to_char_type( ch );
+        pbump( 1 );
+    }
+
+    return traits_type::not_eof( ch );
+}
+
+std::streamsize FrameBuf::xsputn( const char* s, std::streamsize n )
+{
+    if( n > epptr() - pptr() ) {
+        sync();
+
+        // large chunks are sent without copying them
+        if( n >= BUFFER_SIZE ) {
+            send( s, n );
+            return n;
+        }
+    }
+
+    traits_type::copy( pptr(), s, n );
+    pbump( n );
+
+    return n;
+}
+
+int FrameBuf::sync()
+{
+    send( pbase(), pptr() - pbase() );
+    setp( m_Buffer, m_Buffer + BUFFER_SIZE );
+
+    // never fails, a bad stream state would outlive the request
+    return 0;
+}
+
+void FrameBuf::send( const char* s, size_t n )
+{
+    if( n == 0 || m_IsBroken ) return;
+
+    if( !ServerProtocol::send_frame( m_Socket, m_Type, s, n ) ) {
+        m_IsBroken = true;
+        Environment::set_terminate();
+    }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Server implementation
+//////////////////////////////////////////////////////////////////////////////
+
+volatile int Server::s_IsStopped = 0;
+
+
+Server::Server( std::string path )
+ : m_Path( path ),
+   m_Socket( -1 )
+{}
+
+Server::~Server()
+{
+    if( m_Socket >= 0 ) {
+        close( m_Socket );
+        unlink( m_Path.c_str() );
+    }
+}
+
+bool Server::listen()
+{
+    sockaddr_un addr;
+    memset( &addr, 0, sizeof(addr) );
+    addr.sun_family = AF_UNIX;
+
+    if( m_Path.length() >= sizeof(addr.sun_path) ) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy( addr.sun_path, m_Path.c_str() );
+
+    int fd = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 );
+    if( fd < 0 ) return false;
+
+    // a socket left behind by a server that was killed is replaced. only the owner may
+    // connect, the server has the same access to the hardware as its user.
+    struct stat buf;
+    if( lstat( m_Path.c_str(), &buf ) == 0 && S_ISSOCK( buf.st_mode ) ) unlink( m_Path.c_str() );
+
+    mode_t mask = umask( 0077 );
+    int ret = bind( fd, (sockaddr*)&addr, sizeof(addr) );
+    umask( mask );
+
+    if( ret != 0 || ::listen( fd, 16 ) != 0 ) {
+        int err = errno;
+        close( fd );
+        errno = err;
+        return false;
+    }
+
+    m_Socket = fd;
+    return true;
+}
+
+void Server::run( handler_t handler )
+{
+    s_IsStopped = 0;
+
+    while( !s_IsStopped ) {
+        set_signal_handlers( true );
+
+        int fd = accept4( m_Socket, nullptr, nullptr, SOCK_CLOEXEC );
+        if( fd < 0 ) continue;
+
+        serve( fd, handler );
+        close( fd );
+    }
+
+    set_signal_handlers( false );
+}
+
+void Server::serve( int fd, handler_t& handler )
+{
+    for(;;) {
+        ServerProtocol::frame_t type;
+        string request;
+
+        if( !ServerProtocol::recv_frame( fd, type, request ) ) return;
+        if( type != ServerProtocol::REQUEST_COMMAND && type != ServerProtocol::REQUEST_FILE ) return;
+
+        // the output of the request goes to the client, fully buffered
+        FrameBuf out_buf( fd, ServerProtocol::RESPONSE_STDOUT );
+        FrameBuf err_buf( fd, ServerProtocol::RESPONSE_STDERR );
+
+        Output::flush();
+        bool is_line_buffered = Output::is_line_buffered();
+        Output::set_line_buffered( false );
+
+        streambuf* cout_buf = cout.rdbuf( &out_buf );
+        streambuf* cerr_buf = cerr.rdbuf( &err_buf );
+
+        ServerProtocol::status_t status;
+        try {
+            status = handler( request, type == ServerProtocol::REQUEST_FILE );
+        }
+        catch( ... ) {
+            status = ServerProtocol::STATUS_ERROR;
+        }
+
+        Output::flush();
+        cerr.flush();
+
+        cout.rdbuf( cout_buf );
+        cerr.rdbuf( cerr_buf );
+        cout.clear();
+        cerr.clear();
+        Output::set_line_buffered( is_line_buffered );
+
+        set_signal_handlers( true );
+
+        if( !ServerProtocol::send_frame( fd, ServerProtocol::RESPONSE_EXIT, (const char*)&status, 1 ) ) return;
+        if( status == ServerProtocol::STATUS_QUIT ) return;
+    }
+}
+
+void Server::signal_handler( int )
+{
+    s_IsStopped = 1;
+}
+
+void Server::set_signal_handlers( bool is_enabled )
+{
+    // without SA_RESTART, so that waiting for a client or a request is interrupted
+    struct sigaction action;
+    memset( &action, 0, sizeof(action) );
+    action.sa_handler = is_enabled ? signal_handler : SIG_DFL;
+    sigemptyset( &action.sa_mask );
+
+    sigaction( SIGINT, &action, nullptr );
+    sigaction( SIGTERM, &action, nullptr );
+}
@@ -0,0 +1,174 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __server_h__
+#define __server_h__
+
+#include <string>
+#include <functional>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ServerProtocol
+//////////////////////////////////////////////////////////////////////////////
+
+// requests and responses are sent as frames of a one byte type and a four byte length
+// in host byte order, followed by the payload. each request is answered with any number
+// of output frames and a final exit frame that carries the one byte status.
+
+class ServerProtocol {
+public:
+    typedef enum : uint8_t {
+        REQUEST_COMMAND = 'c',
+        REQUEST_FILE = 'f',
+        RESPONSE_STDOUT = 'o',
+        RESPONSE_STDERR = 'e',
+        RESPONSE_EXIT = 'x'
+    } frame_t;
+
+    typedef enum : uint8_t {
+        STATUS_OK = 0,
+        STATUS_ERROR = 1,
+        STATUS_QUIT = 2
+    } status_t;
+
+    enum { MAX_FRAME_SIZE = 64 * 1024 * 1024 };
+
+    static bool send_frame( int fd, frame_t type, const char* data, size_t len );
+    static bool recv_frame( int fd, frame_t& type, std::string& data );
+
+private:
+    static bool send_all( int fd, const void* data, size_t len );
+    static bool recv_all( int fd, void* data, size_t len );
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Server
+//////////////////////////////////////////////////////////////////////////////
+
+// keeps one Environment with its mappings, definitions and imports alive and executes
+// the requests of one client after the other. cout and cerr are redirected to the
+// client while a request is handled.
+
+class Server {
+public:
+    typedef std::function< ServerProtocol::status_t( const std::string& request, bool is_file ) > handler_t;
+
+    Server( std::string path );
+    ~Server();
+
+    // creates the socket, false with errno set on failure
+    bool listen();
+
+    // serves clients until SIGINT or SIGTERM is received while waiting for a request
+    void run( handler_t handler );
+
+private:
+    void serve( int fd, handler_t& handler );
+
+    static void signal_handler( int );
+    static void set_signal_handlers( bool is_enabled );
+
+    std::string m_Path;
+    int m_Socket;
+
+    static volatile int s_IsStopped;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class ServerProtocol inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline bool ServerProtocol::send_frame( int fd, frame_t type, const char* data, size_t len )
+{
+    uint8_t header[5];
+    uint32_t len32 = len;
+
+    header[0] = type;
+    memcpy( header + 1, &len32, 4 );
+
+    return send_all( fd, header, sizeof(header) ) && send_all( fd, data, len );
+}
+
+inline bool ServerProtocol::recv_frame( int fd, frame_t& type, std::string& data )
+{
+    uint8_t header[5];
+    uint32_t len;
+
+    if( !recv_all( fd, header, sizeof(header) ) ) return false;
+    memcpy( &len, header + 1, 4 );
+    if( len > MAX_FRAME_SIZE ) return false;
+
+    type = (frame_t)header[0];
+    data.resize( len );
+
+    return len == 0 || recv_all( fd, &data[0], len );
+}
+
+inline bool ServerProtocol::send_all( int fd, const void* data, size_t len )
+{
+    const char* p = (const char*)data;
+
+    while( len > 0 ) {
+        // MSG_NOSIGNAL, a client that went away must not kill the server
+        ssize_t ret = send( fd, p, len, MSG_NOSIGNAL );
+        if( ret < 0 ) {
+            if( errno == EINTR ) continue;
+            return false;
+        }
+        p += ret;
+        len -= ret;
+    }
+
+    return true;
+}
+
+inline bool ServerProtocol::recv_all( int fd, void* data, size_t len )
+{
+    char* p = (char*)data;
+
+    while( len > 0 ) {
+        // EINTR is not retried, a signal stops waiting for the peer
+        ssize_t ret = recv( fd, p, len, 0 );
+        if( ret <= 0 ) return false;
+        p += ret;
+        len -= ret;
+    }
+
+    return true;
+}
+
+
+#endif // __server_h__
@@ -39,6 +39,8 @@ template< typename CharT, typename Traits = std::char_traits< CharT > >
 class basic_teebuf : public std::basic_streambuf< CharT, Traits >
 {
 public:
+    basic_teebuf();
+
     void attach( std::basic_streambuf< CharT, Traits >* buf );
     void detach( std::basic_streambuf< CharT, Traits >* buf );
 
@@ -46,9 +48,17 @@ protected:
     using typename std::basic_streambuf< CharT, Traits >::int_type;
 
     int_type overflow( int_type ch ) override;
+    std::streamsize xsputn( const CharT* s, std::streamsize n ) override;
     int sync() override;
 
 private:
+    // output is collected in m_Buffer and forwarded to the attached buffers in whole chunks
+    enum { BUFFER_SIZE = 8192 };
+
+    bool flush_buffer();
+    bool fan_out( const CharT* s, std::streamsize n );
+
+    CharT m_Buffer[ BUFFER_SIZE ];
     std::vector< std::basic_streambuf< CharT, Traits >* > m_AttachedBuffers;
 };
 
@@ -76,15 +86,26 @@ private:
 // class basic_teebuf template functions
 //////////////////////////////////////////////////////////////////////////////
 
+template< typename CharT, typename Traits >
+inline basic_teebuf< CharT, Traits >::basic_teebuf()
+{
+    this->setp( m_Buffer, m_Buffer + BUFFER_SIZE );
+}
+
 template< typename CharT, typename Traits >
 inline void basic_teebuf< CharT, Traits >::attach( std::basic_streambuf< CharT, Traits >* buf )
 {
+    flush_buffer();
     m_AttachedBuffers.push_back( buf );
 }
 
 template< typename CharT, typename Traits >
 inline void basic_teebuf< CharT, Traits >::detach( std::basic_streambuf< CharT, Traits >* buf )
 {
+    // pending output still belongs to the buffer that is detached
+    flush_buffer();
+    buf->pubsync();
+
     size_t num_buffers = m_AttachedBuffers.size();
 
     for( size_t i = 0; i < num_buffers; ) {
@@ -99,19 +120,36 @@ inline void basic_teebuf< CharT, Traits >::detach( std::basic_streambuf< CharT,
 template< typename CharT, typename Traits >
 inline typename basic_teebuf< CharT, Traits >::int_type basic_teebuf< CharT, Traits >::overflow( int_type ch )
 {
-    int_type ret = Traits::eof() - 1;
+    if( !flush_buffer() ) return Traits::eof();
 
-    for( auto buf: m_AttachedBuffers ) {
-        if( buf->sputc( ch ) == Traits::eof() ) ret = Traits::eof();
+    if( !Traits::eq_int_type( ch, Traits::eof() ) ) {
+        *this->pptr() = Traits::to_char_type( ch );
+        this->pbump( 1 );
     }
 
-    return ret;
+    return Traits::not_eof( ch );
+}
+
+template< typename CharT, typename Traits >
+inline std::streamsize basic_teebuf< CharT, Traits >::xsputn( const CharT* s, std::streamsize n )
+{
+    if( n > this->epptr() - this->pptr() ) {
+        if( !flush_buffer() ) return 0;
+
+        // large chunks are forwarded without copying them
+        if( n >= BUFFER_SIZE ) return fan_out( s, n ) ? n : 0;
+    }
+
+    Traits::copy( this->pptr(), s, n );
+    this->pbump( n );
+
+    return n;
 }
 
 template< typename CharT, typename Traits >
 inline int basic_teebuf< CharT, Traits >::sync()
 {
-    int ret = 0;
+    int ret = flush_buffer() ? 0 : -1;
 
     for( auto buf: m_AttachedBuffers ) {
         if( buf->pubsync() != 0 ) ret = -1;
@@ -120,6 +158,29 @@ inline int basic_teebuf< CharT, Traits >::sync()
     return ret;
 }
 
+template< typename CharT, typename Traits >
+inline bool basic_teebuf< CharT, Traits >::flush_buffer()
+{
+    bool ret = fan_out( this->pbase(), this->pptr() - this->pbase() );
+    this->setp( m_Buffer, m_Buffer + BUFFER_SIZE );
+
+    return ret;
+}
+
+template< typename CharT, typename Traits >
+inline bool basic_teebuf< CharT, Traits >::fan_out( const CharT* s, std::streamsize n )
+{
+    bool ret = true;
+
+    if( n == 0 ) return ret;
+
+    for( auto buf: m_AttachedBuffers ) {
+        if( buf->sputn( s, n ) != n ) ret = false;
+    }
+
+    return ret;
+}
+
 
 //////////////////////////////////////////////////////////////////////////////
 // class basic_teestream template functions
@@ -0,0 +1,216 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "trace.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <string.h>
+#include <errno.h>
+
+using namespace std;
+
+static_assert( sizeof(Trace::record_t) == 48, "trace records have a fixed size" );
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Trace implementation
+//////////////////////////////////////////////////////////////////////////////
+
+const char Trace::MAGIC[8] = { 'M', 'P', 'T', 'R', 'A', 'C', 'E', 0 };
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class TraceRecorder implementation
+//////////////////////////////////////////////////////////////////////////////
+
+TraceRecorder* TraceRecorder::s_Active = nullptr;
+
+
+TraceRecorder::TraceRecorder()
+{}
+
+TraceRecorder::~TraceRecorder()
+{
+    close();
+}
+
+bool TraceRecorder::create( const std::string& file, size_t capacity )
+{
+    close();
+
+    m_File = open( file.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644 );
+    if( m_File < 0 ) return false;
+
+    // the space is allocated up front, a full disk must not raise SIGBUS while recording
+    m_MappingSize = sizeof(Trace::header_t) + capacity * sizeof(Trace::record_t);
+    int err = posix_fallocate( m_File, 0, m_MappingSize );
+    if( err == 0 ) {
+        m_Mapping = mmap( nullptr, m_MappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, m_File, 0 );
+        if( m_Mapping == MAP_FAILED ) {
+            err = errno;
+            m_Mapping = nullptr;
+        }
+    }
+
+    if( err ) {
+        ::close( m_File );
+        m_File = -1;
+        unlink( file.c_str() );
+        errno = err;
+        return false;
+    }
+
+    Trace::header_t* header = (Trace::header_t*)m_Mapping;
+    memset( header, 0, sizeof(Trace::header_t) );
+    memcpy( header->magic, Trace::MAGIC, sizeof(header->magic) );
+    header->version = Trace::VERSION;
+    header->record_size = sizeof(Trace::record_t);
+
+    m_Next = (Trace::record_t*)(header + 1);
+    m_End = m_Next + capacity;
+    m_NumDropped = 0;
+    m_Start = Trace::now();
+
+    m_FileIndex.clear();
+    m_Files.clear();
+    m_LastFile = nullptr;
+    m_LastIndex = 0;
+
+    return true;
+}
+
+bool TraceRecorder::close()
+{
+    if( m_File < 0 ) return true;
+    if( s_Active == this ) s_Active = nullptr;
+
+    Trace::header_t* header = (Trace::header_t*)m_Mapping;
+    const Trace::record_t* records = (const Trace::record_t*)(header + 1);
+
+    const off_t files_offset = (const char*)m_Next - (const char*)m_Mapping;
+
+    header->num_records = m_Next - records;
+    header->num_dropped = m_NumDropped;
+    header->files_offset = files_offset;
+    header->num_files = m_Files.size();
+
+    munmap( m_Mapping, m_MappingSize );
+    m_Mapping = nullptr;
+
+    // the unused records are cut off and replaced by the file names
+    bool ret = ftruncate( m_File, files_offset ) == 0 && lseek( m_File, 0, SEEK_END ) >= 0;
+    for( const string& file: m_Files ) {
+        if( ret ) ret = write( m_File, file.c_str(), file.length() + 1 ) == (ssize_t)(file.length() + 1);
+    }
+
+    if( ::close( m_File ) != 0 ) ret = false;
+    m_File = -1;
+
+    return ret;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class TraceReader implementation
+//////////////////////////////////////////////////////////////////////////////
+
+TraceReader::TraceReader()
+{}
+
+TraceReader::~TraceReader()
+{
+    if( m_Mapping ) munmap( m_Mapping, m_MappingSize );
+}
+
+bool TraceReader::open( const std::string& file )
+{
+    int fd = ::open( file.c_str(), O_RDONLY | O_CLOEXEC );
+    if( fd < 0 ) return false;
+
+    struct stat buf;
+    if( fstat( fd, &buf ) != 0 || (size_t)buf.st_size < sizeof(Trace::header_t) ) {
+        ::close( fd );
+        return false;
+    }
+
+    m_MappingSize = buf.st_size;
+    m_Mapping = mmap( nullptr, m_MappingSize, PROT_READ, MAP_PRIVATE, fd, 0 );
+    ::close( fd );
+
+    if( m_Mapping == MAP_FAILED ) {
+        m_Mapping = nullptr;
+        return false;
+    }
+
+    const Trace::header_t* header = (const Trace::header_t*)m_Mapping;
+
+    // a trace that was not closed has no counts and is rejected
+    if( memcmp( header->magic, Trace::MAGIC, sizeof(header->magic) ) != 0 ||
+        header->version != Trace::VERSION || header->record_size != sizeof(Trace::record_t) ||
+        header->files_offset != sizeof(Trace::header_t) + header->num_records * sizeof(Trace::record_t) ||
+        header->files_offset > m_MappingSize ) return false;
+
+    const char* names = (const char*)m_Mapping + header->files_offset;
+    const char* end = (const char*)m_Mapping + m_MappingSize;
+
+    for( uint64_t i = 0; i < header->num_files; i++ ) {
+        const char* name_end = (const char*)memchr( names, 0, end - names );
+        if( !name_end ) return false;
+
+        m_Files.push_back( names );
+        names = name_end + 1;
+    }
+
+    m_Header = header;
+    return true;
+}
+
+size_t TraceReader::get_num_records()
+{
+    return m_Header ? m_Header->num_records : 0;
+}
+
+uint64_t TraceReader::get_num_dropped()
+{
+    return m_Header ? m_Header->num_dropped : 0;
+}
+
+const Trace::record_t* TraceReader::get_records()
+{
+    return (const Trace::record_t*)(m_Header + 1);
+}
+
+std::string TraceReader::get_location( const Trace::record_t& record )
+{
+    string file = record.file < m_Files.size() ? m_Files[ record.file ] : "?";
+    if( file.empty() ) file = "command";
+
+    return file + ':' + to_string( record.line );
+}
@@ -0,0 +1,247 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __trace_h__
+#define __trace_h__
+
+#include "mempeek_parser.h"
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Trace
+//////////////////////////////////////////////////////////////////////////////
+
+// file format of memory access traces, all values in host byte order:
+//     header   see header_t, the counts are written when the trace is closed
+//     record   record_t for each access in the order of execution
+//     files    NUL terminated source file names, record_t::file is the index
+
+class Trace {
+public:
+    typedef enum : uint8_t {
+        READ,
+        WRITE,
+        MODIFY,
+        MODIFY_ATOMIC
+    } type_t;
+
+    typedef struct {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint64_t num_records;
+        uint64_t num_dropped;
+        uint64_t files_offset;
+        uint64_t num_files;
+    } header_t;
+
+    typedef struct {
+        uint64_t time;          // ns since the start of the trace
+        uint64_t address;
+        uint64_t value;         // value read or written
+        uint64_t mask;          // bits written, all ones for reads and plain writes
+        uint32_t duration;      // ns
+        uint32_t line;
+        uint16_t file;
+        uint8_t width;          // bytes
+        uint8_t type;           // type_t
+        uint32_t reserved;
+    } record_t;
+
+    enum { VERSION = 1 };
+
+    static const char MAGIC[8];
+
+    static uint64_t now();
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class TraceRecorder
+//////////////////////////////////////////////////////////////////////////////
+
+// writes the accesses of peek and poke into a preallocated file that is mapped into memory.
+// Recording an access takes a record from the mapping by incrementing a pointer, accesses
+// that do not fit any more are counted as dropped.
+
+class TraceRecorder {
+public:
+    TraceRecorder();
+    ~TraceRecorder();
+
+    // creates the file with space for capacity records
+    bool create( const std::string& file, size_t capacity );
+
+    // writes the counts and the file names and truncates the file to its content
+    bool close();
+
+    uint64_t get_num_dropped();
+
+    // accesses are recorded by the active recorder, nullptr stops recording
+    static void set_active( TraceRecorder* recorder );
+
+    // start time of an access, 0 when no recorder is active
+    static uint64_t start();
+    static void record( uint64_t start, const yylloc_t& location, uint64_t address, size_t width,
+                        uint64_t value, uint64_t mask, Trace::type_t type );
+
+private:
+    uint16_t get_file_index( const char* file );
+
+    int m_File = -1;
+    void* m_Mapping = nullptr;
+    size_t m_MappingSize = 0;
+
+    Trace::record_t* m_Next = nullptr;
+    Trace::record_t* m_End = nullptr;
+    uint64_t m_NumDropped = 0;
+    uint64_t m_Start = 0;
+
+    // file names are interned by the environment, the last one is looked up without the map
+    std::map< const char*, uint16_t > m_FileIndex;
+    std::vector< std::string > m_Files;
+    const char* m_LastFile = nullptr;
+    uint16_t m_LastIndex = 0;
+
+    static TraceRecorder* s_Active;
+
+    TraceRecorder( const TraceRecorder& ) = delete;
+    TraceRecorder& operator=( const TraceRecorder& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class TraceReader
+//////////////////////////////////////////////////////////////////////////////
+
+class TraceReader {
+public:
+    TraceReader();
+    ~TraceReader();
+
+    // maps the trace file, false when it cannot be read or is no trace
+    bool open( const std::string& file );
+
+    size_t get_num_records();
+    uint64_t get_num_dropped();
+    const Trace::record_t* get_records();
+
+    // "file:line" of a record
+    std::string get_location( const Trace::record_t& record );
+
+private:
+    void* m_Mapping = nullptr;
+    size_t m_MappingSize = 0;
+
+    const Trace::header_t* m_Header = nullptr;
+    std::vector< std::string > m_Files;
+
+    TraceReader( const TraceReader& ) = delete;
+    TraceReader& operator=( const TraceReader& ) = delete;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class Trace inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t Trace::now()
+{
+    struct timespec ts;
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class TraceRecorder inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t TraceRecorder::get_num_dropped()
+{
+    return m_NumDropped;
+}
+
+inline void TraceRecorder::set_active( TraceRecorder* recorder )
+{
+    s_Active = recorder;
+}
+
+inline uint64_t TraceRecorder::start()
+{
+    return s_Active ? Trace::now() : 0;
+}
+
+inline void TraceRecorder::record( uint64_t start, const yylloc_t& location, uint64_t address, size_t width,
+                                   uint64_t value, uint64_t mask, Trace::type_t type )
+{
+    const uint64_t end = Trace::now();
+
+    TraceRecorder* recorder = s_Active;
+    if( recorder->m_Next == recorder->m_End ) {
+        recorder->m_NumDropped++;
+        return;
+    }
+
+    Trace::record_t* record = recorder->m_Next++;
+
+    record->time = start - recorder->m_Start;
+    record->address = address;
+    record->value = value;
+    record->mask = mask;
+    record->duration = end - start;
+    record->line = location.first_line;
+    record->file = recorder->get_file_index( location.file );
+    record->width = width;
+    record->type = type;
+    record->reserved = 0;
+}
+
+inline uint16_t TraceRecorder::get_file_index( const char* file )
+{
+    if( file == m_LastFile ) return m_LastIndex;
+
+    auto iter = m_FileIndex.find( file );
+    if( iter != m_FileIndex.end() ) m_LastIndex = iter->second;
+    else {
+        m_LastIndex = m_Files.size();
+        m_Files.push_back( file ? file : "" );
+        m_FileIndex[ file ] = m_LastIndex;
+    }
+
+    m_LastFile = file;
+    return m_LastIndex;
+}
+
+
+#endif // __trace_h__
@@ -0,0 +1,90 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include "xxhash64.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class XXHash64 implementation
+//////////////////////////////////////////////////////////////////////////////
+
+uint64_t XXHash64::hash( const void* data, size_t size, uint64_t seed )
+{
+    const uint8_t* p = (const uint8_t*)data;
+    const uint8_t* end = p + size;
+    uint64_t h;
+
+    if( size >= 32 ) {
+        // four lanes over 32 byte stripes
+        uint64_t v1 = seed + PRIME1 + PRIME2;
+        uint64_t v2 = seed + PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME1;
+
+        const uint8_t* limit = end - 32;
+        do {
+            v1 = round( v1, read64( p ) );
+            v2 = round( v2, read64( p + 8 ) );
+            v3 = round( v3, read64( p + 16 ) );
+            v4 = round( v4, read64( p + 24 ) );
+            p += 32;
+        } while( p <= limit );
+
+        h = rotl( v1, 1 ) + rotl( v2, 7 ) + rotl( v3, 12 ) + rotl( v4, 18 );
+        h = merge_round( h, v1 );
+        h = merge_round( h, v2 );
+        h = merge_round( h, v3 );
+        h = merge_round( h, v4 );
+    }
+    else h = seed + PRIME5;
+
+    h += size;
+
+    // remaining bytes
+    for( ; p + 8 <= end; p += 8 ) {
+        h ^= round( 0, read64( p ) );
+        h = rotl( h, 27 ) * PRIME1 + PRIME4;
+    }
+
+    if( p + 4 <= end ) {
+        h ^= (uint64_t)read32( p ) * PRIME1;
+        h = rotl( h, 23 ) * PRIME2 + PRIME3;
+        p += 4;
+    }
+
+    for( ; p < end; p++ ) {
+        h ^= *p * PRIME5;
+        h = rotl( h, 11 ) * PRIME1;
+    }
+
+    // avalanche
+    h ^= h >> 33;
+    h *= PRIME2;
+    h ^= h >> 29;
+    h *= PRIME3;
+    h ^= h >> 32;
+
+    return h;
+}
@@ -0,0 +1,96 @@
+/*  Copyright (c) 2016, Martin Hammel
+    All rights reserved.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are met:
+
+    * Redistributions of source code must retain the above copyright notice, this
+      list of conditions and the following disclaimer.
+
+    * Redistributions in binary form must reproduce the above copyright notice,
+      this list of conditions and the following disclaimer in the documentation
+      and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+    AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+    DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+    FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+    DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+    SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+    CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+    OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef __xxhash64_h__
+#define __xxhash64_h__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class XXHash64
+//////////////////////////////////////////////////////////////////////////////
+
+// non-cryptographic 64 bit hash of the xxHash family, an order of magnitude faster
+// than MD5. used as an alternative key for imported files.
+
+class XXHash64 {
+public:
+    static uint64_t hash( const void* data, size_t size, uint64_t seed = 0 );
+
+private:
+    static uint64_t rotl( uint64_t value, int bits );
+    static uint64_t round( uint64_t acc, uint64_t input );
+    static uint64_t merge_round( uint64_t acc, uint64_t value );
+
+    static uint64_t read64( const uint8_t* p );
+    static uint32_t read32( const uint8_t* p );
+
+    static const uint64_t PRIME1 = 0x9e3779b185ebca87ULL;
+    static const uint64_t PRIME2 = 0xc2b2ae3d27d4eb4fULL;
+    static const uint64_t PRIME3 = 0x165667b19e3779f9ULL;
+    static const uint64_t PRIME4 = 0x85ebca77c2b2ae63ULL;
+    static const uint64_t PRIME5 = 0x27d4eb2f165667c5ULL;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// class XXHash64 inline functions
+//////////////////////////////////////////////////////////////////////////////
+
+inline uint64_t XXHash64::rotl( uint64_t value, int bits )
+{
+    return (value << bits) | (value >> (64 - bits));
+}
+
+inline uint64_t XXHash64::round( uint64_t acc, uint64_t input )
+{
+    acc += input * PRIME2;
+    acc = rotl( acc, 31 );
+    return acc * PRIME1;
+}
+
+inline uint64_t XXHash64::merge_round( uint64_t acc, uint64_t value )
+{
+    acc ^= round( 0, value );
+    return acc * PRIME1 + PRIME4;
+}
+
+inline uint64_t XXHash64::read64( const uint8_t* p )
+{
+    // the hash is defined on little endian words
+    uint64_t value = 0;
+    for( int i = 7; i >= 0; i-- ) value = (value << 8) | p[i];
+    return value;
+}
+
+inline uint32_t XXHash64::read32( const uint8_t* p )
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+
+#endif // __xxhash64_h__
@@ -0,0 +1,33 @@
+#!/bin/sh
+#
+# test case: waitirq and irqenable, with FIFOs standing in for UIO devices
+#
+# usage: waitirq.sh [mempeek]
+#
+# creates two FIFOs in a temporary directory, passes them to include/waitirq.mp as the
+# inherited descriptors 3 and 4 and compares the output with the "# output:" block of
+# the script.
+#
+
+dir=$(dirname "$0")
+mempeek=${1:-$dir/../bin/mempeek}
+script=$dir/include/waitirq.mp
+
+tmp=$(mktemp -d "${TMPDIR:-/tmp}/mempeek-waitirq.XXXXXX") || exit 2
+trap 'rm -rf "$tmp"' EXIT
+trap 'exit 2' INT TERM
+
+mkfifo "$tmp/irq0" "$tmp/irq1" || exit 2
+
+sed -n '/^# output:/,/^#$/p' "$script" | sed -e '1d' -e '$d' -e 's/^# //' > "$tmp/expected"
+
+# the FIFOs are opened for reading and writing, so opening them does not block
+"$mempeek" "$script" > "$tmp/out" 2>&1 3<>"$tmp/irq0" 4<>"$tmp/irq1"
+
+if cmp -s "$tmp/expected" "$tmp/out"; then
+    echo "PASS waitirq"
+else
+    echo "FAIL waitirq"
+    diff "$tmp/expected" "$tmp/out"
+    exit 1
+fi